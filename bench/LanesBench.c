@@ -0,0 +1,109 @@
+#include "spi_lanes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define BENCH_LEN (64 * 1024)
+#define BENCH_ROUNDS 200
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Straightforward per-bit interleaving the kernels are compared against */
+static void naive_split(const u8* src, size len, u8 nbits, u8* dst)
+{
+    size stride = spi_lanes_stride(len, nbits);
+    size clock = 0;
+    memset(dst, 0, nbits * stride);
+    for (size i = 0; i < len; ++i) {
+        for (int first = 7; first >= 0; first -= nbits, ++clock) {
+            for (u8 k = 0; k < nbits; ++k) {
+                u8 bit = (src[i] >> (first - (nbits - 1) + k)) & 1;
+                dst[k * stride + clock / 8] |= (u8)(bit << (7 - clock % 8));
+            }
+        }
+    }
+}
+
+static void naive_merge(const u8* src, size len, u8 nbits, u8* dst)
+{
+    size stride = spi_lanes_stride(len, nbits);
+    size clock = 0;
+    for (size i = 0; i < len; ++i) {
+        u8 byte = 0;
+        for (int first = 7; first >= 0; first -= nbits, ++clock) {
+            for (u8 k = 0; k < nbits; ++k) {
+                u8 bit = (src[k * stride + clock / 8] >> (7 - clock % 8)) & 1;
+                byte |= (u8)(bit << (first - (nbits - 1) + k));
+            }
+        }
+        dst[i] = byte;
+    }
+}
+
+typedef void (*lanes_fn)(const u8* src, size len, u8 nbits, u8* dst);
+
+/* Return throughput in MB/s of data bytes */
+static double measure(lanes_fn fn, const u8* src, u8 nbits, u8* dst)
+{
+    double start = now();
+    for (int round = 0; round < BENCH_ROUNDS; ++round) {
+        fn(src, BENCH_LEN, nbits, dst);
+    }
+    return (double)BENCH_LEN * BENCH_ROUNDS / (now() - start) / 1e6;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------------- Main --------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+int main(void)
+{
+    u8* data = malloc(BENCH_LEN);
+    u8* lines = malloc(BENCH_LEN);
+    u8* check = malloc(BENCH_LEN);
+    if (NULL == data || NULL == lines || NULL == check) {
+        return EXIT_FAILURE;
+    }
+    for (size i = 0; i < BENCH_LEN; ++i) {
+        data[i] = (u8)(i * 131 + (i >> 8));
+    }
+
+    printf("%-6s %14s %14s %14s %14s\n", "lines", "naive split", "split", "naive merge", "merge");
+    const u8 widths[] = {SPI_LANES_DUAL, SPI_LANES_QUAD, SPI_LANES_OCTAL};
+    for (size w = 0; w < sizeof(widths); ++w) {
+        u8 nbits = widths[w];
+
+        /* Both implementations have to agree before their speed matters */
+        naive_split(data, BENCH_LEN, nbits, check);
+        spi_lanes_split(data, BENCH_LEN, nbits, lines);
+        if (0 != memcmp(check, lines, BENCH_LEN)) {
+            fprintf(stderr, "Split mismatch for %u lines\n", nbits);
+            return EXIT_FAILURE;
+        }
+
+        double ns = measure(naive_split, data, nbits, lines);
+        double ks = measure(spi_lanes_split, data, nbits, lines);
+        double nm = measure(naive_merge, lines, nbits, check);
+        double km = measure(spi_lanes_merge, lines, nbits, check);
+        printf("%-6u %9.1f MB/s %9.1f MB/s %9.1f MB/s %9.1f MB/s\n", nbits, ns, ks, nm, km);
+    }
+
+    free(check);
+    free(lines);
+    free(data);
+    return EXIT_SUCCESS;
+}
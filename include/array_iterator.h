@@ -169,6 +169,18 @@ bool array_iterator_create_const(iterator_instance* iter, const void* arr, size
  */
 bool array_iterator_create(iterator_instance* iter, void* arr, size elements, size element_size);
 
+/**
+ * Check whether the iterator is backed by the array implementation.
+ *
+ * Adaptors may use this function to access the underlying array directly (via array_iterator_ctx) instead of
+ * traversing it element by element.
+ *
+ * @param iter Pointer to an iterator instance.
+ *
+ * @return True if the iterator uses array implementation (const or non-const), false otherwise.
+ */
+bool array_iterator_is_array(const iterator_instance* iter);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,6 +20,13 @@ extern "C" {
 #define UNLIKELY
 #endif
 
+#if defined(__GNUC__) || defined(__clang__)
+/** Hint the CPU to fetch the cache line containing ADDR for reading */
+#define PREFETCH(ADDR) __builtin_prefetch((ADDR), 0, 3)
+#else
+#define PREFETCH(ADDR) ((void)(ADDR))
+#endif
+
 /** Return certain status code on unexpected NULL */
 #define NOT_NULL(PTR, STATUS) if (UNLIKELY(NULL == (PTR))) return (STATUS)
 
@@ -0,0 +1,141 @@
+#ifndef SPI_EMULATOR_DEVICE_CORO_H
+#define SPI_EMULATOR_DEVICE_CORO_H
+
+#include "type.h"
+#include "device_model.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Default MISO byte of a device whose body has finished before the chip-select was released */
+#define DEVICE_CORO_DEFAULT_IDLE 0xFF
+
+#if defined(__GNUC__) || defined(__clang__)
+/** Tell the compiler that a resume point is entered from the code above it as well. Do not use directly */
+#define DEVICE_CORO_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define DEVICE_CORO_FALLTHROUGH
+#endif
+
+/**
+ * Start the body of a coroutine device.
+ *
+ * Must be the first statement of the body. The body is re-entered at the point it waited at, so local variables do
+ * not survive a wait - keep everything in the device state.
+ */
+#define DEVICE_CORO_BEGIN(CO) switch ((CO)->line) { case 0:
+
+/**
+ * Exchange a single byte: send 'OUT' on MISO and store the MOSI byte in 'IN'.
+ *
+ * The body is suspended until the host clocks the byte. When the chip-select is released instead, 'IN' is left
+ * untouched and DEVICE_CORO_SELECTED() turns false; from then on exchanges do not wait at all, so the body runs to
+ * DEVICE_CORO_END() on the deselect call. Loops over an unknown number of bytes must check DEVICE_CORO_SELECTED().
+ */
+#define DEVICE_CORO_EXCHANGE(CO, OUT, IN)                                                                            \
+    do {                                                                                                             \
+        (CO)->line = __LINE__;                                                                                       \
+        DEVICE_CORO_FALLTHROUGH;                                                                                     \
+    case __LINE__:                                                                                                   \
+        if ((CO)->pos < (CO)->len) {                                                                                 \
+            (CO)->miso[(CO)->pos] = (u8)(OUT);                                                                       \
+            (IN) = NULL != (CO)->mosi ? (CO)->mosi[(CO)->pos] : 0;                                                   \
+            ++(CO)->pos;                                                                                             \
+        } else if ((CO)->selected) {                                                                                 \
+            return;                                                                                                  \
+        }                                                                                                            \
+    } while (0)
+
+/** Evaluates to true while the chip-select of the current transaction is asserted */
+#define DEVICE_CORO_SELECTED(CO) ((CO)->selected)
+
+/**
+ * Finish the body of a coroutine device.
+ *
+ * Bytes clocked after the body has finished are answered with the idle byte. The next chip-select assertion starts
+ * the body from the top.
+ */
+#define DEVICE_CORO_END(CO)                                                                                          \
+    }                                                                                                                \
+    (CO)->line = 0;                                                                                                  \
+    (CO)->done = true;                                                                                               \
+    return
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct device_coro_;
+
+/**
+ * Body of a coroutine device
+ *
+ * One run of the body is one transaction: it starts at the chip-select assertion and reads the command byte by byte
+ * with DEVICE_CORO_EXCHANGE(), written as plain sequential code instead of a hand-made state machine.
+ */
+typedef void (*device_coro_body)(struct device_coro_* co, void* state);
+
+/**
+ * Stackless coroutine device
+ *
+ * The coroutine is attached to a bus with DEVICE_CORO_OPS and itself as the device state. The bus engine resumes the
+ * body from its exchange call whenever bytes arrive, so any number of devices share the bus thread. A resume is an
+ * indirect call followed by a jump to the saved line - there is no stack to switch and nothing to allocate.
+ */
+typedef struct device_coro_
+{
+    u32 line; /**< Resume point of the body. Do not use directly */
+    bool selected; /**< Chip-select of the current transaction is asserted. Do not use directly */
+    bool done; /**< The body has finished the current transaction. Do not use directly */
+    u8 idle; /**< MISO byte sent once the body has finished */
+    const u8* mosi; /**< MOSI bytes of the current chunk or NULL for zeros. Do not use directly */
+    u8* miso; /**< MISO bytes of the current chunk. Do not use directly */
+    size len; /**< Length of the current chunk. Do not use directly */
+    size pos; /**< Next byte of the current chunk. Do not use directly */
+    device_coro_body body; /**< Body of the device */
+    void* state; /**< Device state passed to the body */
+    u64 resumes; /**< The number of times the body has been entered */
+} device_coro;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum device_coro_status_
+{
+    device_coro_status_ok, /**< Success */
+    device_coro_status_iptr /**< NULL pointer passed instead of a valid pointer */
+} device_coro_status;
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Global variables --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Operations of a coroutine device. Device state must point to device_coro */
+extern const spi_device_ops DEVICE_CORO_OPS;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Initialize coroutine device.
+ *
+ * @param co Pointer to a coroutine instance.
+ * @param body Body of the device.
+ * @param state Device state passed to the body.
+ * @param idle MISO byte sent once the body has finished, usually DEVICE_CORO_DEFAULT_IDLE.
+ *
+ * @return device_coro_status_iptr when NULL was passed instead of a valid pointer, device_coro_status_ok otherwise.
+ */
+device_coro_status device_coro_init(device_coro* co, device_coro_body body, void* state, u8 idle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_DEVICE_CORO_H
@@ -0,0 +1,115 @@
+#ifndef SPI_EMULATOR_DEVICE_MODEL_H
+#define SPI_EMULATOR_DEVICE_MODEL_H
+
+#include "type.h"
+#include "iterator.h"
+#include "array_iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Clock edges of a single word, reported in the cycle-accurate mode only
+ */
+typedef struct spi_cycle_
+{
+    u64 first_edge_ns; /**< Bus time of the first SCLK edge of the word */
+    u64 last_edge_ns; /**< Bus time of the last SCLK edge of the word */
+    u32 edges; /**< The number of SCLK edges (two per clock cycle) */
+} spi_cycle;
+
+/**
+ * Device model operations
+ *
+ * Data is exchanged a whole transfer (or a large chunk of it) at a time, never byte by byte. A single transfer may
+ * be split into several exchange calls between select and deselect.
+ *
+ * MOSI bytes come as a const iterator over u8, which is either a byte array (see device_mosi_array()) or any other
+ * iterator provided by the host. NULL means all MOSI bytes are zero. A generic iterator may end before 'len' bytes -
+ * the missing bytes are zero as well. device_mosi_read() takes care of all of these cases. MISO bytes are written to
+ * a buffer of 'len' bytes.
+ *
+ * On a cycle-accurate bus every word is exchanged separately and preceded by a timing call. Devices which do not care
+ * about timing leave it NULL and work on both kinds of buses unchanged.
+ */
+typedef struct spi_device_ops_
+{
+    void (*select)(void* device); /**< Chip-select asserted. Optional */
+    void (*exchange)(void* device, const iterator_instance* mosi, u8* miso, size len); /**< Required */
+    void (*deselect)(void* device); /**< Chip-select deasserted. Optional */
+    void (*timing)(void* device, const spi_cycle* cycle); /**< Word about to be exchanged. Optional */
+} spi_device_ops;
+
+/**
+ * MOSI bytes read in consecutive chunks
+ */
+typedef struct device_mosi_stream_
+{
+    const iterator_instance* mosi; /**< MOSI iterator being read. Do not use directly */
+    const u8* array; /**< Contiguous MOSI bytes or NULL. Do not use directly */
+    const void* current; /**< Next element of a generic iterator. Do not use directly */
+    const void* end; /**< Past-the-end element of a generic iterator. Do not use directly */
+    size offset; /**< The number of bytes already read */
+} device_mosi_stream;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Return contiguous MOSI bytes if there are any.
+ *
+ * @param mosi MOSI iterator passed to the exchange operation.
+ *
+ * @return Address of the first MOSI byte or NULL when the iterator is not a byte array.
+ */
+static inline const u8* device_mosi_array(const iterator_instance* mosi)
+{
+    if (NULL == mosi || !array_iterator_is_array(mosi)) {
+        return NULL;
+    }
+    return (const u8*)((const array_iterator_ctx*)mosi->context)->array_addr.addr_const;
+}
+
+/**
+ * Copy MOSI bytes to a buffer.
+ *
+ * Byte arrays are copied with memcpy, other iterators are traversed. Bytes past the end of the iterator are zeroed.
+ *
+ * @param mosi MOSI iterator passed to the exchange operation.
+ * @param dst Destination buffer.
+ * @param len The number of bytes to copy.
+ */
+void device_mosi_read(const iterator_instance* mosi, u8* dst, size len);
+
+/**
+ * Start reading MOSI bytes in chunks.
+ *
+ * Use it when the bytes do not fit in a single buffer. A generic iterator is traversed only once for all chunks.
+ *
+ * @param stream Pointer to a stream instance.
+ * @param mosi MOSI iterator passed to the exchange operation.
+ */
+void device_mosi_open(device_mosi_stream* stream, const iterator_instance* mosi);
+
+/**
+ * Copy the next chunk of MOSI bytes to a buffer.
+ *
+ * Bytes past the end of the iterator are zeroed, as for device_mosi_read().
+ *
+ * @param stream Pointer to a stream opened by device_mosi_open().
+ * @param dst Destination buffer.
+ * @param len The number of bytes to copy.
+ */
+void device_mosi_next(device_mosi_stream* stream, u8* dst, size len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_DEVICE_MODEL_H
@@ -0,0 +1,200 @@
+#ifndef SPI_EMULATOR_DEVICE_REGISTRY_H
+#define SPI_EMULATOR_DEVICE_REGISTRY_H
+
+#include "type.h"
+#include "device_model.h"
+#include "spi_mode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** The number of chip-select lines a registry can serve */
+#define DEVICE_REGISTRY_MAX_CS 256
+
+/** MISO byte of a null device - an undriven line pulled up */
+#define DEVICE_NULL_MISO 0xFF
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Kind of a registered device
+ */
+typedef enum device_kind_
+{
+    device_kind_model, /**< Device model with its own operations */
+    device_kind_loopback, /**< Built-in device answering every MOSI byte with the same byte on MISO */
+    device_kind_null /**< Built-in device discarding MOSI and answering with DEVICE_NULL_MISO */
+} device_kind;
+
+/**
+ * Check whether the response to a whole transaction depends on nothing but its MOSI bytes and the state version
+ *
+ * Return true only for side-effect-free commands, such as reading an identifier or a register.
+ */
+typedef bool (*device_pure)(void* device, const u8* mosi, size len);
+
+/**
+ * Registered device
+ *
+ * Operations are copied out of spi_device_ops when the device is registered and missing optional ones are replaced
+ * by no-ops, so a dispatch is a single indirect call without any checks. Mode transforms are precomputed as well.
+ */
+typedef struct device_entry_
+{
+    void (*select)(void* device); /**< Never NULL for a populated entry */
+    void (*exchange)(void* device, const iterator_instance* mosi, u8* miso, size len); /**< NULL if unpopulated */
+    void (*deselect)(void* device); /**< Never NULL for a populated entry */
+    void (*timing)(void* device, const spi_cycle* cycle); /**< Never NULL for a populated entry */
+    void* device; /**< Device model state passed to every operation */
+    spi_mode_transform mosi; /**< How the device sees words sent by the host */
+    spi_mode_transform miso; /**< How the host sees words sent by the device */
+    device_kind kind; /**< Built-in devices are served by the bus without calling their operations */
+    device_pure pure; /**< Tells which MOSI sequences have cacheable responses or NULL when nothing is cached */
+    const u64* version; /**< Version of the device state, changed whenever the state changes */
+} device_entry;
+
+/**
+ * Device registry - a flat table indexed by chip-select number
+ */
+typedef struct device_registry_
+{
+    device_entry entries[DEVICE_REGISTRY_MAX_CS]; /**< Devices indexed by chip-select number. Do not use directly */
+} device_registry;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum device_registry_status_
+{
+    device_registry_status_ok, /**< Success */
+    device_registry_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    device_registry_status_cerror /**< Chip-select out of range or exchange operation missing */
+} device_registry_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Initialize registry with all chip-select lines unpopulated.
+ *
+ * @param registry Pointer to a registry instance.
+ *
+ * @return device_registry_status_iptr when NULL was passed instead of a valid pointer, device_registry_status_ok
+ *         otherwise.
+ */
+device_registry_status device_registry_init(device_registry* registry);
+
+/**
+ * Register a device on a chip-select line.
+ *
+ * A device already registered on the line is replaced. Both ends are assumed to use the same mode.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ * @param ops Device model operations. Only the exchange operation is mandatory. The structure is not referenced
+ *            after the call.
+ * @param device Device model state.
+ *
+ * @return Operation status. Valid values are:
+ *          - device_registry_status_iptr when NULL was passed instead of a valid pointer
+ *          - device_registry_status_cerror when the chip-select is out of range or exchange operation is missing
+ *          - device_registry_status_ok on success
+ */
+device_registry_status device_registry_register(device_registry* registry, u32 cs, const spi_device_ops* ops,
+                                                void* device);
+
+/**
+ * Register a built-in device on a chip-select line.
+ *
+ * Built-in devices have operations like any other device, so they work on every path of the bus, but the bus
+ * recognizes them and moves whole byte arrays with a single memcpy or memset instead - or does nothing at all when
+ * MISO is discarded. A device already registered on the line is replaced.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ * @param kind Kind of the device. Must not be device_kind_model.
+ *
+ * @return Operation status. Valid values are:
+ *          - device_registry_status_iptr when NULL was passed instead of a valid pointer
+ *          - device_registry_status_cerror when the chip-select is out of range or the kind is not a built-in one
+ *          - device_registry_status_ok on success
+ */
+device_registry_status device_registry_register_builtin(device_registry* registry, u32 cs, device_kind kind);
+
+/**
+ * Opt a device into the response cache.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ * @param pure Predicate telling which transactions are cacheable or NULL to opt out.
+ * @param version Version of the device state. The device must change it on every change of the state that could
+ *                affect a cacheable response. May be NULL when opting out.
+ *
+ * @return Operation status. Valid values are:
+ *          - device_registry_status_iptr when NULL was passed instead of a valid pointer
+ *          - device_registry_status_cerror when the chip-select is out of range or not populated
+ *          - device_registry_status_ok on success
+ */
+device_registry_status device_registry_set_cache(device_registry* registry, u32 cs, device_pure pure,
+                                                 const u64* version);
+
+/**
+ * Configure modes of both ends of a chip-select line.
+ *
+ * Mixed-mode buses are emulated faithfully: a device clocking bits in a different order sees them reversed, a device
+ * sampling on the other clock edge sees the stream delayed by one bit.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ * @param host Mode the host uses for the line.
+ * @param device Mode the device model works in.
+ *
+ * @return Operation status. Valid values are:
+ *          - device_registry_status_iptr when NULL was passed instead of a valid pointer
+ *          - device_registry_status_cerror when the chip-select is out of range or not populated or a mode is invalid
+ *          - device_registry_status_ok on success
+ */
+device_registry_status device_registry_set_modes(device_registry* registry, u32 cs, const spi_mode* host,
+                                                 const spi_mode* device);
+
+/**
+ * Remove a device from a chip-select line.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ *
+ * @return Operation status. Valid values are the same as for device_registry_register().
+ */
+device_registry_status device_registry_unregister(device_registry* registry, u32 cs);
+
+/**
+ * Find the device of a chip-select line.
+ *
+ * The lookup is a bounds check and an array access regardless of the number of registered devices.
+ *
+ * @param registry Pointer to a registry instance.
+ * @param cs Chip-select number.
+ *
+ * @return Pointer to the device entry or NULL when the chip-select is out of range or not populated.
+ */
+static inline const device_entry* device_registry_lookup(const device_registry* registry, u32 cs)
+{
+    if (DEVICE_REGISTRY_MAX_CS <= cs || NULL == registry->entries[cs].exchange) {
+        return NULL;
+    }
+    return &registry->entries[cs];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_DEVICE_REGISTRY_H
@@ -0,0 +1,268 @@
+#ifndef SPI_EMULATOR_EMULATOR_H
+#define SPI_EMULATOR_EMULATOR_H
+
+#include "type.h"
+#include "spi_bus.h"
+#include "spi_queue.h"
+#include "scheduler.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** The maximum number of buses of an emulator instance */
+#define EMULATOR_MAX_BUSES 8
+
+/** Default capacity of a mailbox between two buses */
+#define EMULATOR_DEFAULT_MAILBOX 64
+
+/** Value of 'cpu' meaning the bus thread is not pinned */
+#define EMULATOR_NO_CPU (-1)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct emulator_;
+
+/**
+ * Message sent from one bus to another, for example an interrupt or GPIO line change
+ */
+typedef struct emulator_msg_
+{
+    u64 time_ns; /**< Virtual time the message takes effect at on the receiving bus */
+    u32 kind; /**< User defined message kind */
+    u32 line; /**< User defined line number */
+    u64 value; /**< User defined payload */
+} emulator_msg;
+
+/**
+ * Message handler - called on the thread of the receiving bus
+ *
+ * In the synchronized mode the scheduler of the receiving bus stands right before the timestamp of the message, so
+ * events should be scheduled relative to the timestamp rather than to the current time. The scheduler stays there
+ * while the handler runs - like a transfer issued from an event callback, a transfer issued by the handler moves only
+ * the bus time.
+ */
+typedef void (*emulator_handler)(struct emulator_* emu, u32 bus, u32 from, const emulator_msg* msg, void* ctx);
+
+/**
+ * Configuration of a single bus
+ */
+typedef struct emulator_bus_config_
+{
+    size scratch_size; /**< Scratch memory size of the bus */
+    size queue_entries; /**< Capacity of the submission queue. Must be a power of two */
+    int cpu; /**< CPU the bus thread is pinned to or EMULATOR_NO_CPU */
+    mem_allocator allocator; /**< Allocator for everything the bus owns */
+    mem_deallocator deallocator; /**< Deallocator matching the allocator */
+} emulator_bus_config;
+
+/**
+ * Single-producer single-consumer message ring between two buses
+ */
+typedef struct emulator_mailbox_
+{
+    emulator_msg* slots; /**< Ring memory. Do not use directly */
+    spi_queue_ring ring; /**< Ring indices. Do not use directly */
+    u64 last_ns; /**< Timestamp of the last posted message. Do not use directly */
+} emulator_mailbox;
+
+/**
+ * Bus of an emulator with everything it owns
+ *
+ * The bus, its scheduler and its inbound mailboxes are only touched by the bus thread - the worker of its queue. Each
+ * bus is a separate allocation made with its own allocator, so buses never share cache lines.
+ */
+typedef struct emulator_bus_
+{
+    spi_bus bus; /**< The bus. Use it through the queue only */
+    scheduler sched; /**< Scheduler driven by the bus */
+    spi_queue queue; /**< Submission queue. Its worker is the bus thread */
+    emulator_mailbox inbox[EMULATOR_MAX_BUSES]; /**< Messages from other buses indexed by sender. Do not use directly */
+    emulator_handler handler; /**< Message handler or NULL to drop messages. Do not use directly */
+    void* handler_ctx; /**< Context of the handler. Do not use directly */
+    mem_deallocator deallocator; /**< Deallocator of the bus. Do not use directly */
+    u64 clock_ns; /**< Time up to which the bus has run in synchronized mode. Do not use directly */
+    u64 overruns; /**< Times the scheduler was found past a message or the horizon. Zero unless the model moved it */
+    struct emulator_* emu; /**< Owning emulator. Do not use directly */
+    u32 index; /**< Index of the bus. Do not use directly */
+} emulator_bus;
+
+/**
+ * Emulator instance - several independent buses running in parallel
+ *
+ * Nothing is shared between buses apart from mailboxes, so the transfer path takes no locks.
+ *
+ * By default buses run freely and messages are delivered as soon as possible. In the synchronized mode buses follow
+ * the conservative parallel discrete-event scheme: every message is timestamped at least 'lookahead_ns' ahead of its
+ * sender, so a bus may safely run up to the slowest other bus plus the lookahead. Messages are delivered at their
+ * timestamps, before local events of the same time, ordered by time and then by sender. The outcome therefore
+ * depends on nothing but the model, and is the same whether buses run in parallel or one by one.
+ */
+typedef struct emulator_
+{
+    emulator_bus* buses[EMULATOR_MAX_BUSES]; /**< Buses. Do not use directly */
+    size count; /**< The number of buses */
+    size mailbox_entries; /**< Capacity of every mailbox */
+    u64 lookahead_ns; /**< Minimal latency of messages between buses or zero when buses run freely */
+    u64 until_ns; /**< Target of the current run. Do not use directly */
+    bool parallel; /**< Bus threads run the model. Do not use directly */
+    pthread_mutex_t lock; /**< Guards waiting for the end of a run. Do not use directly */
+    pthread_cond_t reached; /**< Signalled when a bus reaches the target of a run. Do not use directly */
+} emulator;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum emulator_status_
+{
+    emulator_status_ok, /**< Success */
+    emulator_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    emulator_status_merror, /**< Memory allocator failed */
+    emulator_status_cerror, /**< Invalid parameters or a bus thread cannot be started */
+    emulator_status_busy /**< Mailbox is full */
+} emulator_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Construct emulator instance and start a thread for every bus.
+ *
+ * @param emu Pointer to an emulator instance.
+ * @param configs Array of bus configurations.
+ * @param count The number of buses. At most EMULATOR_MAX_BUSES.
+ * @param mailbox_entries Capacity of a mailbox between any two buses. Must be a power of two.
+ *
+ * @return Operation status. Valid values are:
+ *          - emulator_status_iptr when NULL was passed instead of a valid pointer
+ *          - emulator_status_cerror when parameters are invalid, a thread cannot be started or pinned
+ *          - emulator_status_merror when memory allocator failed
+ *          - emulator_status_ok on success
+ */
+emulator_status emulator_construct(emulator* emu, const emulator_bus_config* configs, size count,
+                                   size mailbox_entries);
+
+/**
+ * Destruct emulator instance.
+ *
+ * Submitted messages are executed before bus threads quit. Undelivered mailbox messages are dropped.
+ *
+ * @param emu Pointer to an emulator instance.
+ *
+ * @return emulator_status_iptr when NULL was passed instead of a valid pointer, emulator_status_ok otherwise.
+ */
+emulator_status emulator_destruct(emulator* emu);
+
+/**
+ * Get a bus of the emulator.
+ *
+ * @param emu Pointer to an emulator instance.
+ * @param bus Index of the bus.
+ *
+ * @return Pointer to the bus or NULL when the index is out of range.
+ */
+static inline emulator_bus* emulator_bus_at(const emulator* emu, u32 bus)
+{
+    return bus < emu->count ? emu->buses[bus] : NULL;
+}
+
+/**
+ * Install a message handler of a bus.
+ *
+ * Install handlers before any message can be posted.
+ *
+ * @param emu Pointer to an emulator instance.
+ * @param bus Index of the bus.
+ * @param handler Message handler.
+ * @param ctx Context of the handler.
+ *
+ * @return Operation status. Valid values are:
+ *          - emulator_status_iptr when NULL was passed instead of a valid pointer
+ *          - emulator_status_cerror when the index is out of range
+ *          - emulator_status_ok on success
+ */
+emulator_status emulator_set_handler(emulator* emu, u32 bus, emulator_handler handler, void* ctx);
+
+/**
+ * Switch the emulator to the synchronized mode.
+ *
+ * In this mode the model is driven by scheduled events only and time moves with emulator_run() or
+ * emulator_run_serial(). Submitting to the queues of the buses breaks determinism. Call it before any message is
+ * posted.
+ *
+ * @param emu Pointer to an emulator instance.
+ * @param lookahead_ns Minimal latency of messages between buses. The larger it is, the more work buses do between
+ *                     synchronizations.
+ *
+ * @return Operation status. Valid values are:
+ *          - emulator_status_iptr when NULL was passed instead of a valid pointer
+ *          - emulator_status_cerror when the lookahead is zero
+ *          - emulator_status_ok on success
+ */
+emulator_status emulator_synchronize(emulator* emu, u64 lookahead_ns);
+
+/**
+ * Run all buses in parallel up to a virtual time.
+ *
+ * Every bus runs on its own thread, as far ahead as its horizon allows. The call returns once all of them have
+ * reached the target.
+ *
+ * @param emu Pointer to a synchronized emulator instance.
+ * @param until_ns Target virtual time.
+ *
+ * @return Operation status. Valid values are:
+ *          - emulator_status_iptr when NULL was passed instead of a valid pointer
+ *          - emulator_status_cerror when the emulator is not synchronized or the target lies in the past
+ *          - emulator_status_ok on success
+ */
+emulator_status emulator_run(emulator* emu, u64 until_ns);
+
+/**
+ * Run all buses one by one on the calling thread up to a virtual time.
+ *
+ * The outcome is identical to emulator_run(). Use it as a reference or when threads are not wanted, but do not mix
+ * both kinds of runs on a single instance.
+ *
+ * @param emu Pointer to a synchronized emulator instance.
+ * @param until_ns Target virtual time.
+ *
+ * @return Operation status. Return values are the same as for emulator_run().
+ */
+emulator_status emulator_run_serial(emulator* emu, u64 until_ns);
+
+/**
+ * Post a message from one bus to another.
+ *
+ * Must be called on the thread of the sending bus - from a device model, a scheduled event, a completion callback or
+ * a message handler. The message is delivered on the thread of the receiving bus. Messages between two buses keep
+ * their order. In the synchronized mode the message must be timestamped at least the lookahead past the current time
+ * of the sender's scheduler - the deadline of the firing event or right before the timestamp of the message being
+ * handled - and more than the lookahead past the time the sender reached by the previous run. Timestamps of messages
+ * between two buses must not decrease either, so every mailbox stays sorted.
+ *
+ * @param emu Pointer to an emulator instance.
+ * @param from Index of the sending bus.
+ * @param to Index of the receiving bus.
+ * @param msg Message. It is copied.
+ *
+ * @return Operation status. Valid values are:
+ *          - emulator_status_iptr when NULL was passed instead of a valid pointer
+ *          - emulator_status_cerror when an index is out of range or the timestamp is too early or out of order
+ *          - emulator_status_busy when the mailbox is full
+ *          - emulator_status_ok on success
+ */
+emulator_status emulator_post(emulator* emu, u32 from, u32 to, const emulator_msg* msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_EMULATOR_H
@@ -0,0 +1,132 @@
+#ifndef SPI_EMULATOR_ENDIAN_ITERATOR_H
+#define SPI_EMULATOR_ENDIAN_ITERATOR_H
+
+#include "type.h"
+#include "iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Number of elements converted at once */
+#define ENDIAN_ITERATOR_BLOCK 32
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Endian iterator context
+ *
+ * The iterator wraps another const iterator and yields its elements with reversed byte order. Elements are converted
+ * block by block into an internal buffer. When the source is an array iterator the whole block is converted by a
+ * single call to endian_swap(), otherwise elements are pulled one by one from the source.
+ */
+typedef struct endian_iterator_ctx_
+{
+    const iterator_instance* source; /**< Wrapped iterator */
+    size element_size; /**< Size of an element (2, 4 or 8) */
+    const u8* array; /**< Source array when the fast path is used, NULL otherwise. Do not use directly */
+    size num_of_elements; /**< Number of elements in the source array (fast path only). Do not use directly */
+    const void* source_current; /**< Current element of the source (generic path only). Do not use directly */
+    size block_start; /**< Index of the first element held in the block. Do not use directly */
+    size block_len; /**< The number of valid elements in the block. Do not use directly */
+    size current_idx; /**< Index of the current element within the block. Do not use directly */
+    u64 block[ENDIAN_ITERATOR_BLOCK]; /**< Converted elements. Do not use directly */
+} endian_iterator_ctx;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum endian_iterator_status_
+{
+    endian_iterator_status_ok, /**< Success */
+    endian_iterator_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    endian_iterator_status_cerror /**< An error occurred while setting up the context */
+} endian_iterator_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Reverse byte order of every element while copying them.
+ *
+ * The conversion is done with pshufb (SSSE3/AVX2) when the target supports it and with bswap otherwise. Source and
+ * destination may be the same buffer, in which case the conversion is done in place.
+ *
+ * @param dst Destination buffer.
+ * @param src Source buffer.
+ * @param count The number of elements.
+ * @param element_size Size of an element. Valid values are 2, 4 and 8 - other sizes are copied unchanged.
+ */
+void endian_swap(void* dst, const void* src, size count, size element_size);
+
+/**
+ * Initialize iterator context for byte swapping.
+ *
+ * @param iterator Pointer to an iterator instance. It has to be preconfigured as a const type as well as the context
+ *                 memory must be allocated.
+ * @param source Pointer to a const iterator which provides elements. It must outlive the endian iterator. An array
+ *               iterator must hold elements of 'element_size' bytes.
+ * @param element_size Size of an element (2, 4 or 8).
+ *
+ * @return Valid return codes are:
+ *          - endian_iterator_status_iptr when NULL was passed instead of a valid pointer
+ *          - endian_iterator_status_cerror when one or more parameters are invalid or the sizes of array elements
+ *            do not match
+ *          - endian_iterator_status_ok on success
+ */
+endian_iterator_status endian_iterator_init_ctx(iterator_instance* iterator,
+                                                const iterator_instance* source,
+                                                size element_size);
+
+/**
+ * Return const iterator pointing to the first converted element.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the element that must be explicitly casted to u16, u32 or u64 afterwards.
+ */
+const void* endian_iterator_begin(void* context);
+
+/**
+ * Return const iterator pointing to the next converted element.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the element that must be explicitly casted to u16, u32 or u64 afterwards.
+ */
+const void* endian_iterator_next(void* context);
+
+/**
+ * Return const iterator pointing to the past-the-end element.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address which is never returned for a valid element.
+ */
+const void* endian_iterator_end(void* context);
+
+/**
+ * Create and initialize endian iterator.
+ *
+ * Created iterator must be explicitly deleted by the caller afterwards.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param source Pointer to a const iterator which provides elements.
+ * @param element_size Size of an element (2, 4 or 8).
+ *
+ * @return True on success, false on failure.
+ */
+bool endian_iterator_create(iterator_instance* iter, const iterator_instance* source, size element_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_ENDIAN_ITERATOR_H
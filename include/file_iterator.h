@@ -0,0 +1,145 @@
+#ifndef SPI_EMULATOR_FILE_ITERATOR_H
+#define SPI_EMULATOR_FILE_ITERATOR_H
+
+#include "type.h"
+#include "iterator.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Default size of a single read-ahead buffer */
+#define FILE_ITERATOR_DEFAULT_CHUNK (1024 * 1024)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * File iterator context
+ *
+ * A background thread reads the file into two alternating buffers. The consumer iterates one buffer while the
+ * other one is being filled. Both buffers are placed right after the context within the same allocation, see
+ * file_iterator_ctx_size().
+ */
+typedef struct file_iterator_ctx_
+{
+    int fd; /**< File descriptor owned by the iterator */
+    size chunk_size; /**< Capacity of a single buffer */
+    bool error; /**< Set when a read error ended the traversal prematurely */
+    size lengths[2]; /**< The number of valid bytes in each buffer. Do not use directly */
+    bool full[2]; /**< Buffer is ready to be consumed. Do not use directly */
+    size current; /**< Buffer being consumed. Do not use directly */
+    bool running; /**< Reader thread is alive. Do not use directly */
+    bool stop; /**< Request for the reader thread to quit. Do not use directly */
+    pthread_t reader; /**< Reader thread. Do not use directly */
+    pthread_mutex_t lock; /**< Protects buffer states. Do not use directly */
+    pthread_cond_t cond; /**< Signalled on every buffer state change. Do not use directly */
+    iterator_span span; /**< The current chunk. Do not use directly */
+} file_iterator_ctx;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum file_iterator_status_
+{
+    file_iterator_status_ok, /**< Success */
+    file_iterator_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    file_iterator_status_cerror /**< An error occurred while setting up the context */
+} file_iterator_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Return the number of context bytes needed by a file iterator.
+ *
+ * @param chunk_size Capacity of a single buffer.
+ *
+ * @return Size to pass to iterator_construct().
+ */
+static inline size file_iterator_ctx_size(size chunk_size)
+{
+    return sizeof(file_iterator_ctx) + 2 * chunk_size;
+}
+
+/**
+ * Initialize iterator context for file reading.
+ *
+ * The reader thread is started by the begin function, so nothing is read until the traversal starts. The iterator
+ * has to be released with file_iterator_destroy() afterwards.
+ *
+ * @param iterator Pointer to an iterator instance. It has to be preconfigured as a const type as well as the context
+ *                 memory must be allocated (at least file_iterator_ctx_size(chunk_size) bytes).
+ * @param fd Seekable file descriptor opened for reading. The iterator takes ownership of it.
+ * @param chunk_size Capacity of a single buffer. Cannot be zero.
+ *
+ * @return Valid return codes are:
+ *          - file_iterator_status_iptr when NULL was passed instead of a valid pointer
+ *          - file_iterator_status_cerror when one or more parameters are invalid
+ *          - file_iterator_status_ok on success
+ */
+file_iterator_status file_iterator_init_ctx(iterator_instance* iterator, int fd, size chunk_size);
+
+/**
+ * Return const iterator pointing to the first chunk.
+ *
+ * Any reading in progress is cancelled and the file is read from the beginning again.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of an iterator_span describing the chunk.
+ */
+const void* file_iterator_begin(void* context);
+
+/**
+ * Return const iterator pointing to the next chunk.
+ *
+ * The buffer of the previous chunk is handed back to the reader thread, so spans must not be kept across calls.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of an iterator_span describing the chunk.
+ */
+const void* file_iterator_next(void* context);
+
+/**
+ * Return const iterator pointing to the past-the-end chunk.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Always NULL.
+ */
+const void* file_iterator_end(void* context);
+
+/**
+ * Create and initialize file iterator.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param path Path to the file.
+ * @param chunk_size Capacity of a single buffer.
+ *
+ * @return True on success, false on failure.
+ */
+bool file_iterator_create(iterator_instance* iter, const char* path, size chunk_size);
+
+/**
+ * Stop the reader thread, close the file and destruct the iterator.
+ *
+ * @param iter Pointer to an iterator instance initialized by file_iterator_init_ctx() or file_iterator_create().
+ *
+ * @return Operation status. Valid values are the same as for iterator_destruct().
+ */
+iterator_status file_iterator_destroy(iterator_instance* iter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_FILE_ITERATOR_H
@@ -0,0 +1,201 @@
+#ifndef SPI_EMULATOR_GENERATOR_ITERATOR_H
+#define SPI_EMULATOR_GENERATOR_ITERATOR_H
+
+#include "type.h"
+#include "iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Generator function type.
+ *
+ * The function is called each time the iterator needs a new chunk.
+ *
+ * @param user_data Generator state passed during initialization.
+ * @param buffer Buffer to fill.
+ * @param len Capacity of the buffer.
+ *
+ * @return The number of bytes written. Zero ends the sequence.
+ */
+typedef size (*generator_fill)(void* user_data, u8* buffer, size len);
+
+/**
+ * Generator iterator context
+ *
+ * The chunk buffer is placed right after the context within the same allocation, see generator_iterator_ctx_size().
+ */
+typedef struct generator_iterator_ctx_
+{
+    generator_fill fill; /**< Generator function */
+    void* user_data; /**< Generator state */
+    size chunk_size; /**< Capacity of the chunk buffer */
+    size limit; /**< Total number of bytes to generate. Zero means the generator decides when to stop */
+    size produced; /**< The number of bytes generated since begin. Do not use directly */
+    iterator_span span; /**< The current chunk. Do not use directly */
+} generator_iterator_ctx;
+
+/**
+ * State of the constant generator
+ */
+typedef struct generator_constant_state_
+{
+    u8 value; /**< Byte to repeat (e.g. 0xFF for dummy bytes) */
+} generator_constant_state;
+
+/**
+ * State of the counter generator
+ */
+typedef struct generator_counter_state_
+{
+    u8 next; /**< Value of the next byte */
+} generator_counter_state;
+
+/**
+ * State of the PRBS generator
+ */
+typedef struct generator_prbs_state_
+{
+    u32 lfsr; /**< Recent bits of the sequence. The most recent one is the LSB */
+    u8 order; /**< Polynomial order (7, 15, 23 or 31) */
+    u8 tap; /**< The second tap of the polynomial */
+} generator_prbs_state;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum generator_iterator_status_
+{
+    generator_iterator_status_ok, /**< Success */
+    generator_iterator_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    generator_iterator_status_cerror /**< An error occurred while setting up the context */
+} generator_iterator_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Return the number of context bytes needed by a generator iterator.
+ *
+ * @param chunk_size Capacity of the chunk buffer.
+ *
+ * @return Size to pass to iterator_construct().
+ */
+static inline size generator_iterator_ctx_size(size chunk_size)
+{
+    return sizeof(generator_iterator_ctx) + chunk_size;
+}
+
+/**
+ * Initialize iterator context for generating data.
+ *
+ * @param iterator Pointer to an iterator instance. It has to be preconfigured as a const type as well as the context
+ *                 memory must be allocated (at least generator_iterator_ctx_size(chunk_size) bytes).
+ * @param fill Generator function.
+ * @param user_data Generator state passed to the generator function.
+ * @param chunk_size Capacity of the chunk buffer. Cannot be zero.
+ * @param limit Total number of bytes to generate or zero to let the generator decide.
+ *
+ * @return Valid return codes are:
+ *          - generator_iterator_status_iptr when NULL was passed instead of a valid pointer
+ *          - generator_iterator_status_cerror when one or more parameters are invalid
+ *          - generator_iterator_status_ok on success
+ */
+generator_iterator_status generator_iterator_init_ctx(iterator_instance* iterator,
+                                                      generator_fill fill,
+                                                      void* user_data,
+                                                      size chunk_size,
+                                                      size limit);
+
+/**
+ * Return const iterator pointing to the first chunk.
+ *
+ * The byte counter is reset, but the generator state is not - it is up to the caller to rewind it if needed.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of an iterator_span describing the chunk.
+ */
+const void* generator_iterator_begin(void* context);
+
+/**
+ * Return const iterator pointing to the next chunk.
+ *
+ * The previous chunk is overwritten, so spans must not be kept across calls.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of an iterator_span describing the chunk.
+ */
+const void* generator_iterator_next(void* context);
+
+/**
+ * Return const iterator pointing to the past-the-end chunk.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Always NULL.
+ */
+const void* generator_iterator_end(void* context);
+
+/**
+ * Create and initialize generator iterator.
+ *
+ * Created iterator must be explicitly deleted by the caller afterwards.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param fill Generator function.
+ * @param user_data Generator state passed to the generator function.
+ * @param chunk_size Capacity of the chunk buffer.
+ * @param limit Total number of bytes to generate or zero to let the generator decide.
+ *
+ * @return True on success, false on failure.
+ */
+bool generator_iterator_create(iterator_instance* iter,
+                               generator_fill fill,
+                               void* user_data,
+                               size chunk_size,
+                               size limit);
+
+/**
+ * Generator repeating a single byte. User data must point to generator_constant_state.
+ */
+size generator_constant(void* user_data, u8* buffer, size len);
+
+/**
+ * Generator producing incrementing bytes (wrapping at 0xFF). User data must point to generator_counter_state.
+ */
+size generator_counter(void* user_data, u8* buffer, size len);
+
+/**
+ * Initialize PRBS generator state.
+ *
+ * Supported sequences are PRBS7, PRBS15, PRBS23 and PRBS31 as defined by ITU-T O.150. Bits are emitted MSB-first.
+ *
+ * @param state Pointer to a generator state.
+ * @param order Polynomial order (7, 15, 23 or 31).
+ * @param seed Initial register value. Its lower 'order' bits cannot be all zeros.
+ *
+ * @return Valid return codes are:
+ *          - generator_iterator_status_iptr when NULL was passed instead of a valid pointer
+ *          - generator_iterator_status_cerror when one or more parameters are invalid
+ *          - generator_iterator_status_ok on success
+ */
+generator_iterator_status generator_prbs_init(generator_prbs_state* state, u8 order, u32 seed);
+
+/**
+ * Generator producing a pseudo random bit sequence. User data must point to generator_prbs_state.
+ */
+size generator_prbs(void* user_data, u8* buffer, size len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_GENERATOR_ITERATOR_H
@@ -98,6 +98,18 @@ typedef struct iterator_instance_
     } end;
 } iterator_instance;
 
+/**
+ * Contiguous chunk of bytes
+ *
+ * Chunked iterator implementations (e.g. generators or file readers) yield pointers to spans instead of single
+ * elements, so consumers can process whole chunks at once.
+ */
+typedef struct iterator_span_
+{
+    const void* data; /**< Address of the first byte */
+    size len; /**< The number of bytes */
+} iterator_span;
+
 /**
  * Status codes returned by API functions
  */
@@ -0,0 +1,303 @@
+#ifndef SPI_EMULATOR_LIST_H
+#define SPI_EMULATOR_LIST_H
+
+#include "type.h"
+#include "iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Get address of the structure which embeds the list node PTR as MEMBER */
+#define LIST_ENTRY(PTR, TYPE, MEMBER) ((TYPE*)((char*)(PTR) - offsetof(TYPE, MEMBER)))
+
+/** Default number of nodes the list iterator prefetches ahead */
+#define LIST_ITERATOR_DEFAULT_PREFETCH 4
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Singly linked list node. Embed it in a user structure - lists never allocate nodes on their own
+ */
+typedef struct slist_node_
+{
+    struct slist_node_* next; /**< Next node or NULL */
+} slist_node;
+
+/**
+ * Doubly linked list node
+ *
+ * Forward links are kept in the embedded singly linked node, therefore the same iterator works for both lists.
+ */
+typedef struct dlist_node_
+{
+    slist_node link; /**< Forward link. Must be the first member */
+    struct dlist_node_* prev; /**< Previous node or NULL */
+} dlist_node;
+
+/**
+ * Singly linked list
+ */
+typedef struct slist_
+{
+    slist_node* head; /**< The first node or NULL */
+    slist_node* tail; /**< The last node or NULL */
+    size count; /**< The number of nodes */
+} slist;
+
+/**
+ * Doubly linked list
+ */
+typedef struct dlist_
+{
+    slist_node* head; /**< Forward link of the first node or NULL */
+    dlist_node* tail; /**< The last node or NULL */
+    size count; /**< The number of nodes */
+} dlist;
+
+/**
+ * List iterator context
+ */
+typedef struct list_iterator_ctx_
+{
+    slist_node* const* head; /**< Address of the list head */
+    size prefetch_distance; /**< How many nodes ahead of the current one are prefetched */
+    slist_node* current; /**< Current node. Do not use directly */
+    slist_node* next; /**< Successor of the current node, read before the node is returned. Do not use directly */
+    slist_node* ahead; /**< Node being prefetched. Do not use directly */
+} list_iterator_ctx;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum list_status_
+{
+    list_status_ok, /**< Success */
+    list_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    list_status_cerror /**< The node does not belong to the list */
+} list_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Initialize an empty singly linked list.
+ *
+ * @param list Pointer to a list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status slist_init(slist* list);
+
+/**
+ * Insert a node at the beginning of a singly linked list.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to insert. It must not belong to any list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status slist_push_front(slist* list, slist_node* node);
+
+/**
+ * Insert a node at the end of a singly linked list.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to insert. It must not belong to any list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status slist_push_back(slist* list, slist_node* node);
+
+/**
+ * Remove the first node from a singly linked list.
+ *
+ * @param list Pointer to a list.
+ *
+ * @return Removed node or NULL when the list is empty.
+ */
+slist_node* slist_pop_front(slist* list);
+
+/**
+ * Remove a node from a singly linked list.
+ *
+ * The operation has to find a predecessor of the node, therefore its complexity is linear. Use doubly linked list
+ * when nodes are removed frequently.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to remove.
+ *
+ * @return Valid return codes are:
+ *          - list_status_iptr when NULL was passed instead of a valid pointer
+ *          - list_status_cerror when the node does not belong to the list
+ *          - list_status_ok on success
+ */
+list_status slist_remove(slist* list, slist_node* node);
+
+/**
+ * Initialize an empty doubly linked list.
+ *
+ * @param list Pointer to a list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status dlist_init(dlist* list);
+
+/**
+ * Insert a node at the beginning of a doubly linked list.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to insert. It must not belong to any list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status dlist_push_front(dlist* list, dlist_node* node);
+
+/**
+ * Insert a node at the end of a doubly linked list.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to insert. It must not belong to any list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status dlist_push_back(dlist* list, dlist_node* node);
+
+/**
+ * Remove the first node from a doubly linked list.
+ *
+ * @param list Pointer to a list.
+ *
+ * @return Removed node or NULL when the list is empty.
+ */
+dlist_node* dlist_pop_front(dlist* list);
+
+/**
+ * Remove a node from a doubly linked list in constant time.
+ *
+ * @param list Pointer to a list.
+ * @param node Node to remove. It must belong to the list.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status dlist_remove(dlist* list, dlist_node* node);
+
+/**
+ * Move all nodes of one doubly linked list to the end of another one in constant time.
+ *
+ * @param list Destination list.
+ * @param other Source list. It is empty after the operation.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status dlist_splice(dlist* list, dlist* other);
+
+/**
+ * Initialize iterator context for list traversing.
+ *
+ * The iterator yields slist_node pointers. For doubly linked lists they may be casted to dlist_node directly. Since
+ * the head is read on every begin, the list may be modified between traversals.
+ *
+ * @param iterator Pointer to an iterator instance. The context memory must be allocated.
+ * @param head Address of the list head (&list->head of either slist or dlist).
+ * @param prefetch_distance How many nodes ahead of the current one are prefetched. Zero disables prefetching.
+ *
+ * @return list_status_iptr when NULL was passed instead of a valid pointer, list_status_ok otherwise.
+ */
+list_status list_iterator_init_ctx(iterator_instance* iterator, slist_node* const* head, size prefetch_distance);
+
+/**
+ * Return const iterator pointing to the first node.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the node.
+ */
+const void* list_iterator_const_begin(void* context);
+
+/**
+ * Return const iterator pointing to the next node.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the node.
+ */
+const void* list_iterator_const_next(void* context);
+
+/**
+ * Return const iterator pointing to the past-the-end node.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Always NULL.
+ */
+const void* list_iterator_const_end(void* context);
+
+/**
+ * Return non-const iterator pointing to the first node.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the node.
+ */
+void* list_iterator_begin(void* context);
+
+/**
+ * Return non-const iterator pointing to the next node.
+ *
+ * The current node may be removed from the list before calling this function, as its successor has already been
+ * read. Other nodes must not be removed during the traversal.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the node.
+ */
+void* list_iterator_next(void* context);
+
+/**
+ * Return non-const iterator pointing to the past-the-end node.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Always NULL.
+ */
+void* list_iterator_end(void* context);
+
+/**
+ * Create and initialize const list iterator.
+ *
+ * Only the iterator context is allocated. Created iterator must be explicitly deleted by the caller afterwards.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param head Address of the list head (&list->head of either slist or dlist).
+ * @param prefetch_distance How many nodes ahead of the current one are prefetched.
+ *
+ * @return True on success, false on failure.
+ */
+bool list_iterator_create_const(iterator_instance* iter, slist_node* const* head, size prefetch_distance);
+
+/**
+ * Create and initialize non-const list iterator.
+ *
+ * Only the iterator context is allocated. Created iterator must be explicitly deleted by the caller afterwards.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param head Address of the list head (&list->head of either slist or dlist).
+ * @param prefetch_distance How many nodes ahead of the current one are prefetched.
+ *
+ * @return True on success, false on failure.
+ */
+bool list_iterator_create(iterator_instance* iter, slist_node* const* head, size prefetch_distance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_LIST_H
@@ -0,0 +1,158 @@
+#ifndef SPI_EMULATOR_PACKED_ITERATOR_H
+#define SPI_EMULATOR_PACKED_ITERATOR_H
+
+#include "type.h"
+#include "iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Number of fields unpacked by a single kernel call */
+#define PACKED_ITERATOR_BLOCK 64
+
+/** The widest field supported by the packed iterator */
+#define PACKED_ITERATOR_MAX_WIDTH 16
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Packed iterator context
+ *
+ * Fields are stored MSB-first, back to back, exactly as they are shifted out on the wire. The iterator unpacks
+ * PACKED_ITERATOR_BLOCK fields at once into an internal buffer and yields pointers to u16 values from there.
+ */
+typedef struct packed_iterator_ctx_
+{
+    const u8* data; /**< Address of the packed byte array */
+    size num_of_fields; /**< The number of fields stored in the array */
+    u8 width; /**< Width of a single field in bits */
+    size block_start; /**< Index of the first field held in the block. Do not use directly */
+    size block_len; /**< The number of valid fields in the block. Do not use directly */
+    size current_idx; /**< Index of the current field within the block. Do not use directly */
+    u16 block[PACKED_ITERATOR_BLOCK]; /**< Unpacked fields. Do not use directly */
+} packed_iterator_ctx;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum packed_iterator_status_
+{
+    packed_iterator_status_ok, /**< Success */
+    packed_iterator_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    packed_iterator_status_cerror /**< An error occurred while setting up the context */
+} packed_iterator_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Return the number of bytes occupied by packed fields.
+ *
+ * @param fields The number of fields.
+ * @param width Width of a single field in bits.
+ *
+ * @return Number of bytes (the last one may be only partially used).
+ */
+static inline size packed_bytes(size fields, u8 width)
+{
+    return (fields * width + 7) / 8;
+}
+
+/**
+ * Unpack fixed-width fields from a packed byte array.
+ *
+ * Even widths are handled by a SIMD kernel (SSE4.1 or AVX2, depending on the target) which processes a whole block
+ * of fields per iteration. Other widths and the tail fall back to a scalar bit accumulator.
+ *
+ * @param src Packed source. The first field starts at the most significant bit of the first byte.
+ * @param dst Destination buffer for at least 'fields' values.
+ * @param fields The number of fields to unpack.
+ * @param width Width of a single field in bits (1 - PACKED_ITERATOR_MAX_WIDTH).
+ */
+void packed_unpack(const u8* src, u16* dst, size fields, u8 width);
+
+/**
+ * Pack fixed-width fields into a byte array.
+ *
+ * This is the reverse of packed_unpack() and can be used for generating device responses. Bits above 'width' are
+ * ignored. Unused bits of the last byte are cleared.
+ *
+ * @param src Fields to pack.
+ * @param dst Destination buffer for at least packed_bytes(fields, width) bytes.
+ * @param fields The number of fields to pack.
+ * @param width Width of a single field in bits (1 - PACKED_ITERATOR_MAX_WIDTH).
+ */
+void packed_pack(const u16* src, u8* dst, size fields, u8 width);
+
+/**
+ * Initialize iterator context for packed array traversing.
+ *
+ * @param iterator Pointer to an iterator instance. It has to be preconfigured as a const type as well as the context
+ *                 memory must be allocated.
+ * @param data Address of the packed array.
+ * @param fields Total number of fields in the array.
+ * @param width Width of a single field in bits (1 - PACKED_ITERATOR_MAX_WIDTH).
+ *
+ * @return Valid return codes are:
+ *          - packed_iterator_status_iptr when NULL was passed instead of a valid pointer
+ *          - packed_iterator_status_cerror when one or more parameters are invalid
+ *          - packed_iterator_status_ok on success
+ */
+packed_iterator_status packed_iterator_init_ctx(iterator_instance* iterator, const void* data, size fields, u8 width);
+
+/**
+ * Return const iterator pointing to the first unpacked field.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the field as u16.
+ */
+const void* packed_iterator_begin(void* context);
+
+/**
+ * Return const iterator pointing to the next unpacked field.
+ *
+ * The next block is unpacked when the current one is exhausted.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address of the field as u16.
+ */
+const void* packed_iterator_next(void* context);
+
+/**
+ * Return const iterator pointing to the past-the-end field.
+ *
+ * @param context Pointer to an iterator context.
+ *
+ * @return Address which is never returned for a valid field.
+ */
+const void* packed_iterator_end(void* context);
+
+/**
+ * Create and initialize packed iterator.
+ *
+ * Created iterator must be explicitly deleted by the caller afterwards.
+ *
+ * @param iter Pointer to an iterator instance (uninitialized).
+ * @param data Address of the packed array.
+ * @param fields Number of fields in the array.
+ * @param width Width of a single field in bits.
+ *
+ * @return True on success, false on failure.
+ */
+bool packed_iterator_create(iterator_instance* iter, const void* data, size fields, u8 width);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_PACKED_ITERATOR_H
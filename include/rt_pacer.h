@@ -0,0 +1,148 @@
+#ifndef SPI_EMULATOR_RT_PACER_H
+#define SPI_EMULATOR_RT_PACER_H
+
+#include "type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Default length of the busy-poll window before a deadline */
+#define RT_PACER_DEFAULT_SPIN_NS 50000
+
+/** Default lateness still not counted as a deadline miss */
+#define RT_PACER_DEFAULT_TOLERANCE_NS 2000
+
+/** Value of 'cpu' meaning the pacing thread is not pinned */
+#define RT_PACER_NO_CPU (-1)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum rt_pacer_status_
+{
+    rt_pacer_status_ok, /**< Success */
+    rt_pacer_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    rt_pacer_status_cerror /**< Timer cannot be created or the CPU cannot be used */
+} rt_pacer_status;
+
+/**
+ * Pacing statistics
+ */
+typedef struct rt_pacer_stats_
+{
+    u64 waits; /**< The number of paced steps */
+    u64 misses; /**< Steps which ended later than the tolerance allows */
+    u64 worst_late_ns; /**< The largest lateness seen */
+    u64 total_late_ns; /**< Sum of lateness over all steps */
+} rt_pacer_stats;
+
+/**
+ * Real-time pacer
+ *
+ * Maps virtual time onto CLOCK_MONOTONIC one to one, starting from the first paced step. Long waits sleep on a
+ * timerfd until the busy-poll window, the rest is spent polling the time stamp counter, which is calibrated against
+ * the monotonic clock once at construction. Where no TSC is available the monotonic clock is polled instead.
+ */
+typedef struct rt_pacer_
+{
+    int timer_fd; /**< Absolute CLOCK_MONOTONIC timer. Do not use directly */
+    u64 spin_ns; /**< Length of the busy-poll window */
+    u64 tolerance_ns; /**< Lateness still not counted as a miss */
+    int cpu; /**< CPU the pacing thread is pinned to on the first step or RT_PACER_NO_CPU */
+    rt_pacer_status pin_status; /**< rt_pacer_status_cerror when pinning on the first step failed */
+    bool anchored; /**< Origins are set. Do not use directly */
+    u64 wall_origin_ns; /**< Wall time matching the virtual origin. Do not use directly */
+    u64 virt_origin_ns; /**< Virtual time of the first paced step. Do not use directly */
+    u64 tsc_per_ns_q32; /**< TSC ticks per nanosecond in 32.32 fixed point or 0 without a TSC. Do not use directly */
+    rt_pacer_stats stats; /**< Pacing statistics */
+} rt_pacer;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Construct pacer instance.
+ *
+ * Construction takes about a millisecond to calibrate the time stamp counter.
+ *
+ * @param pacer Pointer to a pacer instance.
+ * @param spin_ns Length of the busy-poll window. Zero makes the pacer sleep only.
+ * @param tolerance_ns Lateness still not counted as a deadline miss.
+ * @param cpu CPU to pin the pacing thread to or RT_PACER_NO_CPU. The thread calling rt_pacer_pace() first is pinned,
+ *            so a pacer installed in the scheduler of a queued bus pins the worker thread of the queue.
+ *
+ * @return Operation status. Valid values are:
+ *          - rt_pacer_status_iptr when NULL was passed instead of a valid pointer
+ *          - rt_pacer_status_cerror when the timer cannot be created or the CPU is out of range or not available
+ *          - rt_pacer_status_ok on success
+ */
+rt_pacer_status rt_pacer_construct_ext(rt_pacer* pacer, u64 spin_ns, u64 tolerance_ns, int cpu);
+
+/**
+ * Construct pacer instance with default busy-poll window and tolerance, not pinned to any CPU.
+ *
+ * @param pacer Pointer to a pacer instance.
+ *
+ * @return Operation status. Return values are the same as for rt_pacer_construct_ext().
+ */
+static inline rt_pacer_status rt_pacer_construct(rt_pacer* pacer)
+{
+    return rt_pacer_construct_ext(pacer, RT_PACER_DEFAULT_SPIN_NS, RT_PACER_DEFAULT_TOLERANCE_NS, RT_PACER_NO_CPU);
+}
+
+/**
+ * Destruct pacer instance.
+ *
+ * @param pacer Pointer to a pacer instance.
+ *
+ * @return rt_pacer_status_iptr when NULL was passed instead of a valid pointer, rt_pacer_status_ok otherwise.
+ */
+rt_pacer_status rt_pacer_destruct(rt_pacer* pacer);
+
+/**
+ * Forget the mapping between virtual and wall time.
+ *
+ * The next paced step becomes the new origin. Use it after running unpaced for a while, otherwise the pacer would
+ * count every following step as a miss.
+ *
+ * @param pacer Pointer to a pacer instance.
+ *
+ * @return rt_pacer_status_iptr when NULL was passed instead of a valid pointer, rt_pacer_status_ok otherwise.
+ */
+rt_pacer_status rt_pacer_rebase(rt_pacer* pacer);
+
+/**
+ * Block until wall time reaches virtual time 'target_ns'.
+ *
+ * This is a scheduler_pacer - install it with scheduler_set_pacer() and the pacer as its context.
+ *
+ * @param ctx Pointer to a pacer instance.
+ * @param now_ns Current virtual time.
+ * @param target_ns Virtual time to wait for.
+ */
+void rt_pacer_pace(void* ctx, u64 now_ns, u64 target_ns);
+
+/**
+ * Pin the calling thread to a single CPU.
+ *
+ * @param cpu CPU number.
+ *
+ * @return rt_pacer_status_cerror when the CPU cannot be used, rt_pacer_status_ok otherwise.
+ */
+rt_pacer_status rt_pacer_pin(int cpu);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_RT_PACER_H
@@ -0,0 +1,226 @@
+#ifndef SPI_EMULATOR_SCHEDULER_H
+#define SPI_EMULATOR_SCHEDULER_H
+
+#include "type.h"
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** The number of bits of a deadline resolved by a single wheel level */
+#define SCHEDULER_WHEEL_BITS 6
+
+/** The number of slots of a wheel level */
+#define SCHEDULER_WHEEL_SLOTS (1u << SCHEDULER_WHEEL_BITS)
+
+/** The number of wheel levels - enough to cover the whole 64-bit time range */
+#define SCHEDULER_WHEEL_LEVELS ((64 + SCHEDULER_WHEEL_BITS - 1) / SCHEDULER_WHEEL_BITS)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct scheduler_;
+
+/**
+ * Pacing function - blocks until the wall clock reaches virtual time 'target_ns'
+ *
+ * It is called before the scheduler moves to the deadline of a batch of events and to the target of
+ * scheduler_advance(). 'now_ns' is where the time stands, which may already be past the last paced target when the
+ * wheel cascaded on the way. Without a pacer virtual time runs as fast as possible.
+ */
+typedef void (*scheduler_pacer)(void* ctx, u64 now_ns, u64 target_ns);
+
+/**
+ * Timed event
+ *
+ * Embed it in a device model or any other structure - the scheduler never allocates events on its own. An event may
+ * be scheduled again from within its own callback.
+ */
+typedef struct sched_event_
+{
+    dlist_node node; /**< Link within a wheel slot. Do not use directly */
+    u64 deadline_ns; /**< Virtual time the event fires at */
+    void (*fire)(struct scheduler_* sched, struct sched_event_* event); /**< Called when the deadline is reached */
+    void* ctx; /**< User context */
+    dlist* slot; /**< Slot holding the event or NULL when the event is not pending. Do not use directly */
+} sched_event;
+
+/**
+ * Virtual-time scheduler based on a hierarchical timing wheel
+ *
+ * Level L holds events whose deadline first differs from the current time at bits [6L, 6L + 6). Inserting and
+ * cancelling an event are constant time, expiry walks whole slots and moves events one level down only when the
+ * time crosses their slot - every event is cascaded at most once per level.
+ */
+typedef struct scheduler_
+{
+    u64 now_ns; /**< Current virtual time */
+    u64 occupied[SCHEDULER_WHEEL_LEVELS]; /**< Bitmaps of non-empty slots. Do not use directly */
+    dlist slots[SCHEDULER_WHEEL_LEVELS][SCHEDULER_WHEEL_SLOTS]; /**< Wheel slots. Do not use directly */
+    size pending; /**< The number of scheduled events */
+    u64 fired; /**< The number of events fired so far */
+    u64 skipped_ns; /**< Idle virtual time jumped over by scheduler_fast_forward() */
+    scheduler_pacer pace; /**< Pacing function or NULL to run unpaced. Do not use directly */
+    void* pace_ctx; /**< Context of the pacing function. Do not use directly */
+    bool firing; /**< An event callback is running. Do not use directly */
+} scheduler;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum scheduler_status_
+{
+    scheduler_status_ok, /**< Success */
+    scheduler_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    scheduler_status_cerror, /**< Event is not pending or time would go backwards */
+    scheduler_status_empty /**< No event is pending */
+} scheduler_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Initialize scheduler with no events pending.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param now_ns Initial virtual time.
+ *
+ * @return scheduler_status_iptr when NULL was passed instead of a valid pointer, scheduler_status_ok otherwise.
+ */
+scheduler_status scheduler_init(scheduler* sched, u64 now_ns);
+
+/**
+ * Initialize event before it is scheduled for the first time.
+ *
+ * @param event Pointer to an event instance.
+ * @param fire Callback called when the deadline is reached.
+ * @param ctx User context.
+ *
+ * @return scheduler_status_iptr when NULL was passed instead of a valid pointer, scheduler_status_ok otherwise.
+ */
+scheduler_status sched_event_init(sched_event* event, void (*fire)(scheduler* sched, sched_event* event), void* ctx);
+
+/**
+ * Check whether an event is waiting to fire.
+ *
+ * @param event Pointer to an initialized event.
+ *
+ * @return True when the event is scheduled, false otherwise.
+ */
+static inline bool sched_event_pending(const sched_event* event)
+{
+    return NULL != event->slot;
+}
+
+/**
+ * Schedule event at an absolute virtual time.
+ *
+ * A pending event is rescheduled. A deadline in the past fires on the next call to scheduler_advance().
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param event Pointer to an initialized event.
+ * @param deadline_ns Virtual time the event fires at.
+ *
+ * @return scheduler_status_iptr when NULL was passed instead of a valid pointer, scheduler_status_ok otherwise.
+ */
+scheduler_status scheduler_schedule(scheduler* sched, sched_event* event, u64 deadline_ns);
+
+/**
+ * Schedule event relative to the current virtual time.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param event Pointer to an initialized event.
+ * @param delay_ns Time from now the event fires after.
+ *
+ * @return Operation status. Return values are the same as for scheduler_schedule().
+ */
+static inline scheduler_status scheduler_schedule_in(scheduler* sched, sched_event* event, u64 delay_ns)
+{
+    return scheduler_schedule(sched, event, sched->now_ns + delay_ns);
+}
+
+/**
+ * Cancel pending event.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param event Pointer to an event.
+ *
+ * @return Operation status. Valid values are:
+ *          - scheduler_status_iptr when NULL was passed instead of a valid pointer
+ *          - scheduler_status_cerror when the event is not pending
+ *          - scheduler_status_ok on success
+ */
+scheduler_status scheduler_cancel(scheduler* sched, sched_event* event);
+
+/**
+ * Advance virtual time firing all events with deadlines up to and including the target.
+ *
+ * Events fire in deadline order. Events sharing a deadline fire as a batch in unspecified order, with the current time
+ * set to their deadline. Events scheduled by callbacks within the window fire during the same call. Callbacks cannot
+ * advance the time themselves.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param until_ns Target virtual time.
+ *
+ * @return Operation status. Valid values are:
+ *          - scheduler_status_iptr when NULL was passed instead of a valid pointer
+ *          - scheduler_status_cerror when the target lies in the past or an event callback is running
+ *          - scheduler_status_ok on success
+ */
+scheduler_status scheduler_advance(scheduler* sched, u64 until_ns);
+
+/**
+ * Jump straight to the earliest pending event and fire its batch.
+ *
+ * Call it when the emulator is idle - nothing is in flight and every device waits for a timer. Unpaced, a 400 ms
+ * sector erase costs as much wall time as any other event. With a pacer the jump takes as long as the skipped time.
+ * Synchronized emulator buses move between events this way on their own. The time of a free-running bus follows its
+ * traffic, so there the owner calls it when its firmware goes idle.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param limit_ns Virtual time not to go past. When the earliest event lies beyond it, the time stops at the limit.
+ *
+ * @return Operation status. Valid values are:
+ *          - scheduler_status_iptr when NULL was passed instead of a valid pointer
+ *          - scheduler_status_cerror when the limit lies in the past or an event callback is running
+ *          - scheduler_status_empty when no event is pending. The time does not change then
+ *          - scheduler_status_ok on success
+ */
+scheduler_status scheduler_fast_forward(scheduler* sched, u64 limit_ns);
+
+/**
+ * Set the pacing function.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param pace Pacing function or NULL to let virtual time run as fast as possible.
+ * @param ctx Context of the pacing function.
+ *
+ * @return scheduler_status_iptr when NULL was passed instead of a valid scheduler, scheduler_status_ok otherwise.
+ */
+scheduler_status scheduler_set_pacer(scheduler* sched, scheduler_pacer pace, void* ctx);
+
+/**
+ * Find the deadline of the earliest pending event.
+ *
+ * @param sched Pointer to a scheduler instance.
+ * @param deadline_ns Output parameter for the deadline. Deadlines in the past are reported as the current time.
+ *
+ * @return Operation status. Valid values are:
+ *          - scheduler_status_iptr when NULL was passed instead of a valid pointer
+ *          - scheduler_status_empty when no event is pending
+ *          - scheduler_status_ok on success
+ */
+scheduler_status scheduler_next(const scheduler* sched, u64* deadline_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SCHEDULER_H
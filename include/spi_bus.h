@@ -0,0 +1,454 @@
+#ifndef SPI_EMULATOR_SPI_BUS_H
+#define SPI_EMULATOR_SPI_BUS_H
+
+#include "type.h"
+#include "iterator.h"
+#include "device_registry.h"
+#include "spi_lanes.h"
+#include "scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** The number of chip-select lines of a bus */
+#define SPI_BUS_MAX_SLAVES DEVICE_REGISTRY_MAX_CS
+
+/** Default size of staging buffers used for non-contiguous TX/RX iterators */
+#define SPI_BUS_DEFAULT_SCRATCH 4096
+
+/** Minimum size of staging buffers - a single word of the widest size */
+#define SPI_BUS_MIN_SCRATCH sizeof(u32)
+
+/** Default clock frequency of a bus */
+#define SPI_BUS_DEFAULT_SPEED_HZ 1000000
+
+/** Value of spi_bus::active_cs when no chip-select line is asserted */
+#define SPI_BUS_NO_CS UINT32_MAX
+
+/** Value of a scheduler horizon which does not limit the scheduler */
+#define SPI_BUS_NO_HORIZON UINT64_MAX
+
+/** The number of responses a bus keeps in its response cache. Must be a power of two */
+#define SPI_BUS_CACHE_ENTRIES 16
+
+/** The longest transaction whose response can be cached */
+#define SPI_BUS_CACHE_BYTES 32
+
+/** The number of identical polls at a steady period after which polling is fast-forwarded */
+#define SPI_BUS_POLL_REPEATS 4
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Single transfer of a message
+ *
+ * The layout follows struct spi_ioc_transfer used by SPI_IOC_MESSAGE(n) of Linux spidev. A transfer using more than
+ * one line in any direction is half-duplex, so it can either send or receive. Commands like 1-1-4 or 1-4-4 fast reads
+ * are messages whose transfers switch the number of lines. The number of lines only sets the number of clocks, devices
+ * exchange whole bytes either way.
+ */
+typedef struct spi_transfer_
+{
+    const iterator_instance* tx; /**< Const iterator over bytes to send or NULL to send zeros */
+    iterator_instance* rx; /**< Non-const iterator over bytes to receive or NULL to discard them */
+    size len; /**< The number of bytes to exchange */
+    u32 speed_hz; /**< Clock frequency for this transfer. Zero means the bus default */
+    u16 delay_usecs; /**< Delay after the transfer, before the chip-select is changed */
+    u8 bits_per_word; /**< Word size (4 - 32). Zero means 8. 'len' must be a multiple of spi_mode_word_bytes() */
+    bool cs_change; /**< Deassert chip-select after this transfer. On the last one: keep it asserted instead */
+    u8 tx_nbits; /**< Lines used for sending: SPI_LANES_SINGLE (also zero), DUAL, QUAD or OCTAL */
+    u8 rx_nbits; /**< Lines used for receiving: SPI_LANES_SINGLE (also zero), DUAL, QUAD or OCTAL */
+} spi_transfer;
+
+/**
+ * Bus statistics
+ */
+typedef struct spi_bus_stats_
+{
+    u64 transfers; /**< The number of completed transfers */
+    u64 bytes; /**< The number of bytes exchanged */
+    u64 messages; /**< The number of completed messages */
+    u64 coalesced; /**< Transfers merged into the device call of a preceding transfer */
+    u64 cached; /**< Messages answered from the response cache */
+    u64 skipped; /**< Polls skipped by fast-forwarding, also counted as cached messages */
+} spi_bus_stats;
+
+/**
+ * Cached response of a side-effect-free transaction
+ */
+typedef struct spi_bus_cache_entry_
+{
+    u64 version; /**< State version of the device the response is valid for */
+    u32 cs; /**< Chip-select of the device */
+    u32 len; /**< Length of the transaction or zero when the entry is empty */
+    u8 mosi[SPI_BUS_CACHE_BYTES]; /**< MOSI bytes of the transaction */
+    u8 miso[SPI_BUS_CACHE_BYTES]; /**< MISO bytes of the response */
+} spi_bus_cache_entry;
+
+/**
+ * Run of identical polls answered from the response cache
+ */
+typedef struct spi_bus_poll_
+{
+    const spi_bus_cache_entry* entry; /**< Entry answering the polls or NULL when no run is tracked */
+    u64 start_ns; /**< Start of the last poll */
+    u64 period_ns; /**< Time between the starts of the last two polls */
+    u32 repeats; /**< The number of polls at the current period */
+} spi_bus_poll;
+
+/**
+ * Chip-select and inter-word timing of a cycle-accurate bus
+ */
+typedef struct spi_bus_timing_
+{
+    u32 cs_setup_ns; /**< From chip-select assertion to the first SCLK edge */
+    u32 cs_hold_ns; /**< From the end of the last transfer to chip-select deassertion */
+    u32 cs_inactive_ns; /**< Minimum time a chip-select stays deasserted before the next assertion */
+    u32 word_gap_ns; /**< Idle time between consecutive words of a transfer */
+} spi_bus_timing;
+
+struct spi_bus_;
+
+/** Message execution engine, selected when a bus is constructed */
+typedef void (*spi_bus_execute)(struct spi_bus_* bus, const device_entry* slave, u32 cs,
+                                const spi_transfer* transfers, size count);
+
+/**
+ * SPI bus instance
+ *
+ * A bus runs either in the fast transaction-level mode (spi_bus_construct_ext()) or in the cycle-accurate mode
+ * (spi_bus_construct_cycle_ext()). The mode cannot be changed afterwards.
+ */
+typedef struct spi_bus_
+{
+    device_registry devices; /**< Devices indexed by chip-select number */
+    u8* scratch; /**< Staging memory: TX half followed by RX half. Do not use directly */
+    iterator_instance mosi_view; /**< Byte array view passed to devices for staged chunks. Do not use directly */
+    array_iterator_ctx mosi_view_ctx; /**< Context of the view. Do not use directly */
+    size scratch_size; /**< Size of a single half of the staging memory */
+    u32 speed_hz; /**< Default clock frequency. May be changed at any time. Messages relying on zero are rejected */
+    u32 active_cs; /**< Chip-select left asserted by the last message or SPI_BUS_NO_CS */
+    u64 time_ns; /**< Virtual time consumed by transfers and delays */
+    spi_bus_stats stats; /**< Bus statistics */
+    spi_bus_execute execute; /**< Engine of the bus mode. Do not use directly */
+    spi_bus_timing timing; /**< Timing of a cycle-accurate bus, zeros otherwise */
+    u64 cs_idle_until_ns; /**< Earliest time of the next chip-select assertion. Do not use directly */
+    scheduler* sched; /**< Scheduler kept in step with the bus or NULL */
+    u64 horizon_ns; /**< Time the bus does not move the scheduler past. Do not use directly */
+    bool coalesce; /**< Merge runs of small compatible transfers. Do not use directly */
+    spi_bus_cache_entry cache[SPI_BUS_CACHE_ENTRIES]; /**< Response cache. Do not use directly */
+    bool fast_forward; /**< Skip identical polls up to the next scheduled event. Do not use directly */
+    spi_bus_poll poll; /**< Run of polls being tracked. Do not use directly */
+} spi_bus;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum spi_bus_status_
+{
+    spi_bus_status_ok, /**< Success */
+    spi_bus_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    spi_bus_status_merror, /**< Memory allocator failed */
+    spi_bus_status_cerror, /**< Invalid parameters (e.g. chip-select out of range or buffer too short) */
+    spi_bus_status_nodev /**< No device attached to the chip-select line */
+} spi_bus_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Construct bus instance.
+ *
+ * All chip-select lines are unpopulated after the operation. The bus has to be destructed afterwards.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param scratch_size Size of staging buffers used when TX or RX iterator is not a byte array or when data is
+ *                     transformed. Cannot be smaller than SPI_BUS_MIN_SCRATCH.
+ * @param allocator Pointer to a custom memory allocator.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the scratch size is too small
+ *          - spi_bus_status_merror when memory allocator failed
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_construct_ext(spi_bus* bus, size scratch_size, mem_allocator allocator);
+
+/**
+ * Construct bus instance with default scratch size and memory allocator.
+ *
+ * @param bus Pointer to a bus instance.
+ *
+ * @return Operation status. Return values are the same as for spi_bus_construct_ext().
+ */
+static inline spi_bus_status spi_bus_construct(spi_bus* bus)
+{
+    return spi_bus_construct_ext(bus, SPI_BUS_DEFAULT_SCRATCH, malloc);
+}
+
+/**
+ * Construct cycle-accurate bus instance.
+ *
+ * Every word is exchanged separately: devices get its SCLK edge times through the timing operation and the bus time
+ * includes chip-select setup, hold and inactive times as well as gaps between words. The cost is a device call per
+ * word, so only buses with timing-sensitive devices should use this mode.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param scratch_size See spi_bus_construct_ext().
+ * @param timing Chip-select and inter-word timing. It is copied.
+ * @param allocator Pointer to a custom memory allocator.
+ *
+ * @return Operation status. Return values are the same as for spi_bus_construct_ext().
+ */
+spi_bus_status spi_bus_construct_cycle_ext(spi_bus* bus, size scratch_size, const spi_bus_timing* timing,
+                                           mem_allocator allocator);
+
+/**
+ * Construct cycle-accurate bus instance with default scratch size and memory allocator.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param timing Chip-select and inter-word timing.
+ *
+ * @return Operation status. Return values are the same as for spi_bus_construct_ext().
+ */
+static inline spi_bus_status spi_bus_construct_cycle(spi_bus* bus, const spi_bus_timing* timing)
+{
+    return spi_bus_construct_cycle_ext(bus, SPI_BUS_DEFAULT_SCRATCH, timing, malloc);
+}
+
+/**
+ * Destruct bus instance.
+ *
+ * Attached devices are not touched - they are owned by the caller.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param deallocator Custom memory deallocator.
+ *
+ * @return spi_bus_status_iptr when NULL was passed instead of a valid pointer, spi_bus_status_ok otherwise.
+ */
+spi_bus_status spi_bus_destruct_ext(spi_bus* bus, mem_deallocator deallocator);
+
+/**
+ * Destruct bus instance with a default deallocator.
+ *
+ * @param bus Pointer to a bus instance.
+ *
+ * @return Operation status. Return values are the same as for spi_bus_destruct_ext().
+ */
+static inline spi_bus_status spi_bus_destruct(spi_bus* bus)
+{
+    return spi_bus_destruct_ext(bus, free);
+}
+
+/**
+ * Attach a device model to a chip-select line.
+ *
+ * A device already attached to the line is replaced.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param ops Device model operations. The exchange operation is mandatory. Operations are copied, see
+ *            device_registry_register().
+ * @param device Device model state.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the chip-select is out of range or exchange operation is missing
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_attach(spi_bus* bus, u32 cs, const spi_device_ops* ops, void* device);
+
+/**
+ * Attach a built-in device to a chip-select line.
+ *
+ * A loopback answers every MOSI byte with the same byte, a null device answers with DEVICE_NULL_MISO. The bus serves
+ * them without calling any device operation: a transfer between byte arrays is a single memcpy or memset and a
+ * transfer which discards MISO costs nothing. Use them as throughput baselines or as cheap stand-ins for unpopulated
+ * chip-select lines. A device already attached to the line is replaced.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param kind device_kind_loopback or device_kind_null.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the chip-select is out of range or the kind is not a built-in one
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_attach_builtin(spi_bus* bus, u32 cs, device_kind kind);
+
+/**
+ * Configure modes of both ends of a chip-select line.
+ *
+ * Transfers to a device whose mode differs from the host's are staged through the scratch memory and transformed in
+ * bulk, see device_registry_set_modes(). Lines with matching modes are not affected.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param host Mode the host uses for the line.
+ * @param device Mode the device model works in.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the chip-select is out of range or a mode is invalid
+ *          - spi_bus_status_nodev when nothing is attached to the chip-select line
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_set_modes(spi_bus* bus, u32 cs, const spi_mode* host, const spi_mode* device);
+
+/**
+ * Detach a device model from a chip-select line.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ *
+ * @return Operation status. Valid values are the same as for spi_bus_attach().
+ */
+spi_bus_status spi_bus_detach(spi_bus* bus, u32 cs);
+
+/**
+ * Drive a scheduler with the virtual time of the bus.
+ *
+ * Each message starts no earlier than the current time of the scheduler, and events falling due while it runs fire
+ * before the next transfer - or the next word of a cycle-accurate bus - reaches a device. This way device timers,
+ * such as a flash page-program, complete in order with the traffic. A message issued from an event callback runs in
+ * a single step of the scheduler - only the bus time moves.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param sched Pointer to a scheduler or NULL to detach the current one.
+ *
+ * @return spi_bus_status_iptr when NULL was passed instead of a valid bus, spi_bus_status_ok otherwise.
+ */
+spi_bus_status spi_bus_set_scheduler(spi_bus* bus, scheduler* sched);
+
+/**
+ * Limit the time the bus moves its scheduler to.
+ *
+ * Transfers running past the horizon move only the bus time, the scheduler catches up on the first message after the
+ * horizon is lifted. The emulator uses it to hold the scheduler still while a message handler runs.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param horizon_ns Time the scheduler is not moved past or SPI_BUS_NO_HORIZON to lift the limit.
+ *
+ * @return spi_bus_status_iptr when NULL was passed instead of a valid bus, spi_bus_status_ok otherwise.
+ */
+spi_bus_status spi_bus_set_horizon(spi_bus* bus, u64 horizon_ns);
+
+/**
+ * Opt a device into the response cache.
+ *
+ * A message forming a whole transaction - the chip-select is asserted for it and released after it - of at most
+ * SPI_BUS_CACHE_BYTES bytes is offered to the predicate along with its MOSI bytes. When the predicate accepts it and
+ * the same bytes have been answered at the current state version before, the response is served from the cache
+ * without calling the device at all. Bus time, statistics and scheduled events advance as if the device answered.
+ * Firmware polling a status or reading an identifier in a loop then costs a lookup per poll.
+ *
+ * Only the fast mode caches, only lines whose ends agree on the mode and only messages whose TX buffers are byte
+ * arrays or NULL - other iterators cannot be read twice. Attaching or detaching a device drops its cached responses.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param pure Predicate telling which transactions are side-effect-free or NULL to opt out.
+ * @param version Version of the device state, changed by the device whenever its state changes. May be NULL when
+ *                opting out.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the chip-select is out of range
+ *          - spi_bus_status_nodev when nothing is attached to the chip-select line
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_set_cache(spi_bus* bus, u32 cs, device_pure pure, const u64* version);
+
+/**
+ * Enable or disable transfer coalescing.
+ *
+ * With coalescing a run of consecutive transfers of a message is exchanged with a single device call when the
+ * chip-select stays asserted between them, they share speed, word size and lane widths, no delay separates them, no
+ * scheduled event falls due in between and together they fit in the scratch memory. MOSI bytes of the run are
+ * gathered into the scratch memory and MISO bytes are scattered back to every RX buffer, so buffers, bus time and
+ * statistics end up as without coalescing - only the device sees one longer exchange instead of several short ones.
+ * This suits register-heavy drivers which issue many tiny transfers. Only the fast mode coalesces; built-in devices
+ * and lines with mode transforms are never coalesced. Disabled by default.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param enable True to merge transfers, false to exchange every transfer separately.
+ *
+ * @return spi_bus_status_iptr when NULL was passed instead of a valid bus, spi_bus_status_ok otherwise.
+ */
+spi_bus_status spi_bus_set_coalescing(spi_bus* bus, bool enable);
+
+/**
+ * Enable or disable fast-forwarding of busy polling.
+ *
+ * Firmware commonly spins on a status read until a background operation of the device completes. A poll served from
+ * the response cache (see spi_bus_set_cache()) cannot see a different response until a scheduled event changes the
+ * state of the device. Once the same poll repeats SPI_BUS_POLL_REPEATS times at a steady period, the bus time jumps
+ * to the last poll that would start before the next scheduled event and the polls in between are accounted in bulk:
+ * statistics end up as if every one of them had been executed. The next poll after the event sees the new state.
+ *
+ * Firmware doing work of its own between polls without touching the bus sees that work compressed in time, so this
+ * is disabled by default. Only buses driven by a scheduler fast-forward.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param enable True to skip polls, false to execute every poll.
+ *
+ * @return spi_bus_status_iptr when NULL was passed instead of a valid bus, spi_bus_status_ok otherwise.
+ */
+spi_bus_status spi_bus_set_fast_forward(spi_bus* bus, bool enable);
+
+/**
+ * Execute a message consisting of several transfers.
+ *
+ * All transfers are validated first, then executed back to back without returning to the caller. The chip-select
+ * stays asserted for the whole message unless a transfer requests a change. Virtual time of the bus is advanced by
+ * the duration of every transfer and its delay. A scheduler attached to the bus is advanced along.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param transfers Array of transfers.
+ * @param count The number of transfers.
+ *
+ * @return Operation status. Valid values are the same as for spi_bus_transfer(). Nothing is exchanged on error.
+ */
+spi_bus_status spi_bus_message(spi_bus* bus, u32 cs, const spi_transfer* transfers, size count);
+
+/**
+ * Perform a full-duplex transfer.
+ *
+ * This is a shortcut for spi_bus_message() with a single transfer at the default speed.
+ *
+ * The selected device is asserted, receives all MOSI bytes and provides all MISO bytes, then it is deasserted. When
+ * the RX iterator is a byte array the device writes to it directly and gets the TX iterator as it is, so the whole
+ * transfer takes a single exchange call. Otherwise MISO bytes are staged through the scratch memory, one
+ * scratch-sized chunk at a time, and the device gets a byte array view of each TX chunk.
+ *
+ * @param bus Pointer to a bus instance.
+ * @param cs Chip-select number.
+ * @param tx Const iterator over bytes to send or NULL to send zeros. A generic iterator which ends early is padded
+ *           with zeros.
+ * @param rx Non-const iterator over bytes to receive or NULL to discard received data.
+ * @param len The number of bytes to exchange.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_bus_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_bus_status_cerror when the chip-select is out of range, iterator type is wrong, an array is too
+ *            short or the clock frequency is zero
+ *          - spi_bus_status_nodev when nothing is attached to the chip-select line
+ *          - spi_bus_status_ok on success
+ */
+spi_bus_status spi_bus_transfer(spi_bus* bus, u32 cs, const iterator_instance* tx, iterator_instance* rx, size len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SPI_BUS_H
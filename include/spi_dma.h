@@ -0,0 +1,136 @@
+#ifndef SPI_EMULATOR_SPI_DMA_H
+#define SPI_EMULATOR_SPI_DMA_H
+
+#include "type.h"
+#include "spi_bus.h"
+#include "scheduler.h"
+#include "array_iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct spi_dma_channel_;
+
+/** Completion interrupt - called once every byte of a transfer has been exchanged or a bus error stopped it */
+typedef void (*spi_dma_irq)(struct spi_dma_channel_* channel, void* ctx);
+
+/**
+ * DMA channel statistics
+ */
+typedef struct spi_dma_stats_
+{
+    u64 transfers; /**< The number of completed transfers */
+    u64 errors; /**< The number of transfers stopped by a bus error */
+    u64 bursts; /**< The number of bursts moved */
+    u64 bytes; /**< The number of bytes moved */
+} spi_dma_stats;
+
+/**
+ * DMA channel feeding a single chip-select line of a bus
+ *
+ * A transfer is moved in bursts straight between the caller's buffers and the device: every burst is a transfer of
+ * the bus over array views of the buffers, so a device writes MISO bytes directly to their destination and nothing is
+ * staged on the way. The chip-select stays asserted from the first burst to the last.
+ *
+ * On a bus driven by a scheduler, bursts are scheduled events separated by the arbitration gap and the completion
+ * interrupt fires as an event at the end of the last burst, interleaved in time with everything else the scheduler
+ * runs. Without a scheduler the whole transfer and the interrupt happen within spi_dma_start().
+ *
+ * A burst rejected by the bus, for instance because the device has been detached, stops the transfer: no further
+ * bursts are moved and the completion interrupt fires right away with the error in the status field.
+ */
+typedef struct spi_dma_channel_
+{
+    spi_bus* bus; /**< Bus the channel drives */
+    u32 cs; /**< Chip-select line of the channel */
+    size burst; /**< The number of bytes moved per bus grant */
+    u32 gap_ns; /**< Time the channel waits for the next bus grant */
+    spi_dma_irq irq; /**< Completion interrupt or NULL. Do not use directly */
+    void* irq_ctx; /**< Context of the completion interrupt. Do not use directly */
+    const u8* tx; /**< Caller's MOSI buffer or NULL to send zeros. Do not use directly */
+    u8* rx; /**< Caller's MISO buffer or NULL to discard. Do not use directly */
+    size len; /**< Length of the current transfer. Do not use directly */
+    size done; /**< Bytes of the current transfer already moved. Do not use directly */
+    bool busy; /**< A transfer is in progress */
+    spi_bus_status status; /**< spi_bus_status_ok or the bus error which stopped the last transfer */
+    sched_event event; /**< Next burst or the completion interrupt. Do not use directly */
+    iterator_instance tx_view; /**< Array view of the current MOSI burst. Do not use directly */
+    array_iterator_ctx tx_view_ctx; /**< Context of the MOSI view. Do not use directly */
+    iterator_instance rx_view; /**< Array view of the current MISO burst. Do not use directly */
+    array_iterator_ctx rx_view_ctx; /**< Context of the MISO view. Do not use directly */
+    spi_dma_stats stats; /**< Channel statistics */
+} spi_dma_channel;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum spi_dma_status_
+{
+    spi_dma_status_ok, /**< Success */
+    spi_dma_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    spi_dma_status_cerror, /**< Invalid parameters */
+    spi_dma_status_nodev, /**< No device attached to the chip-select line */
+    spi_dma_status_busy /**< A transfer is already in progress */
+} spi_dma_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Initialize DMA channel.
+ *
+ * @param channel Pointer to a channel instance.
+ * @param bus Bus the channel drives. A scheduler of the bus is looked up on every transfer.
+ * @param cs Chip-select line of the channel.
+ * @param burst The number of bytes moved per bus grant. Cannot be zero.
+ * @param gap_ns Time between the end of a burst and the start of the next one.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_dma_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_dma_status_cerror when the chip-select is out of range or the burst is zero
+ *          - spi_dma_status_ok on success
+ */
+spi_dma_status spi_dma_init(spi_dma_channel* channel, spi_bus* bus, u32 cs, size burst, u32 gap_ns);
+
+/**
+ * Set the completion interrupt of a channel.
+ *
+ * @param channel Pointer to a channel instance.
+ * @param irq Completion interrupt or NULL.
+ * @param ctx Context of the interrupt.
+ *
+ * @return spi_dma_status_iptr when NULL was passed instead of a valid channel, spi_dma_status_ok otherwise.
+ */
+spi_dma_status spi_dma_set_irq(spi_dma_channel* channel, spi_dma_irq irq, void* ctx);
+
+/**
+ * Start a full-duplex transfer.
+ *
+ * The buffers belong to the caller until the completion interrupt - they are read and written in place. Messages to
+ * other devices of the bus must not be issued in between, as they would release the chip-select.
+ *
+ * @param channel Pointer to a channel instance.
+ * @param tx MOSI bytes or NULL to send zeros.
+ * @param rx Buffer for MISO bytes or NULL to discard them.
+ * @param len The number of bytes to exchange. Cannot be zero.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_dma_status_iptr when NULL was passed instead of a valid channel
+ *          - spi_dma_status_cerror when the length is zero
+ *          - spi_dma_status_nodev when nothing is attached to the chip-select line
+ *          - spi_dma_status_busy when the previous transfer has not completed yet
+ *          - spi_dma_status_ok on success
+ */
+spi_dma_status spi_dma_start(spi_dma_channel* channel, const u8* tx, u8* rx, size len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SPI_DMA_H
@@ -0,0 +1,92 @@
+#ifndef SPI_EMULATOR_SPI_LANES_H
+#define SPI_EMULATOR_SPI_LANES_H
+
+#include "type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Standard SPI - one data line per direction */
+#define SPI_LANES_SINGLE 1
+
+/** Dual SPI - IO0 and IO1 */
+#define SPI_LANES_DUAL 2
+
+/** Quad SPI - IO0 to IO3 */
+#define SPI_LANES_QUAD 4
+
+/** Octal SPI - IO0 to IO7 */
+#define SPI_LANES_OCTAL 8
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Check whether a lane count is supported.
+ *
+ * @param nbits The number of data lines (1, 2, 4 or 8).
+ *
+ * @return True if valid, false otherwise.
+ */
+static inline bool spi_lanes_valid(u8 nbits)
+{
+    return SPI_LANES_SINGLE == nbits || SPI_LANES_DUAL == nbits || SPI_LANES_QUAD == nbits
+           || SPI_LANES_OCTAL == nbits;
+}
+
+/**
+ * Return the number of bytes a single line carries while 'len' data bytes are clocked over 'nbits' lines.
+ *
+ * @param len The number of data bytes.
+ * @param nbits The number of data lines.
+ *
+ * @return Size of a single line's bit stream in bytes (the last one may be only partially used).
+ */
+static inline size spi_lanes_stride(size len, u8 nbits)
+{
+    return (len + nbits - 1) / nbits;
+}
+
+/**
+ * Split data bytes into per-line bit streams.
+ *
+ * Every clock carries 'nbits' bits of the current byte, most significant first, and IOk carries the k-th lowest of
+ * them. A line's bit stream is stored in clock order starting at the most significant bit. Streams of all lines are
+ * stored back to back: IOk starts at dst + k * spi_lanes_stride(len, nbits).
+ *
+ * Octal blocks of eight bytes are transposed as 8x8 bit matrices. Dual and quad blocks go through pext when the
+ * target has BMI2. Everything else uses a byte transposition table.
+ *
+ * The bus itself never splits data - it accounts multi-line transfers in clocks and hands devices whole bytes. Use it
+ * where the level of every IO line matters, for example in a waveform dump or a pin-level device model.
+ *
+ * @param src Data bytes.
+ * @param len The number of data bytes.
+ * @param nbits The number of data lines (1, 2, 4 or 8).
+ * @param dst Destination buffer for nbits * spi_lanes_stride(len, nbits) bytes.
+ */
+void spi_lanes_split(const u8* src, size len, u8 nbits, u8* dst);
+
+/**
+ * Merge per-line bit streams into data bytes.
+ *
+ * This is the reverse of spi_lanes_split(). Dual and quad blocks go through pdep when the target has BMI2.
+ *
+ * @param src Bit streams laid out as produced by spi_lanes_split().
+ * @param len The number of data bytes.
+ * @param nbits The number of data lines (1, 2, 4 or 8).
+ * @param dst Destination buffer for 'len' bytes.
+ */
+void spi_lanes_merge(const u8* src, size len, u8 nbits, u8* dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SPI_LANES_H
@@ -0,0 +1,155 @@
+#ifndef SPI_EMULATOR_SPI_MODE_H
+#define SPI_EMULATOR_SPI_MODE_H
+
+#include "type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Clock phase bit: data sampled on the trailing clock edge */
+#define SPI_MODE_CPHA 0x01
+
+/** Clock polarity bit: clock idles high */
+#define SPI_MODE_CPOL 0x02
+
+/** Standard SPI modes */
+#define SPI_MODE_0 0
+#define SPI_MODE_1 SPI_MODE_CPHA
+#define SPI_MODE_2 SPI_MODE_CPOL
+#define SPI_MODE_3 (SPI_MODE_CPOL | SPI_MODE_CPHA)
+
+/** Supported word sizes */
+#define SPI_MODE_MIN_BITS_PER_WORD 4
+#define SPI_MODE_MAX_BITS_PER_WORD 32
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Clock mode and bit order of one end of a link
+ */
+typedef struct spi_mode_
+{
+    u8 mode; /**< SPI_MODE_0 - SPI_MODE_3 */
+    bool lsb_first; /**< Least significant bit of a word is clocked first */
+} spi_mode;
+
+/**
+ * Precomputed conversion of words sent by one end as seen by the other end
+ *
+ * Words are first brought to wire order (most significant bit first), then optionally delayed by a single bit when
+ * the ends sample on different clock edges and finally brought to the bit order of the receiver.
+ */
+typedef struct spi_mode_transform_
+{
+    bool reverse_in; /**< Sender clocks LSB first */
+    bool shift; /**< Receiver samples one bit late */
+    bool reverse_out; /**< Receiver clocks LSB first */
+} spi_mode_transform;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Check whether a word size is supported.
+ *
+ * @param bits_per_word Word size.
+ *
+ * @return True if valid, false otherwise.
+ */
+static inline bool spi_mode_bpw_valid(u8 bits_per_word)
+{
+    return SPI_MODE_MIN_BITS_PER_WORD <= bits_per_word && SPI_MODE_MAX_BITS_PER_WORD >= bits_per_word;
+}
+
+/**
+ * Return the number of bytes a word occupies in memory.
+ *
+ * Like in Linux spidev, words up to 8 bits are stored in bytes, up to 16 bits in u16 and up to 32 bits in u32, all
+ * in native byte order.
+ *
+ * @param bits_per_word Word size.
+ *
+ * @return 1, 2 or 4.
+ */
+static inline size spi_mode_word_bytes(u8 bits_per_word)
+{
+    return 8 >= bits_per_word ? sizeof(u8) : (16 >= bits_per_word ? sizeof(u16) : sizeof(u32));
+}
+
+/**
+ * Compute the transform of words sent from one end to the other.
+ *
+ * Ends with equal CPOL ^ CPHA sample on the same clock edge. Otherwise the receiver samples every bit one edge too
+ * early, so it sees the stream delayed by a single bit.
+ *
+ * @param from Sender configuration.
+ * @param to Receiver configuration.
+ *
+ * @return Transform to pass to spi_mode_apply().
+ */
+spi_mode_transform spi_mode_transform_between(const spi_mode* from, const spi_mode* to);
+
+/**
+ * Check whether a transform leaves data intact.
+ *
+ * @param transform Transform.
+ *
+ * @return True if data does not have to be touched at all, false otherwise.
+ */
+static inline bool spi_mode_transform_identity(const spi_mode_transform* transform)
+{
+    return transform->reverse_in == transform->reverse_out && !transform->shift;
+}
+
+/**
+ * Reverse bit order of every word in place.
+ *
+ * Bytes are reversed with pshufb nibble lookups (SSSE3/AVX2) when the target supports it and with a lookup table
+ * otherwise, then words wider than a byte are byte swapped and all words are aligned back to the bit 0.
+ *
+ * @param words Words stored as described for spi_mode_word_bytes().
+ * @param count The number of words.
+ * @param bits_per_word Word size.
+ */
+void spi_mode_reverse(void* words, size count, u8 bits_per_word);
+
+/**
+ * Delay the bit stream formed by words in wire order by a single bit, in place.
+ *
+ * @param words Words stored as described for spi_mode_word_bytes().
+ * @param count The number of words.
+ * @param bits_per_word Word size.
+ * @param carry The last bit of the previous chunk of the same stream (zero at the start of a transfer).
+ *
+ * @return The last bit of this chunk to pass along with the next one.
+ */
+u32 spi_mode_shift(void* words, size count, u8 bits_per_word, u32 carry);
+
+/**
+ * Apply a transform in place.
+ *
+ * Every step runs over the whole buffer at once, so the cost does not depend on how the ends are configured.
+ *
+ * @param transform Transform.
+ * @param words Words stored as described for spi_mode_word_bytes().
+ * @param count The number of words.
+ * @param bits_per_word Word size.
+ * @param carry Shift state, see spi_mode_shift(). Ignored when the transform does not shift.
+ *
+ * @return Shift state to pass along with the next chunk of the same stream.
+ */
+u32 spi_mode_apply(const spi_mode_transform* transform, void* words, size count, u8 bits_per_word, u32 carry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SPI_MODE_H
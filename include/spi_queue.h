@@ -0,0 +1,255 @@
+#ifndef SPI_EMULATOR_SPI_QUEUE_H
+#define SPI_EMULATOR_SPI_QUEUE_H
+
+#include "type.h"
+#include "spi_bus.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Default number of entries of a queue */
+#define SPI_QUEUE_DEFAULT_ENTRIES 256
+
+/** Value of notify_fd meaning no eventfd notification */
+#define SPI_QUEUE_NO_FD (-1)
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Completion of a submitted message
+ */
+typedef struct spi_queue_completion_
+{
+    void* user_data; /**< Value copied from the submission entry */
+    spi_bus_status status; /**< Result of spi_bus_message() */
+} spi_queue_completion;
+
+/**
+ * Submission entry - a single message to execute
+ */
+typedef struct spi_queue_entry_
+{
+    u32 cs; /**< Chip-select number */
+    const spi_transfer* transfers; /**< Transfers of the message. Must stay valid until the message completes */
+    size count; /**< The number of transfers */
+    void* user_data; /**< Value passed back within the completion */
+    void (*complete)(const spi_queue_completion* completion); /**< Called on the worker thread. Optional */
+} spi_queue_entry;
+
+/**
+ * Service function run by the worker thread before every pass over the submission ring
+ *
+ * Returns true when it has more work to do right away, so the worker must not go to sleep.
+ */
+typedef bool (*spi_queue_service)(void* ctx);
+
+/**
+ * Single-producer single-consumer ring indices
+ *
+ * Indices run freely and are masked on access, so 'tail - head' is always the number of used slots.
+ */
+typedef struct spi_queue_ring_
+{
+    size head; /**< Next slot to consume. Do not use directly */
+    size tail; /**< Next slot to produce. Do not use directly */
+} spi_queue_ring;
+
+/**
+ * Asynchronous queue attached to a bus
+ *
+ * Submission and completion rings are lock-free: the host publishes entries by moving the submission tail and reaps
+ * completions by moving the completion head, while a worker thread owning the bus does the opposite. Locks are only
+ * taken to put a thread to sleep or to wake it up.
+ */
+typedef struct spi_queue_
+{
+    spi_bus* bus; /**< Bus used exclusively by the worker thread */
+    size entries; /**< Capacity of both rings. Power of two */
+    spi_queue_entry* sq; /**< Submission ring. Do not use directly */
+    spi_queue_completion* cq; /**< Completion ring. Do not use directly */
+    spi_queue_ring sq_ring; /**< Submission indices. Do not use directly */
+    spi_queue_ring cq_ring; /**< Completion indices. Do not use directly */
+    int notify_fd; /**< Eventfd incremented by the number of posted completions or SPI_QUEUE_NO_FD */
+    bool idle; /**< Worker is about to sleep. Do not use directly */
+    bool waiting; /**< Host is about to sleep in spi_queue_wait(). Do not use directly */
+    bool stop; /**< Request for the worker to quit. Do not use directly */
+    bool kicked; /**< Worker has to run its service. Do not use directly */
+    bool joined; /**< Worker has quit. Do not use directly */
+    spi_queue_service service; /**< Service function or NULL. Do not use directly */
+    void* service_ctx; /**< Context of the service function. Do not use directly */
+    pthread_t worker; /**< Worker thread. Do not use directly */
+    pthread_mutex_t lock; /**< Guards sleeping only. Do not use directly */
+    pthread_cond_t doorbell; /**< Wakes the worker. Do not use directly */
+    pthread_cond_t completed; /**< Wakes the host. Do not use directly */
+} spi_queue;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum spi_queue_status_
+{
+    spi_queue_status_ok, /**< Success */
+    spi_queue_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    spi_queue_status_merror, /**< Memory allocator failed */
+    spi_queue_status_cerror, /**< Invalid parameters or thread primitives could not be created */
+    spi_queue_status_busy /**< Not enough free entries - reap completions first */
+} spi_queue_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Construct queue instance and start its worker thread.
+ *
+ * The bus must not be used directly for as long as the queue exists. Every bus needs its own queue, but several
+ * queues may share a single eventfd, so one thread can sleep on completions of many buses.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param bus Pointer to a constructed bus.
+ * @param entries Capacity of the queue - the maximum number of messages in flight. Must be a power of two.
+ * @param notify_fd Eventfd owned by the caller or SPI_QUEUE_NO_FD.
+ * @param allocator Pointer to a custom memory allocator.
+ * @param deallocator Custom memory deallocator releasing the allocation when the worker cannot be started.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_queue_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_queue_status_cerror when the capacity is not a power of two or the worker cannot be started
+ *          - spi_queue_status_merror when memory allocator failed
+ *          - spi_queue_status_ok on success
+ */
+spi_queue_status spi_queue_construct_ext(spi_queue* queue, spi_bus* bus, size entries, int notify_fd,
+                                         mem_allocator allocator, mem_deallocator deallocator);
+
+/**
+ * Construct queue instance with default capacity, no eventfd and default memory allocator.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param bus Pointer to a constructed bus.
+ *
+ * @return Operation status. Return values are the same as for spi_queue_construct_ext().
+ */
+static inline spi_queue_status spi_queue_construct(spi_queue* queue, spi_bus* bus)
+{
+    return spi_queue_construct_ext(queue, bus, SPI_QUEUE_DEFAULT_ENTRIES, SPI_QUEUE_NO_FD, malloc, free);
+}
+
+/**
+ * Destruct queue instance.
+ *
+ * Messages already submitted are executed before the worker quits. Unreaped completions are dropped.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param deallocator Custom memory deallocator.
+ *
+ * @return spi_queue_status_iptr when NULL was passed instead of a valid pointer, spi_queue_status_ok otherwise.
+ */
+spi_queue_status spi_queue_destruct_ext(spi_queue* queue, mem_deallocator deallocator);
+
+/**
+ * Stop the worker thread without releasing the queue.
+ *
+ * Messages already submitted are executed first. The queue may still be kicked afterwards, which makes it possible to
+ * stop several queues whose workers kick one another before any of them is destructed.
+ *
+ * @param queue Pointer to a queue instance.
+ *
+ * @return spi_queue_status_iptr when NULL was passed instead of a valid pointer, spi_queue_status_ok otherwise.
+ */
+spi_queue_status spi_queue_stop(spi_queue* queue);
+
+/**
+ * Destruct queue instance with a default deallocator.
+ *
+ * @param queue Pointer to a queue instance.
+ *
+ * @return Operation status. Return values are the same as for spi_queue_destruct_ext().
+ */
+static inline spi_queue_status spi_queue_destruct(spi_queue* queue)
+{
+    return spi_queue_destruct_ext(queue, free);
+}
+
+/**
+ * Submit a batch of messages.
+ *
+ * Either all entries are queued or none of them. The worker is woken up at most once per batch. Only a single thread
+ * may submit to a queue.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param entries Array of entries. They are copied, so the array may be reused right away.
+ * @param count The number of entries.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_queue_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_queue_status_busy when fewer than 'count' messages may be put in flight
+ *          - spi_queue_status_ok on success
+ */
+spi_queue_status spi_queue_submit(spi_queue* queue, const spi_queue_entry* entries, size count);
+
+/**
+ * Reap completions without blocking.
+ *
+ * Completions are returned in submission order. Only a single thread may reap from a queue.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param completions Output array.
+ * @param max Capacity of the output array.
+ * @param reaped Output parameter for the number of completions written.
+ *
+ * @return spi_queue_status_iptr when NULL was passed instead of a valid pointer, spi_queue_status_ok otherwise.
+ */
+spi_queue_status spi_queue_reap(spi_queue* queue, spi_queue_completion* completions, size max, size* reaped);
+
+/**
+ * Block until at least 'min' completions are ready to be reaped.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param min The number of completions to wait for.
+ *
+ * @return Operation status. Valid values are:
+ *          - spi_queue_status_iptr when NULL was passed instead of a valid pointer
+ *          - spi_queue_status_cerror when 'min' exceeds the number of messages in flight
+ *          - spi_queue_status_ok on success
+ */
+spi_queue_status spi_queue_wait(spi_queue* queue, size min);
+
+/**
+ * Install a service function run on the worker thread.
+ *
+ * The service runs whenever the worker wakes up, either for submissions or after spi_queue_kick(), and may use the
+ * bus freely. It is meant for work that has to stay on the thread owning the bus, like delivering messages from other
+ * buses. Install it once, before anything can kick the queue.
+ *
+ * @param queue Pointer to a queue instance.
+ * @param service Service function.
+ * @param ctx Context of the service function.
+ *
+ * @return spi_queue_status_iptr when NULL was passed instead of a valid pointer, spi_queue_status_ok otherwise.
+ */
+spi_queue_status spi_queue_set_service(spi_queue* queue, spi_queue_service service, void* ctx);
+
+/**
+ * Make the worker run its service.
+ *
+ * May be called from any thread. The worker is woken up only when it sleeps.
+ *
+ * @param queue Pointer to a queue instance.
+ *
+ * @return spi_queue_status_iptr when NULL was passed instead of a valid pointer, spi_queue_status_ok otherwise.
+ */
+spi_queue_status spi_queue_kick(spi_queue* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_SPI_QUEUE_H
@@ -0,0 +1,208 @@
+#ifndef SPI_EMULATOR_TASK_POOL_H
+#define SPI_EMULATOR_TASK_POOL_H
+
+#include "type.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+#include <cstdlib>
+#else
+#include <stdlib.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Default number of task descriptors of a pool */
+#define TASK_POOL_DEFAULT_CAPACITY 1024
+
+/** Value of a task index meaning no task */
+#define TASK_POOL_NO_TASK UINT32_MAX
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+struct task_pool_;
+
+/**
+ * Task descriptor
+ */
+typedef struct task_
+{
+    void (*fn)(void* arg); /**< Work to do */
+    void* arg; /**< Argument of the work function */
+    u32 next; /**< Next free descriptor. Do not use directly */
+} task;
+
+/**
+ * Chase-Lev work-stealing deque of task indices
+ *
+ * The owning worker pushes and takes at the bottom, other workers steal from the top. The deque never grows - it is
+ * as large as the descriptor pool, so it cannot overflow.
+ */
+typedef struct task_deque_
+{
+    i64 top; /**< Next index to steal. Do not use directly */
+    i64 bottom; /**< Next index to push. Do not use directly */
+    u32* buffer; /**< Ring of task indices. Do not use directly */
+} task_deque;
+
+/**
+ * Cell of the injection queue
+ */
+typedef struct task_cell_
+{
+    size sequence; /**< Turn of the cell. Do not use directly */
+    u32 task; /**< Task index. Do not use directly */
+} task_cell;
+
+/**
+ * Worker thread of a pool
+ */
+typedef struct task_worker_
+{
+    task_deque deque; /**< Tasks spawned on this worker */
+    struct task_pool_* pool; /**< Owning pool */
+    u64 seed; /**< State of the victim selection. Do not use directly */
+    u64 executed; /**< The number of tasks run by the worker */
+    u64 stolen; /**< The number of tasks taken from other workers */
+    pthread_t thread; /**< Worker thread. Do not use directly */
+} task_worker;
+
+/**
+ * Work-stealing task pool
+ *
+ * Tasks submitted from outside go to a shared lock-free injection queue, tasks submitted by running tasks go to the
+ * deque of their worker. An idle worker takes from its own deque first, then from the injection queue and finally
+ * steals from other workers. Descriptors come from a preallocated free list, so submitting never allocates. Locks are
+ * only taken to put a thread to sleep or to wake it up.
+ */
+typedef struct task_pool_
+{
+    task* tasks; /**< Descriptor pool. Do not use directly */
+    u64 free_head; /**< Free list head: index in the low half, ABA tag in the high half. Do not use directly */
+    task_cell* inject; /**< Injection queue. Do not use directly */
+    size inject_head; /**< Next injection cell to consume. Do not use directly */
+    size inject_tail; /**< Next injection cell to produce. Do not use directly */
+    size capacity; /**< The number of descriptors. Power of two */
+    task_worker* workers; /**< Worker threads */
+    size count; /**< The number of workers */
+    size pending; /**< Tasks submitted and not finished yet. Do not use directly */
+    size sleepers; /**< Workers going to sleep. Do not use directly */
+    size waiters; /**< Threads sleeping in task_pool_wait(). Do not use directly */
+    bool stop; /**< Request for workers to quit. Do not use directly */
+    pthread_mutex_t lock; /**< Guards sleeping only. Do not use directly */
+    pthread_cond_t work; /**< Wakes workers. Do not use directly */
+    pthread_cond_t done; /**< Wakes threads waiting for all tasks. Do not use directly */
+} task_pool;
+
+/**
+ * Status codes returned by API functions
+ */
+typedef enum task_pool_status_
+{
+    task_pool_status_ok, /**< Success */
+    task_pool_status_iptr, /**< NULL pointer passed instead of a valid pointer */
+    task_pool_status_merror, /**< Memory allocator failed */
+    task_pool_status_cerror, /**< Invalid parameters or threads cannot be started */
+    task_pool_status_busy /**< All descriptors are in use */
+} task_pool_status;
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Construct task pool and start its workers.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param workers The number of worker threads.
+ * @param capacity The maximum number of unfinished tasks. Must be a power of two.
+ * @param allocator Pointer to a custom memory allocator. All memory is allocated here, once.
+ * @param deallocator Custom memory deallocator releasing the allocation when workers cannot be started.
+ *
+ * @return Operation status. Valid values are:
+ *          - task_pool_status_iptr when NULL was passed instead of a valid pointer
+ *          - task_pool_status_cerror when parameters are invalid or threads cannot be started
+ *          - task_pool_status_merror when memory allocator failed
+ *          - task_pool_status_ok on success
+ */
+task_pool_status task_pool_construct_ext(task_pool* pool, size workers, size capacity, mem_allocator allocator,
+                                         mem_deallocator deallocator);
+
+/**
+ * Construct task pool with default capacity and default memory allocator.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param workers The number of worker threads.
+ *
+ * @return Operation status. Return values are the same as for task_pool_construct_ext().
+ */
+static inline task_pool_status task_pool_construct(task_pool* pool, size workers)
+{
+    return task_pool_construct_ext(pool, workers, TASK_POOL_DEFAULT_CAPACITY, malloc, free);
+}
+
+/**
+ * Destruct task pool.
+ *
+ * Tasks already submitted are finished before workers quit.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param deallocator Custom memory deallocator.
+ *
+ * @return task_pool_status_iptr when NULL was passed instead of a valid pointer, task_pool_status_ok otherwise.
+ */
+task_pool_status task_pool_destruct_ext(task_pool* pool, mem_deallocator deallocator);
+
+/**
+ * Destruct task pool with a default deallocator.
+ *
+ * @param pool Pointer to a pool instance.
+ *
+ * @return Operation status. Return values are the same as for task_pool_destruct_ext().
+ */
+static inline task_pool_status task_pool_destruct(task_pool* pool)
+{
+    return task_pool_destruct_ext(pool, free);
+}
+
+/**
+ * Submit a task.
+ *
+ * May be called from any thread, including running tasks. A task submitted by a task is queued on the same worker,
+ * where it stays cache-hot unless another worker runs out of work and steals it.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param fn Work function. It is called on one of the workers.
+ * @param arg Argument of the work function.
+ *
+ * @return Operation status. Valid values are:
+ *          - task_pool_status_iptr when NULL was passed instead of a valid pointer
+ *          - task_pool_status_busy when all descriptors are in use
+ *          - task_pool_status_ok on success
+ */
+task_pool_status task_pool_submit(task_pool* pool, void (*fn)(void* arg), void* arg);
+
+/**
+ * Block until every submitted task has finished.
+ *
+ * Must not be called from a task.
+ *
+ * @param pool Pointer to a pool instance.
+ *
+ * @return task_pool_status_iptr when NULL was passed instead of a valid pointer, task_pool_status_ok otherwise.
+ */
+task_pool_status task_pool_wait(task_pool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SPI_EMULATOR_TASK_POOL_H
@@ -153,3 +153,13 @@ bool array_iterator_create(iterator_instance* iter, void* arr, size elements, si
 
     return true;
 }
+
+bool array_iterator_is_array(const iterator_instance* iter)
+{
+    NOT_NULL(iter, false);
+
+    if (iterator_type_const == iter->type) {
+        return array_iterator_const_next == iter->next.next_const;
+    }
+    return array_iterator_next == iter->next.next_non_const;
+}
@@ -0,0 +1,102 @@
+#include "device_coro.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------------- Macros -------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Staging size for MOSI bytes of a generic iterator */
+#define DEVICE_CORO_CHUNK 64
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Let the body consume a chunk of bytes, answering with the idle byte once it has finished */
+static void device_coro_feed(device_coro* co, const u8* mosi, u8* miso, size len)
+{
+    co->mosi = mosi;
+    co->miso = miso;
+    co->len = len;
+    co->pos = 0;
+
+    /* The body only returns when it runs out of bytes or finishes */
+    if (LIKELY(!co->done)) {
+        ++co->resumes;
+        co->body(co, co->state);
+    }
+    if (co->pos < len) {
+        memset(miso + co->pos, co->idle, len - co->pos);
+    }
+}
+
+static void device_coro_select(void* device)
+{
+    device_coro* co = device;
+    co->selected = true;
+    co->done = false;
+}
+
+static void device_coro_exchange(void* device, const iterator_instance* mosi, u8* miso, size len)
+{
+    device_coro* co = device;
+
+    const u8* array = device_mosi_array(mosi);
+    if (NULL != array || NULL == mosi) {
+        device_coro_feed(co, array, miso, len);
+        return;
+    }
+
+    /* Generic iterators are staged a few bytes at a time */
+    u8 staging[DEVICE_CORO_CHUNK];
+    device_mosi_stream stream;
+    device_mosi_open(&stream, mosi);
+    for (size offset = 0; offset < len; offset += DEVICE_CORO_CHUNK) {
+        size n = len - offset < DEVICE_CORO_CHUNK ? len - offset : DEVICE_CORO_CHUNK;
+        device_mosi_next(&stream, staging, n);
+        device_coro_feed(co, staging, miso + offset, n);
+    }
+}
+
+static void device_coro_deselect(void* device)
+{
+    device_coro* co = device;
+    co->selected = false;
+
+    /* Exchanges stop waiting, so the body runs to its end right here */
+    if (!co->done) {
+        co->mosi = NULL;
+        co->miso = NULL;
+        co->len = 0;
+        co->pos = 0;
+        ++co->resumes;
+        co->body(co, co->state);
+    }
+    co->line = 0;
+    co->done = true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Global variables --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+const spi_device_ops DEVICE_CORO_OPS = {device_coro_select, device_coro_exchange, device_coro_deselect, NULL};
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+device_coro_status device_coro_init(device_coro* co, device_coro_body body, void* state, u8 idle)
+{
+    NOT_NULL(co, device_coro_status_iptr);
+    NOT_NULL(body, device_coro_status_iptr);
+
+    memset(co, 0, sizeof(*co));
+    co->done = true;
+    co->idle = idle;
+    co->body = body;
+    co->state = state;
+
+    return device_coro_status_ok;
+}
@@ -0,0 +1,43 @@
+#include "device_model.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void device_mosi_read(const iterator_instance* mosi, u8* dst, size len)
+{
+    device_mosi_stream stream;
+    device_mosi_open(&stream, mosi);
+    device_mosi_next(&stream, dst, len);
+}
+
+void device_mosi_open(device_mosi_stream* stream, const iterator_instance* mosi)
+{
+    stream->mosi = mosi;
+    stream->array = device_mosi_array(mosi);
+    stream->current = NULL;
+    stream->end = NULL;
+    stream->offset = 0;
+    if (NULL == stream->array && NULL != mosi) {
+        stream->current = ITERATOR_CBEGIN(*mosi);
+        stream->end = ITERATOR_CEND(*mosi);
+    }
+}
+
+void device_mosi_next(device_mosi_stream* stream, u8* dst, size len)
+{
+    if (NULL != stream->array) {
+        memcpy(dst, stream->array + stream->offset, len);
+        stream->offset += len;
+        return;
+    }
+
+    size i = 0;
+    for (; i < len && stream->current != stream->end; ++i) {
+        dst[i] = *(const u8*)stream->current;
+        stream->current = ITERATOR_CNEXT(*stream->mosi);
+    }
+    memset(dst + i, 0, len - i);
+    stream->offset += len;
+}
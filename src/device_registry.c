@@ -0,0 +1,132 @@
+#include "device_registry.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void device_nop(void* device)
+{
+    (void)device;
+}
+
+static void device_timing_nop(void* device, const spi_cycle* cycle)
+{
+    (void)device;
+    (void)cycle;
+}
+
+static void device_loopback_exchange(void* device, const iterator_instance* mosi, u8* miso, size len)
+{
+    (void)device;
+    device_mosi_read(mosi, miso, len);
+}
+
+static void device_null_exchange(void* device, const iterator_instance* mosi, u8* miso, size len)
+{
+    (void)device;
+    (void)mosi;
+    memset(miso, DEVICE_NULL_MISO, len);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+device_registry_status device_registry_init(device_registry* registry)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+
+    memset(registry, 0, sizeof(*registry));
+    return device_registry_status_ok;
+}
+
+device_registry_status device_registry_register(device_registry* registry, u32 cs, const spi_device_ops* ops,
+                                                void* device)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+    NOT_NULL(ops, device_registry_status_iptr);
+
+    if (DEVICE_REGISTRY_MAX_CS <= cs || NULL == ops->exchange) {
+        return device_registry_status_cerror;
+    }
+
+    device_entry* entry = &registry->entries[cs];
+    entry->select = NULL != ops->select ? ops->select : device_nop;
+    entry->exchange = ops->exchange;
+    entry->deselect = NULL != ops->deselect ? ops->deselect : device_nop;
+    entry->timing = NULL != ops->timing ? ops->timing : device_timing_nop;
+    entry->device = device;
+    memset(&entry->mosi, 0, sizeof(entry->mosi));
+    memset(&entry->miso, 0, sizeof(entry->miso));
+    entry->kind = device_kind_model;
+    entry->pure = NULL;
+    entry->version = NULL;
+    return device_registry_status_ok;
+}
+
+device_registry_status device_registry_register_builtin(device_registry* registry, u32 cs, device_kind kind)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+
+    spi_device_ops ops = {NULL, NULL, NULL, NULL};
+    if (device_kind_loopback == kind) {
+        ops.exchange = device_loopback_exchange;
+    } else if (device_kind_null == kind) {
+        ops.exchange = device_null_exchange;
+    }
+
+    device_registry_status status = device_registry_register(registry, cs, &ops, NULL);
+    if (device_registry_status_ok == status) {
+        registry->entries[cs].kind = kind;
+    }
+    return status;
+}
+
+device_registry_status device_registry_set_cache(device_registry* registry, u32 cs, device_pure pure,
+                                                 const u64* version)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+    if (NULL != pure) {
+        NOT_NULL(version, device_registry_status_iptr);
+    }
+
+    if (NULL == device_registry_lookup(registry, cs)) {
+        return device_registry_status_cerror;
+    }
+
+    device_entry* entry = &registry->entries[cs];
+    entry->pure = pure;
+    entry->version = NULL != pure ? version : NULL;
+    return device_registry_status_ok;
+}
+
+device_registry_status device_registry_set_modes(device_registry* registry, u32 cs, const spi_mode* host,
+                                                 const spi_mode* device)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+    NOT_NULL(host, device_registry_status_iptr);
+    NOT_NULL(device, device_registry_status_iptr);
+
+    if (NULL == device_registry_lookup(registry, cs) || SPI_MODE_3 < host->mode || SPI_MODE_3 < device->mode) {
+        return device_registry_status_cerror;
+    }
+
+    device_entry* entry = &registry->entries[cs];
+    entry->mosi = spi_mode_transform_between(host, device);
+    entry->miso = spi_mode_transform_between(device, host);
+    return device_registry_status_ok;
+}
+
+device_registry_status device_registry_unregister(device_registry* registry, u32 cs)
+{
+    NOT_NULL(registry, device_registry_status_iptr);
+
+    if (DEVICE_REGISTRY_MAX_CS <= cs) {
+        return device_registry_status_cerror;
+    }
+
+    memset(&registry->entries[cs], 0, sizeof(device_entry));
+    return device_registry_status_ok;
+}
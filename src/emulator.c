@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+#include "emulator.h"
+#include "common.h"
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Deliver everything other buses have posted so far */
+static void emulator_bus_deliver_all(emulator_bus* self)
+{
+    const emulator* emu = self->emu;
+    size mask = emu->mailbox_entries - 1;
+
+    for (u32 from = 0; from < emu->count; ++from) {
+        emulator_mailbox* mailbox = &self->inbox[from];
+        size head = mailbox->ring.head;
+        size tail = __atomic_load_n(&mailbox->ring.tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            if (NULL != self->handler) {
+                self->handler(self->emu, self->index, from, &mailbox->slots[head & mask], self->handler_ctx);
+            }
+        }
+        __atomic_store_n(&mailbox->ring.head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Return the sender of the earliest message due no later than 'limit_ns' or EMULATOR_MAX_BUSES. Mailboxes are sorted,
+ * so only their heads are compared. Ties go to the lowest sender, which keeps the order independent of thread timing.
+ */
+static u32 emulator_bus_earliest(const emulator_bus* self, u64 limit_ns)
+{
+    const emulator* emu = self->emu;
+    size mask = emu->mailbox_entries - 1;
+    u32 earliest = EMULATOR_MAX_BUSES;
+    u64 time = limit_ns;
+
+    for (u32 from = 0; from < emu->count; ++from) {
+        const emulator_mailbox* mailbox = &self->inbox[from];
+        size head = mailbox->ring.head;
+        if (head != __atomic_load_n(&mailbox->ring.tail, __ATOMIC_ACQUIRE)) {
+            u64 msg_time = mailbox->slots[head & mask].time_ns;
+            if (msg_time < time || (msg_time == time && EMULATOR_MAX_BUSES == earliest)) {
+                time = msg_time;
+                earliest = from;
+            }
+        }
+    }
+    return earliest;
+}
+
+/* The latest time the bus may reach - no other bus can send anything due earlier than that */
+static u64 emulator_bus_horizon(const emulator_bus* self)
+{
+    const emulator* emu = self->emu;
+    u64 horizon = emu->until_ns;
+
+    for (u32 j = 0; j < emu->count; ++j) {
+        if (j != self->index) {
+            u64 bound = __atomic_load_n(&emu->buses[j]->clock_ns, __ATOMIC_ACQUIRE) + emu->lookahead_ns;
+            horizon = bound < horizon ? bound : horizon;
+        }
+    }
+    return horizon;
+}
+
+/*
+ * Run a synchronized bus as far as its horizon allows. Messages are delivered at their timestamps, before local events
+ * of the same time. Return true when the bus made progress.
+ */
+static bool emulator_bus_step(emulator_bus* self)
+{
+    emulator* emu = self->emu;
+    if (self->clock_ns >= emu->until_ns) {
+        return false;
+    }
+    u64 limit = emulator_bus_horizon(self);
+    if (limit <= self->clock_ns) {
+        return false;
+    }
+
+    size mask = emu->mailbox_entries - 1;
+    for (u32 from = emulator_bus_earliest(self, limit); EMULATOR_MAX_BUSES != from;
+         from = emulator_bus_earliest(self, limit)) {
+        emulator_mailbox* mailbox = &self->inbox[from];
+        const emulator_msg* msg = &mailbox->slots[mailbox->ring.head & mask];
+
+        /* Messages are always due past the clock, see emulator_post() */
+        if (scheduler_status_ok != scheduler_advance(&self->sched, msg->time_ns - 1)) {
+            ++self->overruns;
+        }
+        if (NULL != self->handler) {
+            /* Transfers of the handler move only the bus time, so the scheduler never runs past the next message */
+            spi_bus_set_horizon(&self->bus, msg->time_ns - 1);
+            self->handler(emu, self->index, from, msg, self->handler_ctx);
+            spi_bus_set_horizon(&self->bus, SPI_BUS_NO_HORIZON);
+        }
+        __atomic_store_n(&mailbox->ring.head, mailbox->ring.head + 1, __ATOMIC_RELEASE);
+    }
+
+    /* Nothing but timers drives a synchronized bus, so it jumps from one batch of events to the next */
+    scheduler_status status;
+    do {
+        status = scheduler_fast_forward(&self->sched, limit);
+    } while (scheduler_status_ok == status && self->sched.now_ns < limit);
+    if (scheduler_status_empty == status) {
+        status = scheduler_advance(&self->sched, limit);
+    }
+    if (scheduler_status_ok != status) {
+        ++self->overruns;
+    }
+
+    /* Messages posted on the way become visible to other buses together with the new clock */
+    __atomic_store_n(&self->clock_ns, limit, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&emu->parallel, __ATOMIC_ACQUIRE)) {
+        for (u32 j = 0; j < emu->count; ++j) {
+            if (j != self->index) {
+                spi_queue_kick(&emu->buses[j]->queue);
+            }
+        }
+        if (limit == emu->until_ns) {
+            pthread_mutex_lock(&emu->lock);
+            pthread_cond_broadcast(&emu->reached);
+            pthread_mutex_unlock(&emu->lock);
+        }
+    }
+    return true;
+}
+
+/* Runs on the bus thread */
+static bool emulator_bus_serve(void* ctx)
+{
+    emulator_bus* self = ctx;
+    const emulator* emu = self->emu;
+
+    if (0 == emu->lookahead_ns) {
+        emulator_bus_deliver_all(self);
+        return false;
+    }
+    return __atomic_load_n(&emu->parallel, __ATOMIC_ACQUIRE) && emulator_bus_step(self);
+}
+
+static bool emulator_reached(const emulator* emu, u64 until_ns)
+{
+    for (size i = 0; i < emu->count; ++i) {
+        if (__atomic_load_n(&emu->buses[i]->clock_ns, __ATOMIC_ACQUIRE) < until_ns) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static emulator_status emulator_run_check(const emulator* emu, u64 until_ns)
+{
+    if (0 == emu->lookahead_ns) {
+        return emulator_status_cerror;
+    }
+    for (size i = 0; i < emu->count; ++i) {
+        if (emu->buses[i]->clock_ns > until_ns) {
+            return emulator_status_cerror;
+        }
+    }
+    return emulator_status_ok;
+}
+
+static emulator_status emulator_pin(pthread_t thread, int cpu)
+{
+    if (EMULATOR_NO_CPU == cpu) {
+        return emulator_status_ok;
+    }
+    if (cpu < 0 || CPU_SETSIZE <= cpu) {
+        return emulator_status_cerror;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return 0 == pthread_setaffinity_np(thread, sizeof(set), &set) ? emulator_status_ok : emulator_status_cerror;
+}
+
+static emulator_status emulator_bus_create(emulator* emu, u32 index, const emulator_bus_config* config)
+{
+    NOT_NULL(config->allocator, emulator_status_iptr);
+    NOT_NULL(config->deallocator, emulator_status_iptr);
+
+    /* Inbound mailboxes follow the bus */
+    size ring_bytes = emu->mailbox_entries * sizeof(emulator_msg);
+    emulator_bus* self = config->allocator(sizeof(emulator_bus) + emu->count * ring_bytes);
+    NOT_NULL(self, emulator_status_merror);
+    memset(self, 0, sizeof(*self));
+    self->deallocator = config->deallocator;
+    self->emu = emu;
+    self->index = index;
+    for (size from = 0; from < emu->count; ++from) {
+        self->inbox[from].slots = (emulator_msg*)(self + 1) + from * emu->mailbox_entries;
+    }
+
+    spi_bus_status bus_status = spi_bus_construct_ext(&self->bus, config->scratch_size, config->allocator);
+    if (spi_bus_status_ok != bus_status) {
+        config->deallocator(self);
+        return spi_bus_status_merror == bus_status ? emulator_status_merror : emulator_status_cerror;
+    }
+    scheduler_init(&self->sched, 0);
+    spi_bus_set_scheduler(&self->bus, &self->sched);
+
+    spi_queue_status queue_status = spi_queue_construct_ext(&self->queue, &self->bus, config->queue_entries,
+                                                            SPI_QUEUE_NO_FD, config->allocator,
+                                                            config->deallocator);
+    if (spi_queue_status_ok != queue_status) {
+        spi_bus_destruct_ext(&self->bus, config->deallocator);
+        config->deallocator(self);
+        return spi_queue_status_merror == queue_status ? emulator_status_merror : emulator_status_cerror;
+    }
+
+    /* The bus is reachable from now on, so a failure below is cleaned up by emulator_destruct() */
+    emu->buses[index] = self;
+    spi_queue_set_service(&self->queue, emulator_bus_serve, self);
+    return emulator_pin(self->queue.worker, config->cpu);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+emulator_status emulator_construct(emulator* emu, const emulator_bus_config* configs, size count,
+                                   size mailbox_entries)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+    NOT_NULL(configs, emulator_status_iptr);
+
+    if (0 == count || EMULATOR_MAX_BUSES < count || 0 == mailbox_entries
+        || 0 != (mailbox_entries & (mailbox_entries - 1))) {
+        return emulator_status_cerror;
+    }
+
+    memset(emu, 0, sizeof(*emu));
+    if (0 != pthread_mutex_init(&emu->lock, NULL)) {
+        return emulator_status_cerror;
+    }
+    if (0 != pthread_cond_init(&emu->reached, NULL)) {
+        pthread_mutex_destroy(&emu->lock);
+        return emulator_status_cerror;
+    }
+    emu->count = count;
+    emu->mailbox_entries = mailbox_entries;
+
+    for (u32 i = 0; i < count; ++i) {
+        emulator_status status = emulator_bus_create(emu, i, &configs[i]);
+        if (emulator_status_ok != status) {
+            emulator_destruct(emu);
+            return status;
+        }
+    }
+    return emulator_status_ok;
+}
+
+emulator_status emulator_destruct(emulator* emu)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+
+    /* Bus threads may post to one another, so all of them quit before any bus is released */
+    for (size i = 0; i < emu->count; ++i) {
+        if (NULL != emu->buses[i]) {
+            spi_queue_stop(&emu->buses[i]->queue);
+        }
+    }
+    for (size i = 0; i < emu->count; ++i) {
+        emulator_bus* self = emu->buses[i];
+        if (NULL != self) {
+            spi_queue_destruct_ext(&self->queue, self->deallocator);
+            spi_bus_destruct_ext(&self->bus, self->deallocator);
+            self->deallocator(self);
+            emu->buses[i] = NULL;
+        }
+    }
+    if (0 != emu->mailbox_entries) {
+        pthread_cond_destroy(&emu->reached);
+        pthread_mutex_destroy(&emu->lock);
+        emu->mailbox_entries = 0;
+    }
+    emu->count = 0;
+    return emulator_status_ok;
+}
+
+emulator_status emulator_set_handler(emulator* emu, u32 bus, emulator_handler handler, void* ctx)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+    NOT_NULL(handler, emulator_status_iptr);
+
+    emulator_bus* self = emulator_bus_at(emu, bus);
+    if (NULL == self) {
+        return emulator_status_cerror;
+    }
+    self->handler_ctx = ctx;
+    self->handler = handler;
+    return emulator_status_ok;
+}
+
+emulator_status emulator_post(emulator* emu, u32 from, u32 to, const emulator_msg* msg)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+    NOT_NULL(msg, emulator_status_iptr);
+
+    emulator_bus* target = emulator_bus_at(emu, to);
+    if (UNLIKELY(NULL == target || NULL == emulator_bus_at(emu, from))) {
+        return emulator_status_cerror;
+    }
+
+    /*
+     * The sender runs past its clock during a step, except for a handler of a message due right after the clock - it
+     * runs with the scheduler at the clock itself. Receivers may have reached the clock plus the lookahead already.
+     */
+    const emulator_bus* sender = emu->buses[from];
+    u64 now = sender->sched.now_ns > sender->clock_ns ? sender->sched.now_ns : sender->clock_ns + 1;
+    emulator_mailbox* mailbox = &target->inbox[from];
+    if (0 != emu->lookahead_ns && (msg->time_ns < now + emu->lookahead_ns || msg->time_ns < mailbox->last_ns)) {
+        return emulator_status_cerror;
+    }
+
+    size tail = mailbox->ring.tail;
+    if (UNLIKELY(tail - __atomic_load_n(&mailbox->ring.head, __ATOMIC_ACQUIRE) == emu->mailbox_entries)) {
+        return emulator_status_busy;
+    }
+    mailbox->slots[tail & (emu->mailbox_entries - 1)] = *msg;
+    mailbox->last_ns = msg->time_ns;
+    __atomic_store_n(&mailbox->ring.tail, tail + 1, __ATOMIC_RELEASE);
+
+    /* A synchronized bus picks the message up when its horizon moves */
+    if (0 == emu->lookahead_ns) {
+        spi_queue_kick(&target->queue);
+    }
+    return emulator_status_ok;
+}
+
+emulator_status emulator_synchronize(emulator* emu, u64 lookahead_ns)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+
+    if (0 == lookahead_ns) {
+        return emulator_status_cerror;
+    }
+    emu->lookahead_ns = lookahead_ns;
+    return emulator_status_ok;
+}
+
+emulator_status emulator_run(emulator* emu, u64 until_ns)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+
+    emulator_status status = emulator_run_check(emu, until_ns);
+    if (emulator_status_ok != status) {
+        return status;
+    }
+
+    emu->until_ns = until_ns;
+    __atomic_store_n(&emu->parallel, true, __ATOMIC_RELEASE);
+    for (size i = 0; i < emu->count; ++i) {
+        spi_queue_kick(&emu->buses[i]->queue);
+    }
+
+    pthread_mutex_lock(&emu->lock);
+    while (!emulator_reached(emu, until_ns)) {
+        pthread_cond_wait(&emu->reached, &emu->lock);
+    }
+    pthread_mutex_unlock(&emu->lock);
+    __atomic_store_n(&emu->parallel, false, __ATOMIC_RELEASE);
+    return emulator_status_ok;
+}
+
+emulator_status emulator_run_serial(emulator* emu, u64 until_ns)
+{
+    NOT_NULL(emu, emulator_status_iptr);
+
+    emulator_status status = emulator_run_check(emu, until_ns);
+    if (emulator_status_ok != status) {
+        return status;
+    }
+
+    emu->until_ns = until_ns;
+    while (!emulator_reached(emu, until_ns)) {
+        for (size i = 0; i < emu->count; ++i) {
+            emulator_bus_step(emu->buses[i]);
+        }
+    }
+    return emulator_status_ok;
+}
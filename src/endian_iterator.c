@@ -0,0 +1,243 @@
+#include "endian_iterator.h"
+#include "array_iterator.h"
+#include "common.h"
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void endian_swap_scalar(u8* dst, const u8* src, size count, size element_size)
+{
+    switch (element_size) {
+        case sizeof(u16):
+            for (size i = 0; i < count; ++i) {
+                u16 v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                v = __builtin_bswap16(v);
+                memcpy(dst + i * sizeof(v), &v, sizeof(v));
+            }
+            break;
+        case sizeof(u32):
+            for (size i = 0; i < count; ++i) {
+                u32 v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                v = __builtin_bswap32(v);
+                memcpy(dst + i * sizeof(v), &v, sizeof(v));
+            }
+            break;
+        case sizeof(u64):
+            for (size i = 0; i < count; ++i) {
+                u64 v;
+                memcpy(&v, src + i * sizeof(v), sizeof(v));
+                v = __builtin_bswap64(v);
+                memcpy(dst + i * sizeof(v), &v, sizeof(v));
+            }
+            break;
+        default:
+            if (dst != src) {
+                memmove(dst, src, count * element_size);
+            }
+            break;
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+/* Return pshufb mask reversing every element within a 128-bit lane */
+static __m128i endian_shuffle_mask(size element_size)
+{
+    u8 mask[16];
+    for (u8 i = 0; i < 16; ++i) {
+        u8 base = (u8)(i - i % element_size);
+        mask[i] = (u8)(base + element_size - 1 - i % element_size);
+    }
+    return _mm_loadu_si128((const __m128i*)mask);
+}
+
+/* Swap as many bytes as possible with vector instructions. Return the number of bytes processed */
+static size endian_swap_simd(u8* dst, const u8* src, size bytes, size element_size)
+{
+    const __m128i mask = endian_shuffle_mask(element_size);
+    size done = 0;
+#if defined(__AVX2__)
+    const __m256i mask256 = _mm256_broadcastsi128_si256(mask);
+    for (; done + 32 <= bytes; done += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + done));
+        _mm256_storeu_si256((__m256i*)(dst + done), _mm256_shuffle_epi8(v, mask256));
+    }
+#endif
+    for (; done + 16 <= bytes; done += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + done));
+        _mm_storeu_si128((__m128i*)(dst + done), _mm_shuffle_epi8(v, mask));
+    }
+    return done;
+}
+#endif
+
+/* Convert the next block using the source array */
+static size endian_fill_from_array(endian_iterator_ctx* ctx)
+{
+    size remaining = ctx->num_of_elements - ctx->block_start;
+    size count = remaining < ENDIAN_ITERATOR_BLOCK ? remaining : ENDIAN_ITERATOR_BLOCK;
+    endian_swap(ctx->block, ctx->array + ctx->block_start * ctx->element_size, count, ctx->element_size);
+    return count;
+}
+
+/* Convert the next block pulling elements one by one from the source */
+static size endian_fill_from_source(endian_iterator_ctx* ctx)
+{
+    const void* end = ITERATOR_CEND(*ctx->source);
+    u8* block = (u8*)ctx->block;
+    size count = 0;
+
+    while (count < ENDIAN_ITERATOR_BLOCK && ctx->source_current != end) {
+        endian_swap_scalar(block + count * ctx->element_size, ctx->source_current, 1, ctx->element_size);
+        ctx->source_current = ITERATOR_CNEXT(*ctx->source);
+        ++count;
+    }
+    return count;
+}
+
+static inline size endian_fill(endian_iterator_ctx* ctx)
+{
+    return NULL != ctx->array ? endian_fill_from_array(ctx) : endian_fill_from_source(ctx);
+}
+
+static inline const void* endian_current(const endian_iterator_ctx* ctx)
+{
+    return (const u8*)ctx->block + ctx->current_idx * ctx->element_size;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void endian_swap(void* dst, const void* src, size count, size element_size)
+{
+    u8* d = dst;
+    const u8* s = src;
+    size bytes = count * element_size;
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+    if (sizeof(u16) == element_size || sizeof(u32) == element_size || sizeof(u64) == element_size) {
+        size done = endian_swap_simd(d, s, bytes, element_size);
+        d += done;
+        s += done;
+        bytes -= done;
+    }
+#endif
+    endian_swap_scalar(d, s, bytes / element_size, element_size);
+}
+
+endian_iterator_status endian_iterator_init_ctx(iterator_instance* iterator,
+                                                const iterator_instance* source,
+                                                size element_size)
+{
+    NOT_NULL(iterator, endian_iterator_status_iptr);
+    NOT_NULL(source, endian_iterator_status_iptr);
+
+    if (iterator_type_const != iterator->type || iterator_type_const != source->type) {
+        return endian_iterator_status_cerror;
+    }
+    if (sizeof(u16) != element_size && sizeof(u32) != element_size && sizeof(u64) != element_size) {
+        return endian_iterator_status_cerror;
+    }
+    /* Elements of an array are read whole, so they must have the size being swapped */
+    if (array_iterator_is_array(source) && element_size != ((const array_iterator_ctx*)source->context)->element_size) {
+        return endian_iterator_status_cerror;
+    }
+
+    endian_iterator_ctx* ctx = iterator->context;
+    ctx->source = source;
+    ctx->element_size = element_size;
+    ctx->array = NULL;
+    ctx->num_of_elements = 0;
+    ctx->source_current = NULL;
+    ctx->block_start = 0;
+    ctx->block_len = 0;
+    ctx->current_idx = 0;
+
+    return endian_iterator_status_ok;
+}
+
+const void* endian_iterator_begin(void* context)
+{
+    endian_iterator_ctx* ctx = context;
+    ctx->block_start = 0;
+    ctx->current_idx = 0;
+    ctx->array = NULL;
+
+    /* The source may have been re-initialized since the last traversal, so the fast path is chosen here */
+    const void* first = ITERATOR_CBEGIN(*ctx->source);
+    const array_iterator_ctx* actx = ctx->source->context;
+    if (array_iterator_is_array(ctx->source)) {
+        /* An array re-initialized with another element size would be read past its end - yield nothing */
+        if (UNLIKELY(actx->element_size != ctx->element_size)) {
+            return endian_iterator_end(context);
+        }
+        ctx->array = first;
+        ctx->num_of_elements = actx->num_of_elements;
+    } else {
+        ctx->source_current = first;
+    }
+
+    ctx->block_len = endian_fill(ctx);
+    if (UNLIKELY(0 == ctx->block_len)) {
+        return endian_iterator_end(context);
+    }
+    return endian_current(ctx);
+}
+
+const void* endian_iterator_next(void* context)
+{
+    endian_iterator_ctx* ctx = context;
+    ++ctx->current_idx;
+
+    if (UNLIKELY(ctx->current_idx >= ctx->block_len)) {
+        ctx->block_start += ctx->block_len;
+        ctx->current_idx = 0;
+        ctx->block_len = endian_fill(ctx);
+        if (0 == ctx->block_len) {
+            return endian_iterator_end(context);
+        }
+    }
+
+    return endian_current(ctx);
+}
+
+const void* endian_iterator_end(void* context)
+{
+    endian_iterator_ctx* ctx = context;
+    return &ctx->block[ENDIAN_ITERATOR_BLOCK];
+}
+
+bool endian_iterator_create(iterator_instance* iter, const iterator_instance* source, size element_size)
+{
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, sizeof(endian_iterator_ctx));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use endian implementation */
+    is = iterator_init_as_const(iter, endian_iterator_begin, endian_iterator_next, endian_iterator_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    endian_iterator_status eis;
+    eis = endian_iterator_init_ctx(iter, source, element_size);
+    if (endian_iterator_status_ok != eis) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,231 @@
+#include "file_iterator.h"
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Buffers follow the context */
+static inline u8* file_buffer(file_iterator_ctx* ctx, size idx)
+{
+    return (u8*)(ctx + 1) + idx * ctx->chunk_size;
+}
+
+/* Read until the buffer is full or the end of file is reached. Return -1 on error */
+static long file_read_chunk(int fd, u8* buffer, size len)
+{
+    size done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, buffer + done, len - done);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            break;
+        }
+        done += (size)n;
+    }
+    return (long)done;
+}
+
+static void* file_reader(void* arg)
+{
+    file_iterator_ctx* ctx = arg;
+    size idx = 0;
+
+    for (;;) {
+        /* Wait until the consumer hands the buffer back */
+        pthread_mutex_lock(&ctx->lock);
+        while (ctx->full[idx] && !ctx->stop) {
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        bool stop = ctx->stop;
+        pthread_mutex_unlock(&ctx->lock);
+        if (stop) {
+            break;
+        }
+
+        long n = file_read_chunk(ctx->fd, file_buffer(ctx, idx), ctx->chunk_size);
+
+        /* An empty buffer tells the consumer that the traversal is over */
+        pthread_mutex_lock(&ctx->lock);
+        if (n < 0) {
+            ctx->error = true;
+            n = 0;
+        }
+        ctx->lengths[idx] = (size)n;
+        ctx->full[idx] = true;
+        pthread_cond_broadcast(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+        if (0 == n) {
+            break;
+        }
+        idx ^= 1;
+    }
+    return NULL;
+}
+
+static void file_reader_stop(file_iterator_ctx* ctx)
+{
+    if (!ctx->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stop = true;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+
+    pthread_join(ctx->reader, NULL);
+    ctx->running = false;
+}
+
+/* Block until the current buffer is filled and return it as a span */
+static const void* file_wait_current(file_iterator_ctx* ctx)
+{
+    pthread_mutex_lock(&ctx->lock);
+    while (!ctx->full[ctx->current]) {
+        pthread_cond_wait(&ctx->cond, &ctx->lock);
+    }
+    size len = ctx->lengths[ctx->current];
+    pthread_mutex_unlock(&ctx->lock);
+
+    ctx->span.data = file_buffer(ctx, ctx->current);
+    ctx->span.len = len;
+    return 0 != len ? &ctx->span : file_iterator_end(ctx);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+file_iterator_status file_iterator_init_ctx(iterator_instance* iterator, int fd, size chunk_size)
+{
+    NOT_NULL(iterator, file_iterator_status_iptr);
+
+    if (iterator_type_const != iterator->type || 0 > fd || 0 == chunk_size) {
+        return file_iterator_status_cerror;
+    }
+
+    file_iterator_ctx* ctx = iterator->context;
+    ctx->fd = fd;
+    ctx->chunk_size = chunk_size;
+    ctx->error = false;
+    ctx->full[0] = ctx->full[1] = false;
+    ctx->lengths[0] = ctx->lengths[1] = 0;
+    ctx->current = 0;
+    ctx->running = false;
+    ctx->stop = false;
+    ctx->span.data = NULL;
+    ctx->span.len = 0;
+
+    if (0 != pthread_mutex_init(&ctx->lock, NULL)) {
+        return file_iterator_status_cerror;
+    }
+    if (0 != pthread_cond_init(&ctx->cond, NULL)) {
+        pthread_mutex_destroy(&ctx->lock);
+        return file_iterator_status_cerror;
+    }
+
+    return file_iterator_status_ok;
+}
+
+const void* file_iterator_begin(void* context)
+{
+    file_iterator_ctx* ctx = context;
+
+    /* Restart reading from the beginning */
+    file_reader_stop(ctx);
+    ctx->full[0] = ctx->full[1] = false;
+    ctx->current = 0;
+    ctx->stop = false;
+    ctx->error = false;
+    ctx->span.len = 0;
+
+    if (0 > lseek(ctx->fd, 0, SEEK_SET) || 0 != pthread_create(&ctx->reader, NULL, file_reader, ctx)) {
+        ctx->error = true;
+        return file_iterator_end(context);
+    }
+    ctx->running = true;
+
+    return file_wait_current(ctx);
+}
+
+const void* file_iterator_next(void* context)
+{
+    file_iterator_ctx* ctx = context;
+    if (UNLIKELY(0 == ctx->span.len)) {
+        return file_iterator_end(context);
+    }
+
+    /* Hand the consumed buffer back to the reader and switch to the other one */
+    pthread_mutex_lock(&ctx->lock);
+    ctx->full[ctx->current] = false;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+    ctx->current ^= 1;
+
+    return file_wait_current(ctx);
+}
+
+const void* file_iterator_end(void* context)
+{
+    (void)context;
+    return NULL;
+}
+
+bool file_iterator_create(iterator_instance* iter, const char* path, size chunk_size)
+{
+    NOT_NULL(path, false);
+
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, file_iterator_ctx_size(chunk_size));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use file implementation */
+    is = iterator_init_as_const(iter, file_iterator_begin, file_iterator_next, file_iterator_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (0 > fd) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    file_iterator_status fis;
+    fis = file_iterator_init_ctx(iter, fd, chunk_size);
+    if (file_iterator_status_ok != fis) {
+        close(fd);
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
+
+iterator_status file_iterator_destroy(iterator_instance* iter)
+{
+    NOT_NULL(iter, iterator_status_iptr);
+
+    file_iterator_ctx* ctx = iter->context;
+    if (NULL != ctx) {
+        file_reader_stop(ctx);
+        pthread_cond_destroy(&ctx->cond);
+        pthread_mutex_destroy(&ctx->lock);
+        close(ctx->fd);
+    }
+    return iterator_destruct(iter);
+}
@@ -0,0 +1,185 @@
+#include "generator_iterator.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* The chunk buffer follows the context */
+static inline u8* generator_buffer(generator_iterator_ctx* ctx)
+{
+    return (u8*)(ctx + 1);
+}
+
+static const void* generator_refill(generator_iterator_ctx* ctx)
+{
+    size request = ctx->chunk_size;
+    if (0 != ctx->limit) {
+        size remaining = ctx->limit - ctx->produced;
+        request = remaining < request ? remaining : request;
+    }
+
+    size len = 0;
+    if (LIKELY(0 != request)) {
+        len = ctx->fill(ctx->user_data, generator_buffer(ctx), request);
+        len = len < request ? len : request;
+    }
+    if (0 == len) {
+        return generator_iterator_end(ctx);
+    }
+
+    ctx->produced += len;
+    ctx->span.data = generator_buffer(ctx);
+    ctx->span.len = len;
+    return &ctx->span;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+generator_iterator_status generator_iterator_init_ctx(iterator_instance* iterator,
+                                                      generator_fill fill,
+                                                      void* user_data,
+                                                      size chunk_size,
+                                                      size limit)
+{
+    NOT_NULL(iterator, generator_iterator_status_iptr);
+    NOT_NULL(fill, generator_iterator_status_iptr);
+
+    if (iterator_type_const != iterator->type || 0 == chunk_size) {
+        return generator_iterator_status_cerror;
+    }
+
+    generator_iterator_ctx* ctx = iterator->context;
+    ctx->fill = fill;
+    ctx->user_data = user_data;
+    ctx->chunk_size = chunk_size;
+    ctx->limit = limit;
+    ctx->produced = 0;
+    ctx->span.data = NULL;
+    ctx->span.len = 0;
+
+    return generator_iterator_status_ok;
+}
+
+const void* generator_iterator_begin(void* context)
+{
+    generator_iterator_ctx* ctx = context;
+    ctx->produced = 0;
+    return generator_refill(ctx);
+}
+
+const void* generator_iterator_next(void* context)
+{
+    return generator_refill(context);
+}
+
+const void* generator_iterator_end(void* context)
+{
+    (void)context;
+    return NULL;
+}
+
+bool generator_iterator_create(iterator_instance* iter,
+                               generator_fill fill,
+                               void* user_data,
+                               size chunk_size,
+                               size limit)
+{
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, generator_iterator_ctx_size(chunk_size));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use generator implementation */
+    is = iterator_init_as_const(iter, generator_iterator_begin, generator_iterator_next, generator_iterator_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    generator_iterator_status gis;
+    gis = generator_iterator_init_ctx(iter, fill, user_data, chunk_size, limit);
+    if (generator_iterator_status_ok != gis) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
+
+size generator_constant(void* user_data, u8* buffer, size len)
+{
+    const generator_constant_state* state = user_data;
+    memset(buffer, state->value, len);
+    return len;
+}
+
+size generator_counter(void* user_data, u8* buffer, size len)
+{
+    generator_counter_state* state = user_data;
+    u8 value = state->next;
+    for (size i = 0; i < len; ++i) {
+        buffer[i] = value++;
+    }
+    state->next = value;
+    return len;
+}
+
+generator_iterator_status generator_prbs_init(generator_prbs_state* state, u8 order, u32 seed)
+{
+    NOT_NULL(state, generator_iterator_status_iptr);
+
+    switch (order) {
+        case 7: state->tap = 6; break;
+        case 15: state->tap = 14; break;
+        case 23: state->tap = 18; break;
+        case 31: state->tap = 28; break;
+        default: return generator_iterator_status_cerror;
+    }
+
+    u32 mask = (1u << order) - 1;
+    if (0 == (seed & mask)) {
+        return generator_iterator_status_cerror;
+    }
+    state->order = order;
+    state->lfsr = seed & mask;
+
+    return generator_iterator_status_ok;
+}
+
+size generator_prbs(void* user_data, u8* buffer, size len)
+{
+    generator_prbs_state* state = user_data;
+    const u32 order = state->order;
+    const u32 tap = state->tap;
+    const u32 mask = (1u << order) - 1;
+    u32 lfsr = state->lfsr;
+
+    if (tap >= 8) {
+        /* Eight new bits depend only on bits already in the register, so a whole byte is computed at once */
+        for (size i = 0; i < len; ++i) {
+            u32 byte = ((lfsr >> (order - 8)) ^ (lfsr >> (tap - 8))) & 0xFF;
+            lfsr = ((lfsr << 8) | byte) & mask;
+            buffer[i] = (u8)byte;
+        }
+    } else {
+        for (size i = 0; i < len; ++i) {
+            u32 byte = 0;
+            for (u32 b = 0; b < 8; ++b) {
+                u32 bit = ((lfsr >> (order - 1)) ^ (lfsr >> (tap - 1))) & 1;
+                lfsr = ((lfsr << 1) | bit) & mask;
+                byte = (byte << 1) | bit;
+            }
+            buffer[i] = (u8)byte;
+        }
+    }
+
+    state->lfsr = lfsr;
+    return len;
+}
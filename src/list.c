@@ -0,0 +1,323 @@
+#include "list.h"
+#include "common.h"
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline dlist_node* dlist_from_link(slist_node* link)
+{
+    /* The link is the first member of dlist_node */
+    return (dlist_node*)link;
+}
+
+static slist_node* list_iterator_first(list_iterator_ctx* ctx)
+{
+    ctx->current = *ctx->head;
+    ctx->next = NULL != ctx->current ? ctx->current->next : NULL;
+    ctx->ahead = ctx->current;
+
+    /* Run the prefetch cursor ahead of the current node */
+    for (size i = 0; i < ctx->prefetch_distance && NULL != ctx->ahead; ++i) {
+        ctx->ahead = ctx->ahead->next;
+        PREFETCH(ctx->ahead);
+    }
+    return ctx->current;
+}
+
+static inline slist_node* list_iterator_advance(list_iterator_ctx* ctx)
+{
+    if (0 != ctx->prefetch_distance && NULL != ctx->ahead) {
+        ctx->ahead = ctx->ahead->next;
+        PREFETCH(ctx->ahead);
+    }
+    ctx->current = ctx->next;
+    ctx->next = NULL != ctx->current ? ctx->current->next : NULL;
+    return ctx->current;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+list_status slist_init(slist* list)
+{
+    NOT_NULL(list, list_status_iptr);
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    return list_status_ok;
+}
+
+list_status slist_push_front(slist* list, slist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    node->next = list->head;
+    list->head = node;
+    if (NULL == list->tail) {
+        list->tail = node;
+    }
+    ++list->count;
+    return list_status_ok;
+}
+
+list_status slist_push_back(slist* list, slist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    node->next = NULL;
+    if (NULL == list->tail) {
+        list->head = node;
+    } else {
+        list->tail->next = node;
+    }
+    list->tail = node;
+    ++list->count;
+    return list_status_ok;
+}
+
+slist_node* slist_pop_front(slist* list)
+{
+    NOT_NULL(list, NULL);
+
+    slist_node* node = list->head;
+    if (NULL != node) {
+        list->head = node->next;
+        if (NULL == list->head) {
+            list->tail = NULL;
+        }
+        node->next = NULL;
+        --list->count;
+    }
+    return node;
+}
+
+list_status slist_remove(slist* list, slist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    slist_node* prev = NULL;
+    slist_node* it = list->head;
+    while (NULL != it && node != it) {
+        prev = it;
+        it = it->next;
+    }
+    if (NULL == it) {
+        return list_status_cerror;
+    }
+
+    if (NULL == prev) {
+        list->head = node->next;
+    } else {
+        prev->next = node->next;
+    }
+    if (list->tail == node) {
+        list->tail = prev;
+    }
+    node->next = NULL;
+    --list->count;
+    return list_status_ok;
+}
+
+list_status dlist_init(dlist* list)
+{
+    NOT_NULL(list, list_status_iptr);
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->count = 0;
+    return list_status_ok;
+}
+
+list_status dlist_push_front(dlist* list, dlist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    node->prev = NULL;
+    node->link.next = list->head;
+    if (NULL == list->head) {
+        list->tail = node;
+    } else {
+        dlist_from_link(list->head)->prev = node;
+    }
+    list->head = &node->link;
+    ++list->count;
+    return list_status_ok;
+}
+
+list_status dlist_push_back(dlist* list, dlist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    node->link.next = NULL;
+    node->prev = list->tail;
+    if (NULL == list->tail) {
+        list->head = &node->link;
+    } else {
+        list->tail->link.next = &node->link;
+    }
+    list->tail = node;
+    ++list->count;
+    return list_status_ok;
+}
+
+dlist_node* dlist_pop_front(dlist* list)
+{
+    NOT_NULL(list, NULL);
+
+    if (NULL == list->head) {
+        return NULL;
+    }
+    dlist_node* node = dlist_from_link(list->head);
+    dlist_remove(list, node);
+    return node;
+}
+
+list_status dlist_remove(dlist* list, dlist_node* node)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(node, list_status_iptr);
+
+    if (NULL == node->prev) {
+        list->head = node->link.next;
+    } else {
+        node->prev->link.next = node->link.next;
+    }
+    if (NULL == node->link.next) {
+        list->tail = node->prev;
+    } else {
+        dlist_from_link(node->link.next)->prev = node->prev;
+    }
+
+    node->link.next = NULL;
+    node->prev = NULL;
+    --list->count;
+    return list_status_ok;
+}
+
+list_status dlist_splice(dlist* list, dlist* other)
+{
+    NOT_NULL(list, list_status_iptr);
+    NOT_NULL(other, list_status_iptr);
+
+    if (NULL == other->head) {
+        return list_status_ok;
+    }
+
+    if (NULL == list->tail) {
+        list->head = other->head;
+    } else {
+        list->tail->link.next = other->head;
+        dlist_from_link(other->head)->prev = list->tail;
+    }
+    list->tail = other->tail;
+    list->count += other->count;
+    return dlist_init(other);
+}
+
+list_status list_iterator_init_ctx(iterator_instance* iterator, slist_node* const* head, size prefetch_distance)
+{
+    NOT_NULL(iterator, list_status_iptr);
+    NOT_NULL(head, list_status_iptr);
+
+    list_iterator_ctx* ctx = iterator->context;
+    ctx->head = head;
+    ctx->prefetch_distance = prefetch_distance;
+    ctx->current = NULL;
+    ctx->next = NULL;
+    ctx->ahead = NULL;
+    return list_status_ok;
+}
+
+const void* list_iterator_const_begin(void* context)
+{
+    return list_iterator_first(context);
+}
+
+const void* list_iterator_const_next(void* context)
+{
+    return list_iterator_advance(context);
+}
+
+const void* list_iterator_const_end(void* context)
+{
+    (void)context;
+    return NULL;
+}
+
+void* list_iterator_begin(void* context)
+{
+    return list_iterator_first(context);
+}
+
+void* list_iterator_next(void* context)
+{
+    return list_iterator_advance(context);
+}
+
+void* list_iterator_end(void* context)
+{
+    (void)context;
+    return NULL;
+}
+
+bool list_iterator_create_const(iterator_instance* iter, slist_node* const* head, size prefetch_distance)
+{
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, sizeof(list_iterator_ctx));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use list implementation */
+    is = iterator_init_as_const(iter, list_iterator_const_begin, list_iterator_const_next, list_iterator_const_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    list_status ls;
+    ls = list_iterator_init_ctx(iter, head, prefetch_distance);
+    if (list_status_ok != ls) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
+
+bool list_iterator_create(iterator_instance* iter, slist_node* const* head, size prefetch_distance)
+{
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, sizeof(list_iterator_ctx));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use list implementation */
+    is = iterator_init_as_non_const(iter, list_iterator_begin, list_iterator_next, list_iterator_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    list_status ls;
+    ls = list_iterator_init_ctx(iter, head, prefetch_distance);
+    if (list_status_ok != ls) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,235 @@
+#include "packed_iterator.h"
+#include "common.h"
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void packed_unpack_scalar(const u8* src, u16* dst, size fields, u8 width)
+{
+    const u64 mask = (1u << width) - 1;
+    u64 acc = 0;
+    u32 bits = 0;
+
+    for (size i = 0; i < fields; ++i) {
+        while (bits < width) {
+            acc = (acc << 8) | *src++;
+            bits += 8;
+        }
+        bits -= width;
+        dst[i] = (u16)((acc >> bits) & mask);
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+/*
+ * For an even width four fields always occupy exactly width / 2 bytes, so the layout of every group of four is the
+ * same. Each field is gathered into the upper three bytes of a 32-bit lane (big-endian), shifted left to drop the bits
+ * of the previous field and finally shifted right to drop the bits of the next one.
+ */
+static void packed_group_layout(u8 width, u8 shuffle[16], u32 shift[4])
+{
+    for (u32 lane = 0; lane < 4; ++lane) {
+        u32 bit = lane * width;
+        u8 byte = (u8)(bit / 8);
+        shuffle[lane * 4 + 0] = 0x80;
+        shuffle[lane * 4 + 1] = byte + 2;
+        shuffle[lane * 4 + 2] = byte + 1;
+        shuffle[lane * 4 + 3] = byte;
+        shift[lane] = bit % 8;
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+/* Unpack 16 fields per iteration. Return the number of fields processed */
+static size packed_unpack_simd(const u8* src, u16* dst, size fields, u8 width)
+{
+    u8 shuffle[16];
+    u32 shift[4];
+    packed_group_layout(width, shuffle, shift);
+
+    const __m256i shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)shuffle));
+    const __m256i sh = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)shift));
+    const size group_bytes = width / 2;
+    size done = 0;
+
+    /* Every load reads 16 bytes, so make sure the last one stays within the packed array */
+    while (fields - done >= 16 && packed_bytes(fields - done, width) >= 3 * group_bytes + 16) {
+        __m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+                                             _mm_loadu_si128((const __m128i*)(src + group_bytes)), 1);
+        __m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                                                 _mm_loadu_si128((const __m128i*)(src + 2 * group_bytes))),
+                                             _mm_loadu_si128((const __m128i*)(src + 3 * group_bytes)), 1);
+        lo = _mm256_srli_epi32(_mm256_sllv_epi32(_mm256_shuffle_epi8(lo, shuf), sh), 32 - width);
+        hi = _mm256_srli_epi32(_mm256_sllv_epi32(_mm256_shuffle_epi8(hi, shuf), sh), 32 - width);
+
+        /* Packing works within 128-bit lanes, restore the order of the groups afterwards */
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + done), out);
+
+        src += 2 * width;
+        done += 16;
+    }
+    return done;
+}
+#elif defined(__SSE4_1__)
+/* Unpack 8 fields per iteration. Return the number of fields processed */
+static size packed_unpack_simd(const u8* src, u16* dst, size fields, u8 width)
+{
+    u8 shuffle[16];
+    u32 shift[4];
+    packed_group_layout(width, shuffle, shift);
+
+    const __m128i shuf = _mm_loadu_si128((const __m128i*)shuffle);
+    const __m128i mul = _mm_set_epi32(1 << shift[3], 1 << shift[2], 1 << shift[1], 1 << shift[0]);
+    const size group_bytes = width / 2;
+    size done = 0;
+
+    /* Every load reads 16 bytes, so make sure the last one stays within the packed array */
+    while (fields - done >= 8 && packed_bytes(fields - done, width) >= group_bytes + 16) {
+        __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)src), shuf);
+        __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + group_bytes)), shuf);
+        lo = _mm_srli_epi32(_mm_mullo_epi32(lo, mul), 32 - width);
+        hi = _mm_srli_epi32(_mm_mullo_epi32(hi, mul), 32 - width);
+        _mm_storeu_si128((__m128i*)(dst + done), _mm_packus_epi32(lo, hi));
+
+        src += width;
+        done += 8;
+    }
+    return done;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void packed_unpack(const u8* src, u16* dst, size fields, u8 width)
+{
+#if defined(__AVX2__) || defined(__SSE4_1__)
+    if (0 == width % 2) {
+        size done = packed_unpack_simd(src, dst, fields, width);
+        /* The SIMD kernel always stops on a byte boundary */
+        src += done * width / 8;
+        dst += done;
+        fields -= done;
+    }
+#endif
+    packed_unpack_scalar(src, dst, fields, width);
+}
+
+void packed_pack(const u16* src, u8* dst, size fields, u8 width)
+{
+    const u64 mask = (1u << width) - 1;
+    u64 acc = 0;
+    u32 bits = 0;
+
+    for (size i = 0; i < fields; ++i) {
+        acc = (acc << width) | (src[i] & mask);
+        bits += width;
+        while (bits >= 8) {
+            bits -= 8;
+            *dst++ = (u8)(acc >> bits);
+        }
+    }
+
+    if (0 != bits) {
+        *dst = (u8)(acc << (8 - bits));
+    }
+}
+
+packed_iterator_status packed_iterator_init_ctx(iterator_instance* iterator, const void* data, size fields, u8 width)
+{
+    NOT_NULL(iterator, packed_iterator_status_iptr);
+    NOT_NULL(data, packed_iterator_status_iptr);
+
+    if (iterator_type_const != iterator->type || 0 == width || PACKED_ITERATOR_MAX_WIDTH < width) {
+        return packed_iterator_status_cerror;
+    }
+
+    packed_iterator_ctx* ctx = iterator->context;
+    ctx->data = data;
+    ctx->num_of_fields = fields;
+    ctx->width = width;
+    ctx->block_start = 0;
+    ctx->block_len = 0;
+    ctx->current_idx = 0;
+
+    return packed_iterator_status_ok;
+}
+
+const void* packed_iterator_begin(void* context)
+{
+    packed_iterator_ctx* ctx = context;
+    ctx->block_start = 0;
+    ctx->block_len = 0;
+    ctx->current_idx = 0;
+
+    if (UNLIKELY(0 == ctx->num_of_fields)) {
+        return packed_iterator_end(context);
+    }
+
+    ctx->block_len = ctx->num_of_fields < PACKED_ITERATOR_BLOCK ? ctx->num_of_fields : PACKED_ITERATOR_BLOCK;
+    packed_unpack(ctx->data, ctx->block, ctx->block_len, ctx->width);
+    return &ctx->block[0];
+}
+
+const void* packed_iterator_next(void* context)
+{
+    packed_iterator_ctx* ctx = context;
+    ++ctx->current_idx;
+
+    if (UNLIKELY(ctx->current_idx >= ctx->block_len)) {
+        ctx->block_start += ctx->block_len;
+        ctx->current_idx = 0;
+        if (ctx->block_start >= ctx->num_of_fields) {
+            ctx->block_len = 0;
+            return packed_iterator_end(context);
+        }
+
+        /* A full block always ends on a byte boundary, therefore the next one starts at a whole byte */
+        size remaining = ctx->num_of_fields - ctx->block_start;
+        ctx->block_len = remaining < PACKED_ITERATOR_BLOCK ? remaining : PACKED_ITERATOR_BLOCK;
+        packed_unpack(ctx->data + ctx->block_start * ctx->width / 8, ctx->block, ctx->block_len, ctx->width);
+    }
+
+    return &ctx->block[ctx->current_idx];
+}
+
+const void* packed_iterator_end(void* context)
+{
+    packed_iterator_ctx* ctx = context;
+    return &ctx->block[PACKED_ITERATOR_BLOCK];
+}
+
+bool packed_iterator_create(iterator_instance* iter, const void* data, size fields, u8 width)
+{
+    /* Create an abstract iterator */
+    iterator_status is;
+    is = iterator_construct(iter, sizeof(packed_iterator_ctx));
+    if (iterator_status_ok != is) {
+        return false;
+    }
+
+    /* Use packed implementation */
+    is = iterator_init_as_const(iter, packed_iterator_begin, packed_iterator_next, packed_iterator_end);
+    if (iterator_status_ok != is) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    /* Set implementation details */
+    packed_iterator_status pis;
+    pis = packed_iterator_init_ctx(iter, data, fields, width);
+    if (packed_iterator_status_ok != pis) {
+        iterator_destruct(iter);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include "rt_pacer.h"
+#include "common.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RT_PACER_HAS_TSC
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline u64 rt_pacer_wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000 + (u64)ts.tv_nsec;
+}
+
+/* Return TSC ticks per nanosecond in 32.32 fixed point or 0 when there is no TSC */
+static u64 rt_pacer_calibrate(void)
+{
+#ifdef RT_PACER_HAS_TSC
+    const u64 window_ns = 1000000;
+    u64 wall_start = rt_pacer_wall_ns();
+    u64 tsc_start = __rdtsc();
+    u64 wall_end;
+    do {
+        wall_end = rt_pacer_wall_ns();
+    } while (wall_end - wall_start < window_ns);
+    u64 tsc_end = __rdtsc();
+    return ((tsc_end - tsc_start) << 32) / (wall_end - wall_start);
+#else
+    return 0;
+#endif
+}
+
+/* Sleep on the timer until the absolute wall time */
+static void rt_pacer_sleep(const rt_pacer* pacer, u64 wall_ns)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)(wall_ns / 1000000000);
+    spec.it_value.tv_nsec = (long)(wall_ns % 1000000000);
+    if (0 != timerfd_settime(pacer->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL)) {
+        return;
+    }
+
+    u64 expirations;
+    while (read(pacer->timer_fd, &expirations, sizeof(expirations)) < 0 && EINTR == errno) {
+    }
+}
+
+/* Convert nanoseconds to TSC ticks, splitting the product so that waits of any length do not overflow */
+static inline u64 rt_pacer_ticks(u64 tsc_per_ns_q32, u64 ns)
+{
+    const u64 low = 0xFFFFFFFF;
+    u64 whole = tsc_per_ns_q32 >> 32;
+    u64 fraction = tsc_per_ns_q32 & low;
+    return ns * whole + (ns >> 32) * fraction + (((ns & low) * fraction) >> 32);
+}
+
+/* Check that a CPU exists and the calling thread is allowed to run on it */
+static bool rt_pacer_cpu_available(int cpu)
+{
+    if (cpu < 0 || CPU_SETSIZE <= cpu) {
+        return false;
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    return 0 == sched_getaffinity(0, sizeof(allowed), &allowed) && CPU_ISSET(cpu, &allowed);
+}
+
+/* Poll until the absolute wall time, which lies no further than the busy-poll window */
+static void rt_pacer_spin(const rt_pacer* pacer, u64 wall_ns)
+{
+#ifdef RT_PACER_HAS_TSC
+    if (LIKELY(0 != pacer->tsc_per_ns_q32)) {
+        u64 now = rt_pacer_wall_ns();
+        if (now >= wall_ns) {
+            return;
+        }
+        u64 deadline = __rdtsc() + rt_pacer_ticks(pacer->tsc_per_ns_q32, wall_ns - now);
+        while (__rdtsc() < deadline) {
+            _mm_pause();
+        }
+        return;
+    }
+#endif
+    (void)pacer;
+    while (rt_pacer_wall_ns() < wall_ns) {
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+rt_pacer_status rt_pacer_construct_ext(rt_pacer* pacer, u64 spin_ns, u64 tolerance_ns, int cpu)
+{
+    NOT_NULL(pacer, rt_pacer_status_iptr);
+
+    if (RT_PACER_NO_CPU != cpu && !rt_pacer_cpu_available(cpu)) {
+        return rt_pacer_status_cerror;
+    }
+
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (pacer->timer_fd < 0) {
+        return rt_pacer_status_cerror;
+    }
+    pacer->spin_ns = spin_ns;
+    pacer->tolerance_ns = tolerance_ns;
+    pacer->cpu = cpu;
+    pacer->tsc_per_ns_q32 = rt_pacer_calibrate();
+
+    return rt_pacer_status_ok;
+}
+
+rt_pacer_status rt_pacer_destruct(rt_pacer* pacer)
+{
+    NOT_NULL(pacer, rt_pacer_status_iptr);
+
+    if (LIKELY(0 <= pacer->timer_fd)) {
+        close(pacer->timer_fd);
+        pacer->timer_fd = -1;
+    }
+    return rt_pacer_status_ok;
+}
+
+rt_pacer_status rt_pacer_rebase(rt_pacer* pacer)
+{
+    NOT_NULL(pacer, rt_pacer_status_iptr);
+
+    pacer->anchored = false;
+    return rt_pacer_status_ok;
+}
+
+void rt_pacer_pace(void* ctx, u64 now_ns, u64 target_ns)
+{
+    rt_pacer* pacer = ctx;
+
+    if (UNLIKELY(!pacer->anchored)) {
+        if (RT_PACER_NO_CPU != pacer->cpu) {
+            pacer->pin_status = rt_pacer_pin(pacer->cpu);
+        }
+        pacer->wall_origin_ns = rt_pacer_wall_ns();
+        pacer->virt_origin_ns = now_ns;
+        pacer->anchored = true;
+    }
+
+    u64 deadline = pacer->wall_origin_ns + (target_ns - pacer->virt_origin_ns);
+    if (rt_pacer_wall_ns() + pacer->spin_ns < deadline) {
+        rt_pacer_sleep(pacer, deadline - pacer->spin_ns);
+    }
+    rt_pacer_spin(pacer, deadline);
+
+    u64 now = rt_pacer_wall_ns();
+    u64 late = now > deadline ? now - deadline : 0;
+    ++pacer->stats.waits;
+    pacer->stats.total_late_ns += late;
+    if (late > pacer->stats.worst_late_ns) {
+        pacer->stats.worst_late_ns = late;
+    }
+    if (late > pacer->tolerance_ns) {
+        ++pacer->stats.misses;
+    }
+}
+
+rt_pacer_status rt_pacer_pin(int cpu)
+{
+    if (cpu < 0 || CPU_SETSIZE <= cpu) {
+        return rt_pacer_status_cerror;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (0 != sched_setaffinity(0, sizeof(set), &set)) {
+        return rt_pacer_status_cerror;
+    }
+    return rt_pacer_status_ok;
+}
@@ -0,0 +1,241 @@
+#include "scheduler.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Wheel level of a deadline - the level of the most significant bit it differs from the current time in */
+static inline u32 scheduler_level(u64 now_ns, u64 key)
+{
+    u64 diff = key ^ now_ns;
+    return 0 == diff ? 0 : (u32)(63 - __builtin_clzll(diff)) / SCHEDULER_WHEEL_BITS;
+}
+
+static inline u32 scheduler_slot(u64 key, u32 level)
+{
+    return (u32)(key >> (level * SCHEDULER_WHEEL_BITS)) & (SCHEDULER_WHEEL_SLOTS - 1);
+}
+
+/* Deadline used for placement. Events already due go to the slot of the current time */
+static inline u64 scheduler_key(const scheduler* sched, const sched_event* event)
+{
+    return event->deadline_ns > sched->now_ns ? event->deadline_ns : sched->now_ns;
+}
+
+/* Time the slot starts at. It always lies ahead of the current time, except for the current slot of level 0 */
+static inline u64 scheduler_slot_start(const scheduler* sched, u32 level, u32 slot)
+{
+    u32 shift = level * SCHEDULER_WHEEL_BITS;
+    u32 span = shift + SCHEDULER_WHEEL_BITS;
+    u64 high = span < 64 ? sched->now_ns & ~((UINT64_C(1) << span) - 1) : 0;
+    return high | ((u64)slot << shift);
+}
+
+static void scheduler_insert(scheduler* sched, sched_event* event)
+{
+    u64 key = scheduler_key(sched, event);
+    u32 level = scheduler_level(sched->now_ns, key);
+    u32 slot = scheduler_slot(key, level);
+
+    event->slot = &sched->slots[level][slot];
+    dlist_push_back(event->slot, &event->node);
+    sched->occupied[level] |= UINT64_C(1) << slot;
+}
+
+static void scheduler_unlink(scheduler* sched, sched_event* event)
+{
+    dlist* list = event->slot;
+    dlist_remove(list, &event->node);
+    event->slot = NULL;
+
+    if (0 == list->count) {
+        size index = (size)(list - &sched->slots[0][0]);
+        sched->occupied[index / SCHEDULER_WHEEL_SLOTS] &= ~(UINT64_C(1) << (index % SCHEDULER_WHEEL_SLOTS));
+    }
+}
+
+static inline sched_event* scheduler_first(const dlist* list)
+{
+    return LIST_ENTRY((dlist_node*)list->head, sched_event, node);
+}
+
+/* Return the lowest level with a non-empty slot or SCHEDULER_WHEEL_LEVELS when the wheel is empty */
+static inline u32 scheduler_lowest_level(const scheduler* sched)
+{
+    u32 level = 0;
+    while (level < SCHEDULER_WHEEL_LEVELS && 0 == sched->occupied[level]) {
+        ++level;
+    }
+    return level;
+}
+
+/* Let the pacer hold the time back before it moves forward */
+static inline void scheduler_pace(const scheduler* sched, u64 target_ns)
+{
+    if (UNLIKELY(NULL != sched->pace) && target_ns > sched->now_ns) {
+        sched->pace(sched->pace_ctx, sched->now_ns, target_ns);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+scheduler_status scheduler_init(scheduler* sched, u64 now_ns)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+
+    memset(sched, 0, sizeof(*sched));
+    sched->now_ns = now_ns;
+    return scheduler_status_ok;
+}
+
+scheduler_status sched_event_init(sched_event* event, void (*fire)(scheduler* sched, sched_event* event), void* ctx)
+{
+    NOT_NULL(event, scheduler_status_iptr);
+    NOT_NULL(fire, scheduler_status_iptr);
+
+    memset(event, 0, sizeof(*event));
+    event->fire = fire;
+    event->ctx = ctx;
+    return scheduler_status_ok;
+}
+
+scheduler_status scheduler_schedule(scheduler* sched, sched_event* event, u64 deadline_ns)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+    NOT_NULL(event, scheduler_status_iptr);
+
+    if (sched_event_pending(event)) {
+        scheduler_unlink(sched, event);
+    } else {
+        ++sched->pending;
+    }
+    event->deadline_ns = deadline_ns;
+    scheduler_insert(sched, event);
+    return scheduler_status_ok;
+}
+
+scheduler_status scheduler_cancel(scheduler* sched, sched_event* event)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+    NOT_NULL(event, scheduler_status_iptr);
+
+    if (!sched_event_pending(event)) {
+        return scheduler_status_cerror;
+    }
+    scheduler_unlink(sched, event);
+    --sched->pending;
+    return scheduler_status_ok;
+}
+
+scheduler_status scheduler_advance(scheduler* sched, u64 until_ns)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+
+    if (UNLIKELY(until_ns < sched->now_ns || sched->firing)) {
+        return scheduler_status_cerror;
+    }
+
+    for (;;) {
+        u32 level = scheduler_lowest_level(sched);
+        if (SCHEDULER_WHEEL_LEVELS == level) {
+            break;
+        }
+        u32 slot = (u32)__builtin_ctzll(sched->occupied[level]);
+        u64 start = scheduler_slot_start(sched, level, slot);
+        if (start > until_ns) {
+            break;
+        }
+
+        /* Lower levels are empty, so nothing is skipped by moving the time to the start of the slot */
+        if (0 == level) {
+            scheduler_pace(sched, start);
+        }
+        if (start > sched->now_ns) {
+            sched->now_ns = start;
+        }
+        dlist* list = &sched->slots[level][slot];
+
+        if (0 == level) {
+            /* Every event of a level 0 slot is due right now. Events rescheduled into it join the batch */
+            while (0 != list->count) {
+                sched_event* event = scheduler_first(list);
+                scheduler_unlink(sched, event);
+                --sched->pending;
+                ++sched->fired;
+                sched->firing = true;
+                event->fire(sched, event);
+                sched->firing = false;
+            }
+        } else {
+            /* The time entered the slot - spread its events over lower levels */
+            while (0 != list->count) {
+                sched_event* event = scheduler_first(list);
+                scheduler_unlink(sched, event);
+                scheduler_insert(sched, event);
+            }
+        }
+    }
+
+    scheduler_pace(sched, until_ns);
+    sched->now_ns = until_ns;
+    return scheduler_status_ok;
+}
+
+scheduler_status scheduler_fast_forward(scheduler* sched, u64 limit_ns)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+
+    if (UNLIKELY(limit_ns < sched->now_ns || sched->firing)) {
+        return scheduler_status_cerror;
+    }
+
+    u64 next;
+    if (scheduler_status_empty == scheduler_next(sched, &next)) {
+        return scheduler_status_empty;
+    }
+    u64 target = next < limit_ns ? next : limit_ns;
+    sched->skipped_ns += target - sched->now_ns;
+    return scheduler_advance(sched, target);
+}
+
+scheduler_status scheduler_set_pacer(scheduler* sched, scheduler_pacer pace, void* ctx)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+
+    sched->pace = pace;
+    sched->pace_ctx = ctx;
+    return scheduler_status_ok;
+}
+
+scheduler_status scheduler_next(const scheduler* sched, u64* deadline_ns)
+{
+    NOT_NULL(sched, scheduler_status_iptr);
+    NOT_NULL(deadline_ns, scheduler_status_iptr);
+
+    u32 level = scheduler_lowest_level(sched);
+    if (SCHEDULER_WHEEL_LEVELS == level) {
+        return scheduler_status_empty;
+    }
+    u32 slot = (u32)__builtin_ctzll(sched->occupied[level]);
+    const dlist* list = &sched->slots[level][slot];
+
+    if (0 == level) {
+        u64 start = scheduler_slot_start(sched, level, slot);
+        *deadline_ns = start > sched->now_ns ? start : sched->now_ns;
+        return scheduler_status_ok;
+    }
+
+    /* Higher level slots are not sorted, but the earliest of them holds the earliest event */
+    u64 earliest = UINT64_MAX;
+    for (const slist_node* node = list->head; NULL != node; node = node->next) {
+        const sched_event* event = LIST_ENTRY((const dlist_node*)node, sched_event, node);
+        u64 key = scheduler_key(sched, event);
+        earliest = key < earliest ? key : earliest;
+    }
+    *deadline_ns = earliest;
+    return scheduler_status_ok;
+}
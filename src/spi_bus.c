@@ -0,0 +1,922 @@
+#include "spi_bus.h"
+#include "array_iterator.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------- Data types ------------------------------ */
+/* ------------------------------------------------------------------------- */
+
+/* Clock of a single transfer in the cycle-accurate mode */
+typedef struct spi_cycle_clock_
+{
+    u64 start_ns; /* Time of the first edge */
+    u64 speed; /* Clock frequency */
+    u32 edges_per_word; /* Two edges per clock cycle */
+    u32 gap_ns; /* Idle time between words */
+} spi_cycle_clock;
+
+/* Position within a TX or RX iterator */
+typedef struct spi_stream_
+{
+    const iterator_instance* iter; /* NULL when there is no buffer at all */
+    const u8* array; /* Contiguous bytes or NULL when the iterator has to be traversed */
+    const void* current; /* Current element of a generic iterator */
+    const void* end; /* Past-the-end element of a generic iterator */
+} spi_stream;
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline u8* spi_bus_scratch_tx(const spi_bus* bus)
+{
+    return bus->scratch;
+}
+
+static inline u8* spi_bus_scratch_rx(const spi_bus* bus)
+{
+    return bus->scratch + bus->scratch_size;
+}
+
+/* Check whether an iterator can serve as a TX/RX buffer of 'len' bytes */
+static spi_bus_status spi_stream_check(const iterator_instance* iter, iterator_type type, size len)
+{
+    if (NULL == iter) {
+        return spi_bus_status_ok;
+    }
+    if (type != iter->type) {
+        return spi_bus_status_cerror;
+    }
+    if (array_iterator_is_array(iter)) {
+        const array_iterator_ctx* ctx = iter->context;
+        if (ctx->num_of_elements * ctx->element_size < len) {
+            return spi_bus_status_cerror;
+        }
+    }
+    return spi_bus_status_ok;
+}
+
+/* Start traversing an iterator already checked by spi_stream_check() */
+static void spi_stream_open(spi_stream* stream, const iterator_instance* iter)
+{
+    stream->iter = iter;
+    stream->array = NULL;
+    stream->current = NULL;
+    stream->end = NULL;
+    if (NULL == iter) {
+        return;
+    }
+
+    /* Byte arrays are handed to the device directly */
+    if (array_iterator_is_array(iter)) {
+        const array_iterator_ctx* ctx = iter->context;
+        stream->array = ctx->array_addr.addr_const;
+    } else if (iterator_type_const == iter->type) {
+        stream->current = ITERATOR_CBEGIN(*iter);
+        stream->end = ITERATOR_CEND(*iter);
+    } else {
+        stream->current = iter->begin.begin_non_const(iter->context);
+        stream->end = iter->end.end_non_const(iter->context);
+    }
+}
+
+/* Return MOSI bytes for the chunk starting at 'offset' */
+static const u8* spi_stream_read(spi_stream* stream, u8* staging, size offset, size len)
+{
+    if (NULL != stream->array) {
+        return stream->array + offset;
+    }
+
+    size i = 0;
+    if (NULL != stream->iter) {
+        for (; i < len && stream->current != stream->end; ++i) {
+            staging[i] = *(const u8*)stream->current;
+            stream->current = ITERATOR_CNEXT(*stream->iter);
+        }
+    }
+    /* Missing TX data is sent as zeros */
+    memset(staging + i, 0, len - i);
+    return staging;
+}
+
+/* Move staged MISO bytes to a generic RX iterator */
+static void spi_stream_write(spi_stream* stream, const u8* staging, size len)
+{
+    if (NULL != stream->array || NULL == stream->iter) {
+        return;
+    }
+
+    for (size i = 0; i < len && stream->current != stream->end; ++i) {
+        *(u8*)stream->current = staging[i];
+        stream->current = stream->iter->next.next_non_const(stream->iter->context);
+    }
+}
+
+static inline u8 spi_transfer_tx_nbits(const spi_transfer* xfer)
+{
+    return 0 != xfer->tx_nbits ? xfer->tx_nbits : SPI_LANES_SINGLE;
+}
+
+static inline u8 spi_transfer_rx_nbits(const spi_transfer* xfer)
+{
+    return 0 != xfer->rx_nbits ? xfer->rx_nbits : SPI_LANES_SINGLE;
+}
+
+static inline u8 spi_transfer_bpw(const spi_transfer* xfer)
+{
+    return 0 != xfer->bits_per_word ? xfer->bits_per_word : 8;
+}
+
+/* Clock frequency of a transfer, which the bus default stands for when the transfer does not set one */
+static inline u64 spi_transfer_speed(const spi_bus* bus, const spi_transfer* xfer)
+{
+    return 0 != xfer->speed_hz ? xfer->speed_hz : bus->speed_hz;
+}
+
+/* Check a transfer without touching its buffers */
+static spi_bus_status spi_transfer_validate(const spi_bus* bus, const spi_transfer* xfer)
+{
+    /* The bus default may have been set to zero since the bus was constructed */
+    if (UNLIKELY(0 == spi_transfer_speed(bus, xfer))) {
+        return spi_bus_status_cerror;
+    }
+
+    u8 bits_per_word = spi_transfer_bpw(xfer);
+    if (!spi_mode_bpw_valid(bits_per_word) || 0 != xfer->len % spi_mode_word_bytes(bits_per_word)) {
+        return spi_bus_status_cerror;
+    }
+
+    u8 tx_nbits = spi_transfer_tx_nbits(xfer);
+    u8 rx_nbits = spi_transfer_rx_nbits(xfer);
+    if (!spi_lanes_valid(tx_nbits) || !spi_lanes_valid(rx_nbits)) {
+        return spi_bus_status_cerror;
+    }
+    /* Multi-line transfers are half-duplex */
+    if ((SPI_LANES_SINGLE != tx_nbits || SPI_LANES_SINGLE != rx_nbits) && NULL != xfer->tx && NULL != xfer->rx) {
+        return spi_bus_status_cerror;
+    }
+
+    spi_bus_status status = spi_stream_check(xfer->tx, iterator_type_const, xfer->len);
+    if (spi_bus_status_ok == status) {
+        status = spi_stream_check(xfer->rx, iterator_type_non_const, xfer->len);
+    }
+    return status;
+}
+
+/* Return time needed to clock the transfer out followed by its delay */
+static u64 spi_transfer_duration(const spi_bus* bus, const spi_transfer* xfer)
+{
+    const u64 ns_per_s = 1000000000;
+    u64 speed = spi_transfer_speed(bus, xfer);
+
+    /* A receiving transfer is clocked at the RX width, everything else at the TX width */
+    u8 nbits = NULL != xfer->rx ? spi_transfer_rx_nbits(xfer) : spi_transfer_tx_nbits(xfer);
+    u8 bits_per_word = spi_transfer_bpw(xfer);
+    u64 bits = (u64)(xfer->len / spi_mode_word_bytes(bits_per_word)) * bits_per_word;
+    u64 clocks = (bits + nbits - 1) / nbits;
+
+    /* Split the division so large transfers do not overflow */
+    u64 ns = (clocks / speed) * ns_per_s + (clocks % speed) * ns_per_s / speed;
+    return ns + (u64)xfer->delay_usecs * 1000;
+}
+
+static inline void spi_bus_select(spi_bus* bus, const device_entry* slave, u32 cs)
+{
+    slave->select(slave->device);
+    bus->active_cs = cs;
+}
+
+static void spi_bus_deselect(spi_bus* bus)
+{
+    const device_entry* slave = device_registry_lookup(&bus->devices, bus->active_cs);
+    if (NULL != slave) {
+        slave->deselect(slave->device);
+    }
+    bus->active_cs = SPI_BUS_NO_CS;
+}
+
+/*
+ * Keep the scheduler at the time of the bus, firing events due in between. A bus behind the scheduler catches up, a
+ * scheduler held by the horizon stays behind.
+ */
+static inline void spi_bus_sync(spi_bus* bus)
+{
+    scheduler* sched = bus->sched;
+    if (NULL == sched) {
+        return;
+    }
+    if (sched->now_ns > bus->time_ns) {
+        bus->time_ns = sched->now_ns;
+    } else if (sched->now_ns < bus->horizon_ns) {
+        scheduler_advance(sched, bus->time_ns < bus->horizon_ns ? bus->time_ns : bus->horizon_ns);
+    }
+}
+
+/* Return MOSI iterator for the chunk starting at 'offset' */
+static const iterator_instance* spi_bus_mosi_chunk(spi_bus* bus, spi_stream* txs, size offset, size len)
+{
+    if (NULL == txs->iter) {
+        return NULL;
+    }
+
+    const u8* data = spi_stream_read(txs, spi_bus_scratch_tx(bus), offset, len);
+    array_iterator_init_const_ctx(&bus->mosi_view, data, len, sizeof(u8));
+    return &bus->mosi_view;
+}
+
+/* Move all bytes of a transfer whose ends agree on the mode */
+static void spi_bus_exchange_direct(spi_bus* bus, const device_entry* slave, const spi_transfer* xfer)
+{
+    size len = xfer->len;
+
+    if (NULL != xfer->rx && array_iterator_is_array(xfer->rx)) {
+        /* MISO goes straight to its destination, so the device may consume TX in any way it likes */
+        const array_iterator_ctx* ctx = xfer->rx->context;
+        slave->exchange(slave->device, xfer->tx, ctx->array_addr.addr_non_const, len);
+        return;
+    }
+
+    spi_stream txs;
+    spi_stream rxs;
+    spi_stream_open(&txs, xfer->tx);
+    spi_stream_open(&rxs, xfer->rx);
+
+    for (size offset = 0; offset < len; offset += bus->scratch_size) {
+        size n = len - offset < bus->scratch_size ? len - offset : bus->scratch_size;
+        const iterator_instance* mosi = spi_bus_mosi_chunk(bus, &txs, offset, n);
+        u8* miso = spi_bus_scratch_rx(bus);
+        slave->exchange(slave->device, mosi, miso, n);
+        spi_stream_write(&rxs, miso, n);
+    }
+}
+
+/* Time of a clock edge counted from the first edge of a transfer */
+static inline u64 spi_cycle_edge_ns(const spi_cycle_clock* clock, u64 edge)
+{
+    const u64 ns_per_s = 1000000000;
+    u64 edges_per_s = 2 * clock->speed;
+    return (edge / edges_per_s) * ns_per_s + (edge % edges_per_s) * ns_per_s / edges_per_s;
+}
+
+/* Report edges of a single word to the device and return the time the word ends */
+static u64 spi_cycle_word(const spi_cycle_clock* clock, const device_entry* slave, size word)
+{
+    u64 first = (u64)word * clock->edges_per_word;
+    u64 gaps = (u64)word * clock->gap_ns;
+
+    spi_cycle cycle;
+    cycle.first_edge_ns = clock->start_ns + gaps + spi_cycle_edge_ns(clock, first);
+    cycle.last_edge_ns = clock->start_ns + gaps + spi_cycle_edge_ns(clock, first + clock->edges_per_word - 1);
+    cycle.edges = clock->edges_per_word;
+    slave->timing(slave->device, &cycle);
+
+    return clock->start_ns + gaps + spi_cycle_edge_ns(clock, first + clock->edges_per_word);
+}
+
+/*
+ * Move all bytes of a transfer through the scratch memory, transforming whole chunks on the way. With a cycle clock
+ * every word is a chunk of its own, timed edge by edge. Callers pass the clock as a constant, so the fast mode never
+ * carries the cycle-accurate code.
+ */
+static inline void spi_bus_exchange_staged(spi_bus* bus, const device_entry* slave, const spi_transfer* xfer,
+                                           const spi_cycle_clock* clock)
+{
+    u8 bits_per_word = spi_transfer_bpw(xfer);
+    size word_bytes = spi_mode_word_bytes(bits_per_word);
+    size chunk = NULL != clock ? word_bytes : bus->scratch_size - bus->scratch_size % word_bytes;
+    size len = xfer->len;
+
+    spi_stream txs;
+    spi_stream rxs;
+    spi_stream_open(&txs, xfer->tx);
+    spi_stream_open(&rxs, xfer->rx);
+    u32 mosi_carry = 0;
+    u32 miso_carry = 0;
+
+    for (size offset = 0; offset < len; offset += chunk) {
+        size n = len - offset < chunk ? len - offset : chunk;
+
+        /* Zeros stay zeros whatever the transform, so a missing TX buffer needs no work */
+        const iterator_instance* mosi = NULL;
+        if (NULL != txs.iter) {
+            u8* staging = spi_bus_scratch_tx(bus);
+            const u8* data = spi_stream_read(&txs, staging, offset, n);
+            if (data != staging) {
+                memcpy(staging, data, n);
+            }
+            mosi_carry = spi_mode_apply(&slave->mosi, staging, n / word_bytes, bits_per_word, mosi_carry);
+            array_iterator_init_const_ctx(&bus->mosi_view, staging, n, sizeof(u8));
+            mosi = &bus->mosi_view;
+        }
+
+        if (NULL != clock) {
+            bus->time_ns = spi_cycle_word(clock, slave, offset / word_bytes);
+            spi_bus_sync(bus);
+        }
+
+        u8* miso = spi_bus_scratch_rx(bus);
+        slave->exchange(slave->device, mosi, miso, n);
+        miso_carry = spi_mode_apply(&slave->miso, miso, n / word_bytes, bits_per_word, miso_carry);
+        if (NULL != rxs.array) {
+            memcpy((u8*)rxs.array + offset, miso, n);
+        } else {
+            spi_stream_write(&rxs, miso, n);
+        }
+    }
+}
+
+/*
+ * Serve a built-in device without calling it. Return false when the buffers need the generic path - a generic
+ * iterator on either side of a loopback or a generic RX iterator of a null device.
+ */
+static bool spi_bus_exchange_builtin(const device_entry* slave, const spi_transfer* xfer)
+{
+    if (NULL == xfer->rx) {
+        return true;
+    }
+    if (!array_iterator_is_array(xfer->rx)) {
+        return false;
+    }
+
+    u8* miso = ((const array_iterator_ctx*)xfer->rx->context)->array_addr.addr_non_const;
+    if (device_kind_null == slave->kind) {
+        memset(miso, DEVICE_NULL_MISO, xfer->len);
+        return true;
+    }
+    if (NULL == xfer->tx) {
+        memset(miso, 0, xfer->len);
+        return true;
+    }
+    const u8* mosi = device_mosi_array(xfer->tx);
+    if (NULL == mosi) {
+        return false;
+    }
+    memcpy(miso, mosi, xfer->len);
+    return true;
+}
+
+/* Move all bytes of a validated transfer between its buffers and the device */
+static void spi_bus_exchange(spi_bus* bus, const device_entry* slave, const spi_transfer* xfer)
+{
+    if (LIKELY(spi_mode_transform_identity(&slave->mosi) && spi_mode_transform_identity(&slave->miso))) {
+        if (device_kind_model == slave->kind || !spi_bus_exchange_builtin(slave, xfer)) {
+            spi_bus_exchange_direct(bus, slave, xfer);
+        }
+    } else {
+        spi_bus_exchange_staged(bus, slave, xfer, NULL);
+    }
+
+    ++bus->stats.transfers;
+    bus->stats.bytes += xfer->len;
+}
+
+/* Check whether a transfer may share a device call with the one before it */
+static inline bool spi_transfer_compatible(const spi_bus* bus, const spi_transfer* prev, const spi_transfer* next)
+{
+    return !prev->cs_change && 0 == prev->delay_usecs
+           && spi_transfer_speed(bus, prev) == spi_transfer_speed(bus, next)
+           && spi_transfer_bpw(prev) == spi_transfer_bpw(next)
+           && spi_transfer_tx_nbits(prev) == spi_transfer_tx_nbits(next)
+           && spi_transfer_rx_nbits(prev) == spi_transfer_rx_nbits(next);
+}
+
+/*
+ * Return the number of transfers, at least one, exchanged with a single device call. A run stops before a transfer
+ * which would start at or after the next scheduled event, since the event has to fire before it.
+ */
+static size spi_bus_coalescible(const spi_bus* bus, const device_entry* slave, const spi_transfer* transfers,
+                                size count)
+{
+    if (!bus->coalesce || 1 == count || bus->scratch_size < transfers[0].len || device_kind_model != slave->kind
+        || !spi_mode_transform_identity(&slave->mosi) || !spi_mode_transform_identity(&slave->miso)) {
+        return 1;
+    }
+
+    u64 deadline = UINT64_MAX;
+    if (NULL != bus->sched) {
+        scheduler_next(bus->sched, &deadline);
+    }
+
+    size total = transfers[0].len;
+    u64 start = bus->time_ns;
+    size n = 1;
+    for (; n < count; ++n) {
+        const spi_transfer* prev = &transfers[n - 1];
+        const spi_transfer* next = &transfers[n];
+        start += spi_transfer_duration(bus, prev);
+        if (!spi_transfer_compatible(bus, prev, next) || total + next->len > bus->scratch_size || start >= deadline) {
+            break;
+        }
+        total += next->len;
+    }
+    return n;
+}
+
+/* Move MISO bytes of transfers answered by a single exchange to their RX buffers and account the transfers */
+static void spi_bus_scatter(spi_bus* bus, const spi_transfer* transfers, size count, const u8* miso)
+{
+    for (size i = 0, offset = 0; i < count; offset += transfers[i].len, ++i) {
+        const spi_transfer* xfer = &transfers[i];
+        spi_stream rxs;
+        spi_stream_open(&rxs, xfer->rx);
+        if (NULL != rxs.array) {
+            memcpy((u8*)rxs.array, miso + offset, xfer->len);
+        } else {
+            spi_stream_write(&rxs, miso + offset, xfer->len);
+        }
+        ++bus->stats.transfers;
+        bus->stats.bytes += xfer->len;
+        bus->time_ns += spi_transfer_duration(bus, xfer);
+    }
+}
+
+/* Gather MOSI bytes of a run into the scratch memory, exchange them at once and scatter MISO bytes back */
+static void spi_bus_exchange_coalesced(spi_bus* bus, const device_entry* slave, const spi_transfer* transfers,
+                                       size count)
+{
+    u8* staging = spi_bus_scratch_tx(bus);
+    size total = 0;
+    for (size i = 0; i < count; ++i) {
+        spi_stream txs;
+        spi_stream_open(&txs, transfers[i].tx);
+        const u8* data = spi_stream_read(&txs, staging + total, 0, transfers[i].len);
+        if (data != staging + total) {
+            memcpy(staging + total, data, transfers[i].len);
+        }
+        total += transfers[i].len;
+    }
+
+    u8* miso = spi_bus_scratch_rx(bus);
+    array_iterator_init_const_ctx(&bus->mosi_view, staging, total, sizeof(u8));
+    slave->exchange(slave->device, &bus->mosi_view, miso, total);
+
+    spi_bus_scatter(bus, transfers, count, miso);
+    bus->stats.coalesced += count - 1;
+}
+
+/* Transaction-level execution: whole transfers at once, time advanced by their total duration */
+static void spi_bus_execute_fast(spi_bus* bus, const device_entry* slave, u32 cs, const spi_transfer* transfers,
+                                 size count)
+{
+    /* A chip-select left asserted by the previous message is released when another device is addressed */
+    if (SPI_BUS_NO_CS != bus->active_cs && cs != bus->active_cs) {
+        spi_bus_deselect(bus);
+    }
+
+    for (size i = 0; i < count;) {
+        spi_bus_sync(bus);
+        if (SPI_BUS_NO_CS == bus->active_cs) {
+            spi_bus_select(bus, slave, cs);
+        }
+
+        size run = spi_bus_coalescible(bus, slave, &transfers[i], count - i);
+        if (LIKELY(1 == run)) {
+            spi_bus_exchange(bus, slave, &transfers[i]);
+            bus->time_ns += spi_transfer_duration(bus, &transfers[i]);
+        } else {
+            spi_bus_exchange_coalesced(bus, slave, &transfers[i], run);
+        }
+        i += run;
+
+        /* On the last transfer cs_change means the opposite - keep the device selected */
+        bool last = (i == count);
+        if (transfers[i - 1].cs_change != last) {
+            spi_bus_deselect(bus);
+        }
+    }
+}
+
+static void spi_bus_release_timed(spi_bus* bus)
+{
+    bus->time_ns += bus->timing.cs_hold_ns;
+    spi_bus_deselect(bus);
+    bus->cs_idle_until_ns = bus->time_ns + bus->timing.cs_inactive_ns;
+}
+
+static void spi_bus_select_timed(spi_bus* bus, const device_entry* slave, u32 cs)
+{
+    if (bus->time_ns < bus->cs_idle_until_ns) {
+        bus->time_ns = bus->cs_idle_until_ns;
+    }
+    spi_bus_select(bus, slave, cs);
+    bus->time_ns += bus->timing.cs_setup_ns;
+}
+
+/* Cycle-accurate execution: words exchanged one at a time with edges, gaps and chip-select timing modelled */
+static void spi_bus_execute_cycle(spi_bus* bus, const device_entry* slave, u32 cs, const spi_transfer* transfers,
+                                  size count)
+{
+    if (SPI_BUS_NO_CS != bus->active_cs && cs != bus->active_cs) {
+        spi_bus_release_timed(bus);
+    }
+
+    for (size i = 0; i < count; ++i) {
+        const spi_transfer* xfer = &transfers[i];
+        spi_bus_sync(bus);
+        if (SPI_BUS_NO_CS == bus->active_cs) {
+            spi_bus_select_timed(bus, slave, cs);
+        }
+
+        u8 bits_per_word = spi_transfer_bpw(xfer);
+        u8 nbits = NULL != xfer->rx ? spi_transfer_rx_nbits(xfer) : spi_transfer_tx_nbits(xfer);
+        spi_cycle_clock clock;
+        clock.start_ns = bus->time_ns;
+        clock.speed = spi_transfer_speed(bus, xfer);
+        clock.edges_per_word = 2 * ((bits_per_word + nbits - 1) / nbits);
+        clock.gap_ns = bus->timing.word_gap_ns;
+
+        spi_bus_exchange_staged(bus, slave, xfer, &clock);
+        ++bus->stats.transfers;
+        bus->stats.bytes += xfer->len;
+        bus->time_ns += (u64)xfer->delay_usecs * 1000;
+
+        bool last = (i + 1 == count);
+        if (xfer->cs_change != last) {
+            spi_bus_release_timed(bus);
+        }
+    }
+}
+
+static inline u32 spi_bus_cache_slot(u32 cs, const u8* mosi, size len)
+{
+    /* FNV-1a */
+    u32 hash = (2166136261u ^ cs) * 16777619u;
+    for (size i = 0; i < len; ++i) {
+        hash = (hash ^ mosi[i]) * 16777619u;
+    }
+    return hash & (SPI_BUS_CACHE_ENTRIES - 1);
+}
+
+static void spi_bus_cache_drop(spi_bus* bus, u32 cs)
+{
+    for (size i = 0; i < SPI_BUS_CACHE_ENTRIES; ++i) {
+        if (cs == bus->cache[i].cs) {
+            bus->cache[i].len = 0;
+        }
+    }
+}
+
+/*
+ * Gather MOSI bytes of a message forming a whole short transaction. Return their number or zero for other messages.
+ * Only byte arrays are read, as they can be read once more when the message turns out not to be cacheable.
+ */
+static size spi_bus_cache_gather(const spi_bus* bus, const spi_transfer* transfers, size count, u8* mosi)
+{
+    if (SPI_BUS_NO_CS != bus->active_cs) {
+        return 0;
+    }
+
+    size total = 0;
+    for (size i = 0; i < count; ++i) {
+        const iterator_instance* tx = transfers[i].tx;
+        if (transfers[i].cs_change || SPI_BUS_CACHE_BYTES - total < transfers[i].len
+            || (NULL != tx && !array_iterator_is_array(tx))) {
+            return 0;
+        }
+        total += transfers[i].len;
+    }
+
+    u8* dst = mosi;
+    for (size i = 0; i < count; ++i) {
+        spi_stream txs;
+        spi_stream_open(&txs, transfers[i].tx);
+        const u8* data = spi_stream_read(&txs, dst, 0, transfers[i].len);
+        if (data != dst) {
+            memcpy(dst, data, transfers[i].len);
+        }
+        dst += transfers[i].len;
+    }
+    return total;
+}
+
+/* Check that no scheduled event falls due between the transfers of a message starting now */
+static bool spi_bus_quiet(const spi_bus* bus, const spi_transfer* transfers, size count)
+{
+    u64 deadline;
+    if (NULL == bus->sched || scheduler_status_ok != scheduler_next(bus->sched, &deadline)) {
+        return true;
+    }
+
+    u64 start = bus->time_ns;
+    for (size i = 0; i + 1 < count; ++i) {
+        start += spi_transfer_duration(bus, &transfers[i]);
+        if (start >= deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Follow polls answered from the cache. Once the same poll repeats at a steady period, its response cannot change
+ * before the next scheduled event, so the bus moves to the last poll starting before the event and skips the others.
+ */
+static void spi_bus_fast_forward(spi_bus* bus, const spi_bus_cache_entry* entry, const spi_transfer* transfers,
+                                 size count)
+{
+    spi_bus_poll* poll = &bus->poll;
+    u64 start = bus->time_ns;
+    if (entry != poll->entry || start <= poll->start_ns) {
+        poll->entry = entry;
+        poll->start_ns = start;
+        poll->period_ns = 0;
+        poll->repeats = 1;
+        return;
+    }
+
+    u64 period = start - poll->start_ns;
+    poll->start_ns = start;
+    if (period != poll->period_ns) {
+        poll->period_ns = period;
+        poll->repeats = 2;
+        return;
+    }
+    if (++poll->repeats < SPI_BUS_POLL_REPEATS) {
+        return;
+    }
+
+    u64 deadline;
+    if (NULL == bus->sched || scheduler_status_ok != scheduler_next(bus->sched, &deadline)) {
+        return;
+    }
+
+    /* Every transfer of a skipped poll has to start before the event */
+    u64 span = 0;
+    u64 len = 0;
+    for (size i = 0; i < count; ++i) {
+        if (i + 1 < count) {
+            span += spi_transfer_duration(bus, &transfers[i]);
+        }
+        len += transfers[i].len;
+    }
+    if (deadline <= start + span + period) {
+        return;
+    }
+
+    u64 skipped = (deadline - 1 - start - span) / period;
+    bus->time_ns = start + skipped * period;
+    poll->start_ns = bus->time_ns;
+    bus->stats.skipped += skipped;
+    bus->stats.cached += skipped;
+    bus->stats.messages += skipped;
+    bus->stats.transfers += skipped * count;
+    bus->stats.bytes += skipped * len;
+}
+
+/*
+ * Answer a side-effect-free transaction from the response cache, asking the device only on a miss. Return false when
+ * the message is not cacheable and has to be executed normally.
+ */
+static bool spi_bus_cached(spi_bus* bus, const device_entry* slave, u32 cs, const spi_transfer* transfers,
+                           size count)
+{
+    if (spi_bus_execute_fast != bus->execute || !spi_mode_transform_identity(&slave->mosi)
+        || !spi_mode_transform_identity(&slave->miso)) {
+        return false;
+    }
+
+    /* Events due before the message may change the state, so they fire first */
+    spi_bus_sync(bus);
+    u8 mosi[SPI_BUS_CACHE_BYTES];
+    if (!spi_bus_quiet(bus, transfers, count)) {
+        return false;
+    }
+    size len = spi_bus_cache_gather(bus, transfers, count, mosi);
+    if (0 == len || !slave->pure(slave->device, mosi, len)) {
+        return false;
+    }
+
+    u64 version = *slave->version;
+    spi_bus_cache_entry* entry = &bus->cache[spi_bus_cache_slot(cs, mosi, len)];
+    if (entry->len == len && entry->cs == cs && entry->version == version && 0 == memcmp(entry->mosi, mosi, len)) {
+        ++bus->stats.cached;
+        if (bus->fast_forward) {
+            spi_bus_fast_forward(bus, entry, transfers, count);
+        }
+    } else {
+        bus->poll.entry = NULL;
+
+        /* The device answers the whole transaction in one go and the response is kept */
+        spi_bus_select(bus, slave, cs);
+        array_iterator_init_const_ctx(&bus->mosi_view, mosi, len, sizeof(u8));
+        slave->exchange(slave->device, &bus->mosi_view, entry->miso, len);
+        spi_bus_deselect(bus);
+
+        /* A device changing its version on a pure command gets its response cached never */
+        entry->len = version == *slave->version ? (u32)len : 0;
+        entry->cs = cs;
+        entry->version = version;
+        memcpy(entry->mosi, mosi, len);
+    }
+
+    spi_bus_scatter(bus, transfers, count, entry->miso);
+    return true;
+}
+
+static spi_bus_status spi_bus_construct_common(spi_bus* bus, size scratch_size, mem_allocator allocator)
+{
+    if (SPI_BUS_MIN_SCRATCH > scratch_size) {
+        return spi_bus_status_cerror;
+    }
+
+    memset(bus, 0, sizeof(*bus));
+    bus->scratch = allocator(2 * scratch_size);
+    NOT_NULL(bus->scratch, spi_bus_status_merror);
+    bus->scratch_size = scratch_size;
+    bus->speed_hz = SPI_BUS_DEFAULT_SPEED_HZ;
+    bus->active_cs = SPI_BUS_NO_CS;
+    bus->horizon_ns = SPI_BUS_NO_HORIZON;
+    device_registry_init(&bus->devices);
+    bus->mosi_view.context = &bus->mosi_view_ctx;
+    iterator_init_as_const(&bus->mosi_view, array_iterator_const_begin, array_iterator_const_next,
+                           array_iterator_const_end);
+    bus->execute = spi_bus_execute_fast;
+
+    return spi_bus_status_ok;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+spi_bus_status spi_bus_construct_ext(spi_bus* bus, size scratch_size, mem_allocator allocator)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(allocator, spi_bus_status_iptr);
+
+    return spi_bus_construct_common(bus, scratch_size, allocator);
+}
+
+spi_bus_status spi_bus_construct_cycle_ext(spi_bus* bus, size scratch_size, const spi_bus_timing* timing,
+                                           mem_allocator allocator)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(timing, spi_bus_status_iptr);
+    NOT_NULL(allocator, spi_bus_status_iptr);
+
+    spi_bus_status status = spi_bus_construct_common(bus, scratch_size, allocator);
+    if (spi_bus_status_ok == status) {
+        bus->timing = *timing;
+        bus->execute = spi_bus_execute_cycle;
+    }
+    return status;
+}
+
+spi_bus_status spi_bus_destruct_ext(spi_bus* bus, mem_deallocator deallocator)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(deallocator, spi_bus_status_iptr);
+
+    if (LIKELY(NULL != bus->scratch)) {
+        deallocator(bus->scratch);
+        bus->scratch = NULL;
+    }
+
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_attach(spi_bus* bus, u32 cs, const spi_device_ops* ops, void* device)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(ops, spi_bus_status_iptr);
+
+    if (device_registry_status_ok != device_registry_register(&bus->devices, cs, ops, device)) {
+        return spi_bus_status_cerror;
+    }
+    spi_bus_cache_drop(bus, cs);
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_attach_builtin(spi_bus* bus, u32 cs, device_kind kind)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    if (device_registry_status_ok != device_registry_register_builtin(&bus->devices, cs, kind)) {
+        return spi_bus_status_cerror;
+    }
+    spi_bus_cache_drop(bus, cs);
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_modes(spi_bus* bus, u32 cs, const spi_mode* host, const spi_mode* device)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(host, spi_bus_status_iptr);
+    NOT_NULL(device, spi_bus_status_iptr);
+
+    if (SPI_BUS_MAX_SLAVES <= cs) {
+        return spi_bus_status_cerror;
+    }
+    if (NULL == device_registry_lookup(&bus->devices, cs)) {
+        return spi_bus_status_nodev;
+    }
+    if (device_registry_status_ok != device_registry_set_modes(&bus->devices, cs, host, device)) {
+        return spi_bus_status_cerror;
+    }
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_detach(spi_bus* bus, u32 cs)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    if (SPI_BUS_MAX_SLAVES <= cs) {
+        return spi_bus_status_cerror;
+    }
+
+    if (cs == bus->active_cs) {
+        spi_bus_deselect(bus);
+    }
+    device_registry_unregister(&bus->devices, cs);
+    spi_bus_cache_drop(bus, cs);
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_scheduler(spi_bus* bus, scheduler* sched)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    bus->sched = sched;
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_horizon(spi_bus* bus, u64 horizon_ns)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    bus->horizon_ns = horizon_ns;
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_cache(spi_bus* bus, u32 cs, device_pure pure, const u64* version)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    if (NULL != pure) {
+        NOT_NULL(version, spi_bus_status_iptr);
+    }
+
+    if (SPI_BUS_MAX_SLAVES <= cs) {
+        return spi_bus_status_cerror;
+    }
+    if (NULL == device_registry_lookup(&bus->devices, cs)) {
+        return spi_bus_status_nodev;
+    }
+    device_registry_set_cache(&bus->devices, cs, pure, version);
+    spi_bus_cache_drop(bus, cs);
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_coalescing(spi_bus* bus, bool enable)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    bus->coalesce = enable;
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_set_fast_forward(spi_bus* bus, bool enable)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+
+    bus->fast_forward = enable;
+    bus->poll.entry = NULL;
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_message(spi_bus* bus, u32 cs, const spi_transfer* transfers, size count)
+{
+    NOT_NULL(bus, spi_bus_status_iptr);
+    NOT_NULL(transfers, spi_bus_status_iptr);
+
+    if (UNLIKELY(SPI_BUS_MAX_SLAVES <= cs)) {
+        return spi_bus_status_cerror;
+    }
+    const device_entry* slave = device_registry_lookup(&bus->devices, cs);
+    if (UNLIKELY(NULL == slave)) {
+        return spi_bus_status_nodev;
+    }
+
+    /* Reject the whole message before anything reaches the device */
+    for (size i = 0; i < count; ++i) {
+        spi_bus_status status = spi_transfer_validate(bus, &transfers[i]);
+        if (UNLIKELY(spi_bus_status_ok != status)) {
+            return status;
+        }
+    }
+
+    if (NULL == slave->pure || !spi_bus_cached(bus, slave, cs, transfers, count)) {
+        /* Anything else on the bus breaks a run of polls */
+        bus->poll.entry = NULL;
+        bus->execute(bus, slave, cs, transfers, count);
+    }
+    spi_bus_sync(bus);
+    ++bus->stats.messages;
+    return spi_bus_status_ok;
+}
+
+spi_bus_status spi_bus_transfer(spi_bus* bus, u32 cs, const iterator_instance* tx, iterator_instance* rx, size len)
+{
+    spi_transfer xfer = {tx, rx, len, 0, 0, 0, false, SPI_LANES_SINGLE, SPI_LANES_SINGLE};
+    return spi_bus_message(bus, cs, &xfer, 1);
+}
@@ -0,0 +1,145 @@
+#include "spi_dma.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Move the next burst between the caller's buffers and the device. Return false when the bus rejected it */
+static bool spi_dma_burst(spi_dma_channel* channel)
+{
+    size offset = channel->done;
+    size n = channel->len - offset < channel->burst ? channel->len - offset : channel->burst;
+    bool last = offset + n == channel->len;
+
+    spi_transfer xfer = {NULL, NULL, n, 0, 0, 0, !last, SPI_LANES_SINGLE, SPI_LANES_SINGLE};
+    if (NULL != channel->tx) {
+        array_iterator_init_const_ctx(&channel->tx_view, channel->tx + offset, n, sizeof(u8));
+        xfer.tx = &channel->tx_view;
+    }
+    if (NULL != channel->rx) {
+        array_iterator_init_ctx(&channel->rx_view, channel->rx + offset, n, sizeof(u8));
+        xfer.rx = &channel->rx_view;
+    }
+
+    /* On the last transfer of a message cs_change keeps the chip-select asserted for the next burst */
+    spi_bus_status status = spi_bus_message(channel->bus, channel->cs, &xfer, 1);
+    if (UNLIKELY(spi_bus_status_ok != status)) {
+        channel->status = status;
+        return false;
+    }
+    channel->done += n;
+    ++channel->stats.bursts;
+    channel->stats.bytes += n;
+    return true;
+}
+
+static void spi_dma_complete(spi_dma_channel* channel)
+{
+    channel->busy = false;
+    if (spi_bus_status_ok == channel->status) {
+        ++channel->stats.transfers;
+    } else {
+        ++channel->stats.errors;
+    }
+    if (NULL != channel->irq) {
+        channel->irq(channel, channel->irq_ctx);
+    }
+}
+
+static void spi_dma_fire(scheduler* sched, sched_event* event)
+{
+    spi_dma_channel* channel = event->ctx;
+
+    if (channel->done == channel->len) {
+        spi_dma_complete(channel);
+        return;
+    }
+
+    if (!spi_dma_burst(channel)) {
+        spi_dma_complete(channel);
+        return;
+    }
+    u64 next_ns = channel->bus->time_ns;
+    if (channel->done != channel->len) {
+        next_ns += channel->gap_ns;
+    }
+    scheduler_schedule(sched, event, next_ns);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+spi_dma_status spi_dma_init(spi_dma_channel* channel, spi_bus* bus, u32 cs, size burst, u32 gap_ns)
+{
+    NOT_NULL(channel, spi_dma_status_iptr);
+    NOT_NULL(bus, spi_dma_status_iptr);
+
+    if (SPI_BUS_MAX_SLAVES <= cs || 0 == burst) {
+        return spi_dma_status_cerror;
+    }
+
+    memset(channel, 0, sizeof(*channel));
+    channel->bus = bus;
+    channel->cs = cs;
+    channel->burst = burst;
+    channel->gap_ns = gap_ns;
+    sched_event_init(&channel->event, spi_dma_fire, channel);
+
+    channel->tx_view.context = &channel->tx_view_ctx;
+    iterator_init_as_const(&channel->tx_view, array_iterator_const_begin, array_iterator_const_next,
+                           array_iterator_const_end);
+    channel->rx_view.context = &channel->rx_view_ctx;
+    iterator_init_as_non_const(&channel->rx_view, array_iterator_begin, array_iterator_next, array_iterator_end);
+
+    return spi_dma_status_ok;
+}
+
+spi_dma_status spi_dma_set_irq(spi_dma_channel* channel, spi_dma_irq irq, void* ctx)
+{
+    NOT_NULL(channel, spi_dma_status_iptr);
+
+    channel->irq = irq;
+    channel->irq_ctx = ctx;
+    return spi_dma_status_ok;
+}
+
+spi_dma_status spi_dma_start(spi_dma_channel* channel, const u8* tx, u8* rx, size len)
+{
+    NOT_NULL(channel, spi_dma_status_iptr);
+
+    if (UNLIKELY(0 == len)) {
+        return spi_dma_status_cerror;
+    }
+    if (UNLIKELY(channel->busy)) {
+        return spi_dma_status_busy;
+    }
+    if (UNLIKELY(NULL == device_registry_lookup(&channel->bus->devices, channel->cs))) {
+        return spi_dma_status_nodev;
+    }
+
+    channel->tx = tx;
+    channel->rx = rx;
+    channel->len = len;
+    channel->done = 0;
+    channel->busy = true;
+    channel->status = spi_bus_status_ok;
+
+    scheduler* sched = channel->bus->sched;
+    if (NULL != sched) {
+        u64 start_ns = sched->now_ns > channel->bus->time_ns ? sched->now_ns : channel->bus->time_ns;
+        scheduler_schedule(sched, &channel->event, start_ns);
+        return spi_dma_status_ok;
+    }
+
+    /* Nothing to interleave with - run all bursts back to back */
+    bool moved = spi_dma_burst(channel);
+    while (moved && channel->done != channel->len) {
+        channel->bus->time_ns += channel->gap_ns;
+        moved = spi_dma_burst(channel);
+    }
+    spi_dma_complete(channel);
+    return spi_dma_status_ok;
+}
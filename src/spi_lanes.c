@@ -0,0 +1,300 @@
+#include "spi_lanes.h"
+#include <string.h>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private constants -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Byte transpositions: bits carried by IOk are gathered at k * (8 / nbits), in clock order. Octal needs no table as
+ * every line carries exactly one bit of a byte.
+ */
+static const u8 LANES_SPLIT_2[256] = {
+    0x00, 0x01, 0x10, 0x11, 0x02, 0x03, 0x12, 0x13, 0x20, 0x21, 0x30, 0x31, 0x22, 0x23, 0x32, 0x33,
+    0x04, 0x05, 0x14, 0x15, 0x06, 0x07, 0x16, 0x17, 0x24, 0x25, 0x34, 0x35, 0x26, 0x27, 0x36, 0x37,
+    0x40, 0x41, 0x50, 0x51, 0x42, 0x43, 0x52, 0x53, 0x60, 0x61, 0x70, 0x71, 0x62, 0x63, 0x72, 0x73,
+    0x44, 0x45, 0x54, 0x55, 0x46, 0x47, 0x56, 0x57, 0x64, 0x65, 0x74, 0x75, 0x66, 0x67, 0x76, 0x77,
+    0x08, 0x09, 0x18, 0x19, 0x0A, 0x0B, 0x1A, 0x1B, 0x28, 0x29, 0x38, 0x39, 0x2A, 0x2B, 0x3A, 0x3B,
+    0x0C, 0x0D, 0x1C, 0x1D, 0x0E, 0x0F, 0x1E, 0x1F, 0x2C, 0x2D, 0x3C, 0x3D, 0x2E, 0x2F, 0x3E, 0x3F,
+    0x48, 0x49, 0x58, 0x59, 0x4A, 0x4B, 0x5A, 0x5B, 0x68, 0x69, 0x78, 0x79, 0x6A, 0x6B, 0x7A, 0x7B,
+    0x4C, 0x4D, 0x5C, 0x5D, 0x4E, 0x4F, 0x5E, 0x5F, 0x6C, 0x6D, 0x7C, 0x7D, 0x6E, 0x6F, 0x7E, 0x7F,
+    0x80, 0x81, 0x90, 0x91, 0x82, 0x83, 0x92, 0x93, 0xA0, 0xA1, 0xB0, 0xB1, 0xA2, 0xA3, 0xB2, 0xB3,
+    0x84, 0x85, 0x94, 0x95, 0x86, 0x87, 0x96, 0x97, 0xA4, 0xA5, 0xB4, 0xB5, 0xA6, 0xA7, 0xB6, 0xB7,
+    0xC0, 0xC1, 0xD0, 0xD1, 0xC2, 0xC3, 0xD2, 0xD3, 0xE0, 0xE1, 0xF0, 0xF1, 0xE2, 0xE3, 0xF2, 0xF3,
+    0xC4, 0xC5, 0xD4, 0xD5, 0xC6, 0xC7, 0xD6, 0xD7, 0xE4, 0xE5, 0xF4, 0xF5, 0xE6, 0xE7, 0xF6, 0xF7,
+    0x88, 0x89, 0x98, 0x99, 0x8A, 0x8B, 0x9A, 0x9B, 0xA8, 0xA9, 0xB8, 0xB9, 0xAA, 0xAB, 0xBA, 0xBB,
+    0x8C, 0x8D, 0x9C, 0x9D, 0x8E, 0x8F, 0x9E, 0x9F, 0xAC, 0xAD, 0xBC, 0xBD, 0xAE, 0xAF, 0xBE, 0xBF,
+    0xC8, 0xC9, 0xD8, 0xD9, 0xCA, 0xCB, 0xDA, 0xDB, 0xE8, 0xE9, 0xF8, 0xF9, 0xEA, 0xEB, 0xFA, 0xFB,
+    0xCC, 0xCD, 0xDC, 0xDD, 0xCE, 0xCF, 0xDE, 0xDF, 0xEC, 0xED, 0xFC, 0xFD, 0xEE, 0xEF, 0xFE, 0xFF
+};
+
+static const u8 LANES_MERGE_2[256] = {
+    0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15, 0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55,
+    0x02, 0x03, 0x06, 0x07, 0x12, 0x13, 0x16, 0x17, 0x42, 0x43, 0x46, 0x47, 0x52, 0x53, 0x56, 0x57,
+    0x08, 0x09, 0x0C, 0x0D, 0x18, 0x19, 0x1C, 0x1D, 0x48, 0x49, 0x4C, 0x4D, 0x58, 0x59, 0x5C, 0x5D,
+    0x0A, 0x0B, 0x0E, 0x0F, 0x1A, 0x1B, 0x1E, 0x1F, 0x4A, 0x4B, 0x4E, 0x4F, 0x5A, 0x5B, 0x5E, 0x5F,
+    0x20, 0x21, 0x24, 0x25, 0x30, 0x31, 0x34, 0x35, 0x60, 0x61, 0x64, 0x65, 0x70, 0x71, 0x74, 0x75,
+    0x22, 0x23, 0x26, 0x27, 0x32, 0x33, 0x36, 0x37, 0x62, 0x63, 0x66, 0x67, 0x72, 0x73, 0x76, 0x77,
+    0x28, 0x29, 0x2C, 0x2D, 0x38, 0x39, 0x3C, 0x3D, 0x68, 0x69, 0x6C, 0x6D, 0x78, 0x79, 0x7C, 0x7D,
+    0x2A, 0x2B, 0x2E, 0x2F, 0x3A, 0x3B, 0x3E, 0x3F, 0x6A, 0x6B, 0x6E, 0x6F, 0x7A, 0x7B, 0x7E, 0x7F,
+    0x80, 0x81, 0x84, 0x85, 0x90, 0x91, 0x94, 0x95, 0xC0, 0xC1, 0xC4, 0xC5, 0xD0, 0xD1, 0xD4, 0xD5,
+    0x82, 0x83, 0x86, 0x87, 0x92, 0x93, 0x96, 0x97, 0xC2, 0xC3, 0xC6, 0xC7, 0xD2, 0xD3, 0xD6, 0xD7,
+    0x88, 0x89, 0x8C, 0x8D, 0x98, 0x99, 0x9C, 0x9D, 0xC8, 0xC9, 0xCC, 0xCD, 0xD8, 0xD9, 0xDC, 0xDD,
+    0x8A, 0x8B, 0x8E, 0x8F, 0x9A, 0x9B, 0x9E, 0x9F, 0xCA, 0xCB, 0xCE, 0xCF, 0xDA, 0xDB, 0xDE, 0xDF,
+    0xA0, 0xA1, 0xA4, 0xA5, 0xB0, 0xB1, 0xB4, 0xB5, 0xE0, 0xE1, 0xE4, 0xE5, 0xF0, 0xF1, 0xF4, 0xF5,
+    0xA2, 0xA3, 0xA6, 0xA7, 0xB2, 0xB3, 0xB6, 0xB7, 0xE2, 0xE3, 0xE6, 0xE7, 0xF2, 0xF3, 0xF6, 0xF7,
+    0xA8, 0xA9, 0xAC, 0xAD, 0xB8, 0xB9, 0xBC, 0xBD, 0xE8, 0xE9, 0xEC, 0xED, 0xF8, 0xF9, 0xFC, 0xFD,
+    0xAA, 0xAB, 0xAE, 0xAF, 0xBA, 0xBB, 0xBE, 0xBF, 0xEA, 0xEB, 0xEE, 0xEF, 0xFA, 0xFB, 0xFE, 0xFF
+};
+
+static const u8 LANES_SPLIT_4[256] = {
+    0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15, 0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55,
+    0x02, 0x03, 0x06, 0x07, 0x12, 0x13, 0x16, 0x17, 0x42, 0x43, 0x46, 0x47, 0x52, 0x53, 0x56, 0x57,
+    0x08, 0x09, 0x0C, 0x0D, 0x18, 0x19, 0x1C, 0x1D, 0x48, 0x49, 0x4C, 0x4D, 0x58, 0x59, 0x5C, 0x5D,
+    0x0A, 0x0B, 0x0E, 0x0F, 0x1A, 0x1B, 0x1E, 0x1F, 0x4A, 0x4B, 0x4E, 0x4F, 0x5A, 0x5B, 0x5E, 0x5F,
+    0x20, 0x21, 0x24, 0x25, 0x30, 0x31, 0x34, 0x35, 0x60, 0x61, 0x64, 0x65, 0x70, 0x71, 0x74, 0x75,
+    0x22, 0x23, 0x26, 0x27, 0x32, 0x33, 0x36, 0x37, 0x62, 0x63, 0x66, 0x67, 0x72, 0x73, 0x76, 0x77,
+    0x28, 0x29, 0x2C, 0x2D, 0x38, 0x39, 0x3C, 0x3D, 0x68, 0x69, 0x6C, 0x6D, 0x78, 0x79, 0x7C, 0x7D,
+    0x2A, 0x2B, 0x2E, 0x2F, 0x3A, 0x3B, 0x3E, 0x3F, 0x6A, 0x6B, 0x6E, 0x6F, 0x7A, 0x7B, 0x7E, 0x7F,
+    0x80, 0x81, 0x84, 0x85, 0x90, 0x91, 0x94, 0x95, 0xC0, 0xC1, 0xC4, 0xC5, 0xD0, 0xD1, 0xD4, 0xD5,
+    0x82, 0x83, 0x86, 0x87, 0x92, 0x93, 0x96, 0x97, 0xC2, 0xC3, 0xC6, 0xC7, 0xD2, 0xD3, 0xD6, 0xD7,
+    0x88, 0x89, 0x8C, 0x8D, 0x98, 0x99, 0x9C, 0x9D, 0xC8, 0xC9, 0xCC, 0xCD, 0xD8, 0xD9, 0xDC, 0xDD,
+    0x8A, 0x8B, 0x8E, 0x8F, 0x9A, 0x9B, 0x9E, 0x9F, 0xCA, 0xCB, 0xCE, 0xCF, 0xDA, 0xDB, 0xDE, 0xDF,
+    0xA0, 0xA1, 0xA4, 0xA5, 0xB0, 0xB1, 0xB4, 0xB5, 0xE0, 0xE1, 0xE4, 0xE5, 0xF0, 0xF1, 0xF4, 0xF5,
+    0xA2, 0xA3, 0xA6, 0xA7, 0xB2, 0xB3, 0xB6, 0xB7, 0xE2, 0xE3, 0xE6, 0xE7, 0xF2, 0xF3, 0xF6, 0xF7,
+    0xA8, 0xA9, 0xAC, 0xAD, 0xB8, 0xB9, 0xBC, 0xBD, 0xE8, 0xE9, 0xEC, 0xED, 0xF8, 0xF9, 0xFC, 0xFD,
+    0xAA, 0xAB, 0xAE, 0xAF, 0xBA, 0xBB, 0xBE, 0xBF, 0xEA, 0xEB, 0xEE, 0xEF, 0xFA, 0xFB, 0xFE, 0xFF
+};
+
+static const u8 LANES_MERGE_4[256] = {
+    0x00, 0x01, 0x10, 0x11, 0x02, 0x03, 0x12, 0x13, 0x20, 0x21, 0x30, 0x31, 0x22, 0x23, 0x32, 0x33,
+    0x04, 0x05, 0x14, 0x15, 0x06, 0x07, 0x16, 0x17, 0x24, 0x25, 0x34, 0x35, 0x26, 0x27, 0x36, 0x37,
+    0x40, 0x41, 0x50, 0x51, 0x42, 0x43, 0x52, 0x53, 0x60, 0x61, 0x70, 0x71, 0x62, 0x63, 0x72, 0x73,
+    0x44, 0x45, 0x54, 0x55, 0x46, 0x47, 0x56, 0x57, 0x64, 0x65, 0x74, 0x75, 0x66, 0x67, 0x76, 0x77,
+    0x08, 0x09, 0x18, 0x19, 0x0A, 0x0B, 0x1A, 0x1B, 0x28, 0x29, 0x38, 0x39, 0x2A, 0x2B, 0x3A, 0x3B,
+    0x0C, 0x0D, 0x1C, 0x1D, 0x0E, 0x0F, 0x1E, 0x1F, 0x2C, 0x2D, 0x3C, 0x3D, 0x2E, 0x2F, 0x3E, 0x3F,
+    0x48, 0x49, 0x58, 0x59, 0x4A, 0x4B, 0x5A, 0x5B, 0x68, 0x69, 0x78, 0x79, 0x6A, 0x6B, 0x7A, 0x7B,
+    0x4C, 0x4D, 0x5C, 0x5D, 0x4E, 0x4F, 0x5E, 0x5F, 0x6C, 0x6D, 0x7C, 0x7D, 0x6E, 0x6F, 0x7E, 0x7F,
+    0x80, 0x81, 0x90, 0x91, 0x82, 0x83, 0x92, 0x93, 0xA0, 0xA1, 0xB0, 0xB1, 0xA2, 0xA3, 0xB2, 0xB3,
+    0x84, 0x85, 0x94, 0x95, 0x86, 0x87, 0x96, 0x97, 0xA4, 0xA5, 0xB4, 0xB5, 0xA6, 0xA7, 0xB6, 0xB7,
+    0xC0, 0xC1, 0xD0, 0xD1, 0xC2, 0xC3, 0xD2, 0xD3, 0xE0, 0xE1, 0xF0, 0xF1, 0xE2, 0xE3, 0xF2, 0xF3,
+    0xC4, 0xC5, 0xD4, 0xD5, 0xC6, 0xC7, 0xD6, 0xD7, 0xE4, 0xE5, 0xF4, 0xF5, 0xE6, 0xE7, 0xF6, 0xF7,
+    0x88, 0x89, 0x98, 0x99, 0x8A, 0x8B, 0x9A, 0x9B, 0xA8, 0xA9, 0xB8, 0xB9, 0xAA, 0xAB, 0xBA, 0xBB,
+    0x8C, 0x8D, 0x9C, 0x9D, 0x8E, 0x8F, 0x9E, 0x9F, 0xAC, 0xAD, 0xBC, 0xBD, 0xAE, 0xAF, 0xBE, 0xBF,
+    0xC8, 0xC9, 0xD8, 0xD9, 0xCA, 0xCB, 0xDA, 0xDB, 0xE8, 0xE9, 0xF8, 0xF9, 0xEA, 0xEB, 0xFA, 0xFB,
+    0xCC, 0xCD, 0xDC, 0xDD, 0xCE, 0xCF, 0xDE, 0xDF, 0xEC, 0xED, 0xFC, 0xFD, 0xEE, 0xEF, 0xFE, 0xFF
+};
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline const u8* spi_lanes_split_table(u8 nbits)
+{
+    return SPI_LANES_DUAL == nbits ? LANES_SPLIT_2 : (SPI_LANES_QUAD == nbits ? LANES_SPLIT_4 : NULL);
+}
+
+static inline const u8* spi_lanes_merge_table(u8 nbits)
+{
+    return SPI_LANES_DUAL == nbits ? LANES_MERGE_2 : (SPI_LANES_QUAD == nbits ? LANES_MERGE_4 : NULL);
+}
+
+/* Split bytes starting at 'start', which has to be a multiple of 'nbits' */
+static void spi_lanes_split_table_kernel(const u8* src, size start, size len, u8 nbits, u8* dst, size stride)
+{
+    const u8* table = spi_lanes_split_table(nbits);
+    const u8 width = 8 / nbits;
+    const u8 mask = (u8)((1u << width) - 1);
+
+    for (size i = start; i < len; i += nbits) {
+        u8 group[SPI_LANES_OCTAL];
+        size n = len - i < nbits ? len - i : nbits;
+        for (size j = 0; j < n; ++j) {
+            group[j] = NULL != table ? table[src[i + j]] : src[i + j];
+        }
+
+        /* Every line collects 'width' bits from each of the next 'nbits' bytes, forming exactly one output byte */
+        for (u8 k = 0; k < nbits; ++k) {
+            u8 acc = 0;
+            for (size j = 0; j < n; ++j) {
+                acc = (u8)((acc << width) | ((group[j] >> (k * width)) & mask));
+            }
+            dst[k * stride + i / nbits] = (u8)(acc << (width * (nbits - n)));
+        }
+    }
+}
+
+static void spi_lanes_merge_table_kernel(const u8* src, size start, size len, u8 nbits, u8* dst, size stride)
+{
+    const u8* table = spi_lanes_merge_table(nbits);
+    const u8 width = 8 / nbits;
+    const u8 mask = (u8)((1u << width) - 1);
+
+    for (size i = start; i < len; ++i) {
+        size line_byte = i / nbits;
+        u8 shift = (u8)(8 - width - (i % nbits) * width);
+        u8 group = 0;
+        for (u8 k = 0; k < nbits; ++k) {
+            group |= (u8)(((src[k * stride + line_byte] >> shift) & mask) << (k * width));
+        }
+        dst[i] = NULL != table ? table[group] : group;
+    }
+}
+
+/* Transpose an 8x8 bit matrix stored MSB-first, one row per byte */
+static inline u64 spi_lanes_transpose8(u64 x)
+{
+    u64 t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+/*
+ * Octal lines carry one bit of each byte, so eight bytes form a bit matrix whose columns are the line streams.
+ * Return the number of bytes processed.
+ */
+static size spi_lanes_split_octal(const u8* src, size len, u8* dst, size stride)
+{
+    size done = 0;
+    for (; done + 8 <= len; done += 8) {
+        u64 rows = 0;
+        for (u8 j = 0; j < 8; ++j) {
+            rows = (rows << 8) | src[done + j];
+        }
+        u64 columns = spi_lanes_transpose8(rows);
+        for (u8 k = 0; k < 8; ++k) {
+            dst[k * stride + done / 8] = (u8)(columns >> (8 * k));
+        }
+    }
+    return done;
+}
+
+static size spi_lanes_merge_octal(const u8* src, size len, u8* dst, size stride)
+{
+    size done = 0;
+    for (; done + 8 <= len; done += 8) {
+        u64 columns = 0;
+        for (u8 k = 0; k < 8; ++k) {
+            columns |= (u64)src[k * stride + done / 8] << (8 * k);
+        }
+        u64 rows = spi_lanes_transpose8(columns);
+        for (u8 j = 0; j < 8; ++j) {
+            dst[done + j] = (u8)(rows >> (8 * (7 - j)));
+        }
+    }
+    return done;
+}
+
+#if defined(__BMI2__)
+/* Bits of a big-endian 64-bit word which are carried by IOk */
+static inline u64 spi_lanes_mask(u8 nbits, u8 k)
+{
+    u64 byte_mask = 0;
+    for (u8 bit = k; bit < 8; bit += nbits) {
+        byte_mask |= 1u << bit;
+    }
+    return byte_mask * 0x0101010101010101ULL;
+}
+
+/* Eight bytes produce 'width' bytes per line. Return the number of bytes processed */
+static size spi_lanes_split_bmi2(const u8* src, size len, u8 nbits, u8* dst, size stride)
+{
+    const u8 width = 8 / nbits;
+    u64 masks[SPI_LANES_OCTAL];
+    for (u8 k = 0; k < nbits; ++k) {
+        masks[k] = spi_lanes_mask(nbits, k);
+    }
+
+    size done = 0;
+    for (; done + 8 <= len; done += 8) {
+        u64 word;
+        memcpy(&word, src + done, sizeof(word));
+        word = __builtin_bswap64(word);
+        for (u8 k = 0; k < nbits; ++k) {
+            u64 bits = _pext_u64(word, masks[k]);
+            u8* line = dst + k * stride + done / nbits;
+            for (u8 j = 0; j < width; ++j) {
+                line[j] = (u8)(bits >> (8 * (width - 1 - j)));
+            }
+        }
+    }
+    return done;
+}
+
+static size spi_lanes_merge_bmi2(const u8* src, size len, u8 nbits, u8* dst, size stride)
+{
+    const u8 width = 8 / nbits;
+    u64 masks[SPI_LANES_OCTAL];
+    for (u8 k = 0; k < nbits; ++k) {
+        masks[k] = spi_lanes_mask(nbits, k);
+    }
+
+    size done = 0;
+    for (; done + 8 <= len; done += 8) {
+        u64 word = 0;
+        for (u8 k = 0; k < nbits; ++k) {
+            const u8* line = src + k * stride + done / nbits;
+            u64 bits = 0;
+            for (u8 j = 0; j < width; ++j) {
+                bits = (bits << 8) | line[j];
+            }
+            word |= _pdep_u64(bits, masks[k]);
+        }
+        word = __builtin_bswap64(word);
+        memcpy(dst + done, &word, sizeof(word));
+    }
+    return done;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void spi_lanes_split(const u8* src, size len, u8 nbits, u8* dst)
+{
+    if (SPI_LANES_SINGLE == nbits) {
+        memcpy(dst, src, len);
+        return;
+    }
+
+    size stride = spi_lanes_stride(len, nbits);
+    size done = 0;
+    if (SPI_LANES_OCTAL == nbits) {
+        done = spi_lanes_split_octal(src, len, dst, stride);
+    }
+#if defined(__BMI2__)
+    else {
+        done = spi_lanes_split_bmi2(src, len, nbits, dst, stride);
+    }
+#endif
+    spi_lanes_split_table_kernel(src, done, len, nbits, dst, stride);
+}
+
+void spi_lanes_merge(const u8* src, size len, u8 nbits, u8* dst)
+{
+    if (SPI_LANES_SINGLE == nbits) {
+        memcpy(dst, src, len);
+        return;
+    }
+
+    size stride = spi_lanes_stride(len, nbits);
+    size done = 0;
+    if (SPI_LANES_OCTAL == nbits) {
+        done = spi_lanes_merge_octal(src, len, dst, stride);
+    }
+#if defined(__BMI2__)
+    else {
+        done = spi_lanes_merge_bmi2(src, len, nbits, dst, stride);
+    }
+#endif
+    spi_lanes_merge_table_kernel(src, done, len, nbits, dst, stride);
+}
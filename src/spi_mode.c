@@ -0,0 +1,167 @@
+#include "spi_mode.h"
+#include "endian_iterator.h"
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private constants -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Bit-reversed bytes */
+static const u8 REVERSE8[256] = {
+    0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+    0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+    0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+    0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+    0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+    0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+    0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+    0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+    0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+    0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+    0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+    0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+    0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+    0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+    0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+    0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline bool spi_mode_late_edge(const spi_mode* mode)
+{
+    return 0 != (((mode->mode >> 1) ^ mode->mode) & SPI_MODE_CPHA);
+}
+
+/* Reverse bits of every byte. Return the number of bytes processed */
+#if defined(__AVX2__) || defined(__SSSE3__)
+static size spi_mode_reverse_bytes_simd(u8* bytes, size len)
+{
+    /* Reversed nibbles - one table for the low nibble moving up, one for the high nibble moving down */
+    const __m128i rev_lo = _mm_setr_epi8(0x00, 0x08, 0x04, 0x0C, 0x02, 0x0A, 0x06, 0x0E,
+                                         0x01, 0x09, 0x05, 0x0D, 0x03, 0x0B, 0x07, 0x0F);
+    const __m128i rev_hi = _mm_slli_epi16(rev_lo, 4);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    size done = 0;
+    for (; done + 16 <= len; done += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(bytes + done));
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        v = _mm_or_si128(_mm_shuffle_epi8(rev_hi, lo), _mm_shuffle_epi8(rev_lo, hi));
+        _mm_storeu_si128((__m128i*)(bytes + done), v);
+    }
+    return done;
+}
+#endif
+
+static void spi_mode_reverse_bytes(u8* bytes, size len)
+{
+    size done = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    done = spi_mode_reverse_bytes_simd(bytes, len);
+#endif
+    for (; done < len; ++done) {
+        bytes[done] = REVERSE8[bytes[done]];
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+spi_mode_transform spi_mode_transform_between(const spi_mode* from, const spi_mode* to)
+{
+    spi_mode_transform transform;
+    transform.reverse_in = from->lsb_first;
+    transform.shift = spi_mode_late_edge(from) != spi_mode_late_edge(to);
+    transform.reverse_out = to->lsb_first;
+    return transform;
+}
+
+void spi_mode_reverse(void* words, size count, u8 bits_per_word)
+{
+    size word_bytes = spi_mode_word_bytes(bits_per_word);
+    spi_mode_reverse_bytes(words, count * word_bytes);
+    if (sizeof(u8) != word_bytes) {
+        endian_swap(words, words, count, word_bytes);
+    }
+
+    /* Bits of a narrower word end up at the top of its container */
+    u8 align = (u8)(8 * word_bytes - bits_per_word);
+    if (0 == align) {
+        return;
+    }
+    switch (word_bytes) {
+        case sizeof(u8):
+            for (size i = 0; i < count; ++i) {
+                ((u8*)words)[i] >>= align;
+            }
+            break;
+        case sizeof(u16):
+            for (size i = 0; i < count; ++i) {
+                ((u16*)words)[i] >>= align;
+            }
+            break;
+        default:
+            for (size i = 0; i < count; ++i) {
+                ((u32*)words)[i] >>= align;
+            }
+            break;
+    }
+}
+
+u32 spi_mode_shift(void* words, size count, u8 bits_per_word, u32 carry)
+{
+    const u32 mask = (u32)(((u64)1 << bits_per_word) - 1);
+    const u8 top = (u8)(bits_per_word - 1);
+
+    switch (spi_mode_word_bytes(bits_per_word)) {
+        case sizeof(u8):
+            for (size i = 0; i < count; ++i) {
+                u32 w = ((u8*)words)[i] & mask;
+                ((u8*)words)[i] = (u8)((w >> 1) | (carry << top));
+                carry = w & 1;
+            }
+            break;
+        case sizeof(u16):
+            for (size i = 0; i < count; ++i) {
+                u32 w = ((u16*)words)[i] & mask;
+                ((u16*)words)[i] = (u16)((w >> 1) | (carry << top));
+                carry = w & 1;
+            }
+            break;
+        default:
+            for (size i = 0; i < count; ++i) {
+                u32 w = ((u32*)words)[i] & mask;
+                ((u32*)words)[i] = (w >> 1) | (carry << top);
+                carry = w & 1;
+            }
+            break;
+    }
+    return carry;
+}
+
+u32 spi_mode_apply(const spi_mode_transform* transform, void* words, size count, u8 bits_per_word, u32 carry)
+{
+    if (!transform->shift) {
+        if (transform->reverse_in != transform->reverse_out) {
+            spi_mode_reverse(words, count, bits_per_word);
+        }
+        return carry;
+    }
+
+    if (transform->reverse_in) {
+        spi_mode_reverse(words, count, bits_per_word);
+    }
+    carry = spi_mode_shift(words, count, bits_per_word, carry);
+    if (transform->reverse_out) {
+        spi_mode_reverse(words, count, bits_per_word);
+    }
+    return carry;
+}
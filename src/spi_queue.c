@@ -0,0 +1,303 @@
+#include "spi_queue.h"
+#include "common.h"
+#include <string.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static inline size spi_queue_load(const size* index)
+{
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static inline void spi_queue_store(size* index, size value)
+{
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+/*
+ * A thread going to sleep raises its flag and re-checks the ring, the other side publishes an index and checks the
+ * flag. Both use sequentially consistent accesses, so at least one of them notices the other and no wakeup is lost.
+ */
+static inline void spi_queue_flag(bool* flag, bool value)
+{
+    __atomic_store_n(flag, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool spi_queue_flag_raised(const bool* flag)
+{
+    return __atomic_load_n(flag, __ATOMIC_SEQ_CST);
+}
+
+static void spi_queue_wake(spi_queue* queue, pthread_cond_t* cond)
+{
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void spi_queue_notify(const spi_queue* queue, size posted)
+{
+    if (SPI_QUEUE_NO_FD != queue->notify_fd) {
+        u64 value = posted;
+        ssize_t written = write(queue->notify_fd, &value, sizeof(value));
+        (void)written;
+    }
+}
+
+/* Execute everything submitted so far. Return the number of posted completions */
+static size spi_queue_drain(spi_queue* queue)
+{
+    size first = queue->sq_ring.head;
+    size head = first;
+    size tail = spi_queue_load(&queue->sq_ring.tail);
+    size cq_tail = queue->cq_ring.tail;
+    size mask = queue->entries - 1;
+
+    for (; head != tail; ++head, ++cq_tail) {
+        const spi_queue_entry* entry = &queue->sq[head & mask];
+        spi_queue_completion* completion = &queue->cq[cq_tail & mask];
+        completion->user_data = entry->user_data;
+        completion->status = spi_bus_message(queue->bus, entry->cs, entry->transfers, entry->count);
+        if (NULL != entry->complete) {
+            entry->complete(completion);
+        }
+
+        /* Publish every completion right away so the host can overlap reaping with the rest of the batch */
+        queue->sq_ring.head = head + 1;
+        __atomic_store_n(&queue->cq_ring.tail, cq_tail + 1, __ATOMIC_SEQ_CST);
+    }
+
+    return head - first;
+}
+
+/* Run the service once per kick. Return true when it asked to be run again */
+static bool spi_queue_serve(spi_queue* queue)
+{
+    spi_queue_flag(&queue->kicked, false);
+    spi_queue_service service = __atomic_load_n(&queue->service, __ATOMIC_ACQUIRE);
+    return NULL != service && service(queue->service_ctx);
+}
+
+static void* spi_queue_worker(void* arg)
+{
+    spi_queue* queue = arg;
+
+    for (;;) {
+        bool busy = spi_queue_serve(queue);
+        size posted = spi_queue_drain(queue);
+        if (0 != posted) {
+            spi_queue_notify(queue, posted);
+            if (spi_queue_flag_raised(&queue->waiting)) {
+                spi_queue_wake(queue, &queue->completed);
+            }
+            continue;
+        }
+        if (busy) {
+            continue;
+        }
+
+        /* Nothing to do - sleep until the doorbell rings */
+        pthread_mutex_lock(&queue->lock);
+        spi_queue_flag(&queue->idle, true);
+        while (queue->sq_ring.head == __atomic_load_n(&queue->sq_ring.tail, __ATOMIC_SEQ_CST)
+               && !spi_queue_flag_raised(&queue->kicked) && !spi_queue_flag_raised(&queue->stop)) {
+            pthread_cond_wait(&queue->doorbell, &queue->lock);
+        }
+        spi_queue_flag(&queue->idle, false);
+        bool stop = queue->sq_ring.head == __atomic_load_n(&queue->sq_ring.tail, __ATOMIC_SEQ_CST)
+                    && spi_queue_flag_raised(&queue->stop);
+        pthread_mutex_unlock(&queue->lock);
+        if (stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void spi_queue_free_rings(spi_queue* queue, mem_deallocator deallocator)
+{
+    deallocator(queue->sq);
+    queue->sq = NULL;
+    queue->cq = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+spi_queue_status spi_queue_construct_ext(spi_queue* queue, spi_bus* bus, size entries, int notify_fd,
+                                         mem_allocator allocator, mem_deallocator deallocator)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+    NOT_NULL(bus, spi_queue_status_iptr);
+    NOT_NULL(allocator, spi_queue_status_iptr);
+    NOT_NULL(deallocator, spi_queue_status_iptr);
+
+    if (0 == entries || 0 != (entries & (entries - 1))) {
+        return spi_queue_status_cerror;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+    queue->bus = bus;
+    queue->entries = entries;
+    queue->notify_fd = notify_fd;
+
+    /* Both rings share a single allocation */
+    queue->sq = allocator(entries * (sizeof(spi_queue_entry) + sizeof(spi_queue_completion)));
+    NOT_NULL(queue->sq, spi_queue_status_merror);
+    queue->cq = (spi_queue_completion*)(queue->sq + entries);
+
+    if (0 != pthread_mutex_init(&queue->lock, NULL)) {
+        spi_queue_free_rings(queue, deallocator);
+        return spi_queue_status_cerror;
+    }
+    if (0 != pthread_cond_init(&queue->doorbell, NULL)) {
+        pthread_mutex_destroy(&queue->lock);
+        spi_queue_free_rings(queue, deallocator);
+        return spi_queue_status_cerror;
+    }
+    if (0 != pthread_cond_init(&queue->completed, NULL)) {
+        pthread_cond_destroy(&queue->doorbell);
+        pthread_mutex_destroy(&queue->lock);
+        spi_queue_free_rings(queue, deallocator);
+        return spi_queue_status_cerror;
+    }
+    if (0 != pthread_create(&queue->worker, NULL, spi_queue_worker, queue)) {
+        pthread_cond_destroy(&queue->completed);
+        pthread_cond_destroy(&queue->doorbell);
+        pthread_mutex_destroy(&queue->lock);
+        spi_queue_free_rings(queue, deallocator);
+        return spi_queue_status_cerror;
+    }
+
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_destruct_ext(spi_queue* queue, mem_deallocator deallocator)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+    NOT_NULL(deallocator, spi_queue_status_iptr);
+
+    if (UNLIKELY(NULL == queue->sq)) {
+        return spi_queue_status_ok;
+    }
+
+    spi_queue_stop(queue);
+    pthread_cond_destroy(&queue->completed);
+    pthread_cond_destroy(&queue->doorbell);
+    pthread_mutex_destroy(&queue->lock);
+    spi_queue_free_rings(queue, deallocator);
+
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_stop(spi_queue* queue)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+
+    if (NULL == queue->sq || queue->joined) {
+        return spi_queue_status_ok;
+    }
+
+    spi_queue_flag(&queue->stop, true);
+    spi_queue_wake(queue, &queue->doorbell);
+    pthread_join(queue->worker, NULL);
+    queue->joined = true;
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_submit(spi_queue* queue, const spi_queue_entry* entries, size count)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+    NOT_NULL(entries, spi_queue_status_iptr);
+
+    /* A slot is free once its completion has been reaped, so the completion ring can never overflow */
+    size tail = queue->sq_ring.tail;
+    size in_flight = tail - spi_queue_load(&queue->cq_ring.head);
+    if (UNLIKELY(queue->entries - in_flight < count)) {
+        return spi_queue_status_busy;
+    }
+
+    size mask = queue->entries - 1;
+    for (size i = 0; i < count; ++i) {
+        queue->sq[(tail + i) & mask] = entries[i];
+    }
+    __atomic_store_n(&queue->sq_ring.tail, tail + count, __ATOMIC_SEQ_CST);
+
+    /* Ring the doorbell only when the worker might be asleep */
+    if (spi_queue_flag_raised(&queue->idle)) {
+        spi_queue_wake(queue, &queue->doorbell);
+    }
+
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_reap(spi_queue* queue, spi_queue_completion* completions, size max, size* reaped)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+    NOT_NULL(completions, spi_queue_status_iptr);
+    NOT_NULL(reaped, spi_queue_status_iptr);
+
+    size head = queue->cq_ring.head;
+    size ready = spi_queue_load(&queue->cq_ring.tail) - head;
+    size n = ready < max ? ready : max;
+
+    size mask = queue->entries - 1;
+    for (size i = 0; i < n; ++i) {
+        completions[i] = queue->cq[(head + i) & mask];
+    }
+    spi_queue_store(&queue->cq_ring.head, head + n);
+
+    *reaped = n;
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_wait(spi_queue* queue, size min)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+
+    size head = queue->cq_ring.head;
+    if (UNLIKELY(spi_queue_load(&queue->sq_ring.tail) - head < min)) {
+        return spi_queue_status_cerror;
+    }
+
+    /* Fast path - no locking when the completions are already there */
+    if (spi_queue_load(&queue->cq_ring.tail) - head >= min) {
+        return spi_queue_status_ok;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    spi_queue_flag(&queue->waiting, true);
+    while (__atomic_load_n(&queue->cq_ring.tail, __ATOMIC_SEQ_CST) - head < min) {
+        pthread_cond_wait(&queue->completed, &queue->lock);
+    }
+    spi_queue_flag(&queue->waiting, false);
+    pthread_mutex_unlock(&queue->lock);
+
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_set_service(spi_queue* queue, spi_queue_service service, void* ctx)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+    NOT_NULL(service, spi_queue_status_iptr);
+
+    queue->service_ctx = ctx;
+    __atomic_store_n(&queue->service, service, __ATOMIC_RELEASE);
+    spi_queue_kick(queue);
+    return spi_queue_status_ok;
+}
+
+spi_queue_status spi_queue_kick(spi_queue* queue)
+{
+    NOT_NULL(queue, spi_queue_status_iptr);
+
+    spi_queue_flag(&queue->kicked, true);
+    if (spi_queue_flag_raised(&queue->idle)) {
+        spi_queue_wake(queue, &queue->doorbell);
+    }
+    return spi_queue_status_ok;
+}
@@ -0,0 +1,412 @@
+#include "task_pool.h"
+#include "common.h"
+#include <string.h>
+
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Worker running on the calling thread, NULL outside of pools */
+static __thread task_worker* task_pool_current;
+
+static inline u32 task_pool_index(u64 head)
+{
+    return (u32)head;
+}
+
+static inline u64 task_pool_head(u32 index, u64 tag)
+{
+    return (tag << 32) | index;
+}
+
+/*
+ * The free list is a Treiber stack. Its head carries a tag bumped on every pop, so a descriptor popped and pushed back
+ * in the meantime cannot fool the compare-and-swap.
+ */
+static u32 task_pool_alloc(task_pool* pool)
+{
+    u64 head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        u32 index = task_pool_index(head);
+        if (UNLIKELY(TASK_POOL_NO_TASK == index)) {
+            return TASK_POOL_NO_TASK;
+        }
+        u32 next = __atomic_load_n(&pool->tasks[index].next, __ATOMIC_RELAXED);
+        u64 desired = task_pool_head(next, (head >> 32) + 1);
+        if (__atomic_compare_exchange_n(&pool->free_head, &head, desired, true, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE)) {
+            return index;
+        }
+    }
+}
+
+static void task_pool_release(task_pool* pool, u32 index)
+{
+    u64 head = __atomic_load_n(&pool->free_head, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&pool->tasks[index].next, task_pool_index(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &head, task_pool_head(index, head >> 32), true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* Chase-Lev deque with the orderings of Le et al., "Correct and efficient work-stealing for weak memory models" */
+static void task_deque_push(task_deque* deque, size mask, u32 index)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->buffer[(size)bottom & mask], index, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+}
+
+static u32 task_deque_take(task_deque* deque, size mask)
+{
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return TASK_POOL_NO_TASK;
+    }
+
+    u32 index = __atomic_load_n(&deque->buffer[(size)bottom & mask], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        /* The last task - race thieves for it */
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            index = TASK_POOL_NO_TASK;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return index;
+}
+
+static u32 task_deque_steal(task_deque* deque, size mask)
+{
+    i64 top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    i64 bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (top >= bottom) {
+        return TASK_POOL_NO_TASK;
+    }
+    u32 index = __atomic_load_n(&deque->buffer[(size)top & mask], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return TASK_POOL_NO_TASK;
+    }
+    return index;
+}
+
+static inline bool task_deque_empty(const task_deque* deque)
+{
+    return __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+}
+
+/* The injection queue is a bounded multi-producer multi-consumer ring of sequenced cells */
+static void task_pool_inject(task_pool* pool, u32 index)
+{
+    size mask = pool->capacity - 1;
+    size tail = __atomic_load_n(&pool->inject_tail, __ATOMIC_RELAXED);
+    for (;;) {
+        task_cell* cell = &pool->inject[tail & mask];
+        size sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        i64 diff = (i64)(sequence - tail);
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&pool->inject_tail, &tail, tail + 1, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                cell->task = index;
+                __atomic_store_n(&cell->sequence, tail + 1, __ATOMIC_RELEASE);
+                return;
+            }
+        } else {
+            /* The ring holds as many cells as there are descriptors, so it is never full - just behind */
+            tail = __atomic_load_n(&pool->inject_tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static u32 task_pool_extract(task_pool* pool)
+{
+    size mask = pool->capacity - 1;
+    size head = __atomic_load_n(&pool->inject_head, __ATOMIC_RELAXED);
+    for (;;) {
+        task_cell* cell = &pool->inject[head & mask];
+        size sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        i64 diff = (i64)(sequence - (head + 1));
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&pool->inject_head, &head, head + 1, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                u32 index = cell->task;
+                __atomic_store_n(&cell->sequence, head + mask + 1, __ATOMIC_RELEASE);
+                return index;
+            }
+        } else if (diff < 0) {
+            return TASK_POOL_NO_TASK;
+        } else {
+            head = __atomic_load_n(&pool->inject_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline bool task_pool_injected(const task_pool* pool)
+{
+    return __atomic_load_n(&pool->inject_head, __ATOMIC_ACQUIRE)
+           != __atomic_load_n(&pool->inject_tail, __ATOMIC_ACQUIRE);
+}
+
+static bool task_pool_has_work(const task_pool* pool)
+{
+    if (task_pool_injected(pool)) {
+        return true;
+    }
+    for (size i = 0; i < pool->count; ++i) {
+        if (!task_deque_empty(&pool->workers[i].deque)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline u64 task_worker_random(task_worker* worker)
+{
+    /* xorshift64 */
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+    return worker->seed;
+}
+
+/* Own deque first, where spawned work is still hot, then the injection queue, then other workers from a random one */
+static u32 task_worker_find(task_worker* worker)
+{
+    task_pool* pool = worker->pool;
+    size mask = pool->capacity - 1;
+
+    u32 index = task_deque_take(&worker->deque, mask);
+    if (TASK_POOL_NO_TASK != index) {
+        return index;
+    }
+    index = task_pool_extract(pool);
+    if (TASK_POOL_NO_TASK != index) {
+        return index;
+    }
+
+    size self = (size)(worker - pool->workers);
+    size start = (size)(task_worker_random(worker) % pool->count);
+    for (size i = 0; i < pool->count; ++i) {
+        size victim = (start + i) % pool->count;
+        if (victim == self) {
+            continue;
+        }
+        index = task_deque_steal(&pool->workers[victim].deque, mask);
+        if (TASK_POOL_NO_TASK != index) {
+            ++worker->stolen;
+            return index;
+        }
+    }
+    return TASK_POOL_NO_TASK;
+}
+
+static void task_worker_run(task_worker* worker, u32 index)
+{
+    task_pool* pool = worker->pool;
+    const task* work = &pool->tasks[index];
+
+    work->fn(work->arg);
+    ++worker->executed;
+    task_pool_release(pool, index);
+
+    /* Same handshake as with sleeping workers - see task_pool_submit() */
+    if (0 == __atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST)
+        && 0 != __atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void* task_worker_main(void* arg)
+{
+    task_worker* worker = arg;
+    task_pool* pool = worker->pool;
+    task_pool_current = worker;
+
+    for (;;) {
+        u32 index = task_worker_find(worker);
+        if (TASK_POOL_NO_TASK != index) {
+            task_worker_run(worker, index);
+            continue;
+        }
+
+        /* Nothing to do - announce going to sleep and look once more before the submitter could miss it */
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while (!task_pool_has_work(pool) && !__atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        bool stop = !task_pool_has_work(pool) && __atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void task_pool_shutdown(task_pool* pool, size started)
+{
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->stop, true, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size i = 0; i < started; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static void task_pool_free(task_pool* pool, mem_deallocator deallocator)
+{
+    deallocator(pool->workers);
+    pool->workers = NULL;
+    pool->tasks = NULL;
+    pool->inject = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Api functions ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+task_pool_status task_pool_construct_ext(task_pool* pool, size workers, size capacity, mem_allocator allocator,
+                                         mem_deallocator deallocator)
+{
+    NOT_NULL(pool, task_pool_status_iptr);
+    NOT_NULL(allocator, task_pool_status_iptr);
+    NOT_NULL(deallocator, task_pool_status_iptr);
+
+    if (0 == workers || 0 == capacity || 0 != (capacity & (capacity - 1)) || TASK_POOL_NO_TASK <= capacity) {
+        return task_pool_status_cerror;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->capacity = capacity;
+    pool->count = workers;
+
+    /* Workers, descriptors, the injection queue and all deques share a single allocation */
+    size bytes = workers * sizeof(task_worker) + capacity * (sizeof(task) + sizeof(task_cell))
+                 + workers * capacity * sizeof(u32);
+    pool->workers = allocator(bytes);
+    NOT_NULL(pool->workers, task_pool_status_merror);
+    memset(pool->workers, 0, workers * sizeof(task_worker));
+    pool->tasks = (task*)(pool->workers + workers);
+    pool->inject = (task_cell*)(pool->tasks + capacity);
+    u32* buffers = (u32*)(pool->inject + capacity);
+
+    for (size i = 0; i < capacity; ++i) {
+        pool->tasks[i].next = i + 1 < capacity ? (u32)(i + 1) : TASK_POOL_NO_TASK;
+        pool->inject[i].sequence = i;
+    }
+    pool->free_head = task_pool_head(0, 0);
+
+    for (size i = 0; i < workers; ++i) {
+        task_worker* worker = &pool->workers[i];
+        worker->deque.buffer = buffers + i * capacity;
+        worker->pool = pool;
+        worker->seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+    }
+
+    if (0 != pthread_mutex_init(&pool->lock, NULL)) {
+        task_pool_free(pool, deallocator);
+        return task_pool_status_cerror;
+    }
+    if (0 != pthread_cond_init(&pool->work, NULL)) {
+        pthread_mutex_destroy(&pool->lock);
+        task_pool_free(pool, deallocator);
+        return task_pool_status_cerror;
+    }
+    if (0 != pthread_cond_init(&pool->done, NULL)) {
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->lock);
+        task_pool_free(pool, deallocator);
+        return task_pool_status_cerror;
+    }
+    for (size i = 0; i < workers; ++i) {
+        if (0 != pthread_create(&pool->workers[i].thread, NULL, task_worker_main, &pool->workers[i])) {
+            task_pool_shutdown(pool, i);
+            task_pool_free(pool, deallocator);
+            return task_pool_status_cerror;
+        }
+    }
+
+    return task_pool_status_ok;
+}
+
+task_pool_status task_pool_destruct_ext(task_pool* pool, mem_deallocator deallocator)
+{
+    NOT_NULL(pool, task_pool_status_iptr);
+    NOT_NULL(deallocator, task_pool_status_iptr);
+
+    if (UNLIKELY(NULL == pool->workers)) {
+        return task_pool_status_ok;
+    }
+
+    task_pool_wait(pool);
+    task_pool_shutdown(pool, pool->count);
+    task_pool_free(pool, deallocator);
+
+    return task_pool_status_ok;
+}
+
+task_pool_status task_pool_submit(task_pool* pool, void (*fn)(void* arg), void* arg)
+{
+    NOT_NULL(pool, task_pool_status_iptr);
+    NOT_NULL(fn, task_pool_status_iptr);
+
+    u32 index = task_pool_alloc(pool);
+    if (UNLIKELY(TASK_POOL_NO_TASK == index)) {
+        return task_pool_status_busy;
+    }
+    pool->tasks[index].fn = fn;
+    pool->tasks[index].arg = arg;
+    __atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+
+    task_worker* self = task_pool_current;
+    if (NULL != self && pool == self->pool) {
+        task_deque_push(&self->deque, pool->capacity - 1, index);
+    } else {
+        task_pool_inject(pool, index);
+    }
+
+    /*
+     * A worker going to sleep raises the sleeper count and re-checks for work, the submitter publishes the task and
+     * checks the count. The fences make at least one of them notice the other, so no wakeup is lost.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (0 != __atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return task_pool_status_ok;
+}
+
+task_pool_status task_pool_wait(task_pool* pool)
+{
+    NOT_NULL(pool, task_pool_status_iptr);
+
+    pthread_mutex_lock(&pool->lock);
+    __atomic_add_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+    while (0 != __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    __atomic_sub_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->lock);
+
+    return task_pool_status_ok;
+}
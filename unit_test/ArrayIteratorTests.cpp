@@ -230,4 +230,16 @@ TEST(Ut_ArrayIterator, array_iterator_create__CreatesValidIterator)
 
     /* The caller must free memory afterwards */
     ENUMS_EQUAL_INT(iterator_status_ok, iterator_destruct(&iter));
-}
\ No newline at end of file
+}
+
+TEST(Ut_ArrayIterator, array_iterator_is_array__ArrayImplementationRecognized)
+{
+    CHECK_TRUE(array_iterator_is_array(&cIter));
+    CHECK_TRUE(array_iterator_is_array(&ncIter));
+    CHECK_FALSE(array_iterator_is_array(nullptr));
+
+    iterator_instance other;
+    auto next = [](void* ctx) -> const void* { static_cast<void>(ctx); return nullptr; };
+    ENUMS_EQUAL_INT(iterator_status_ok, iterator_init_as_const(&other, next, next, next));
+    CHECK_FALSE(array_iterator_is_array(&other));
+}
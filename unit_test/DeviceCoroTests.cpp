@@ -0,0 +1,225 @@
+#include "AllTests.h"
+#include "device_coro.h"
+#include "spi_bus.h"
+#include "array_iterator.h"
+#include "packed_iterator.h"
+#include <cstring>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_CS 2
+#define TEST_MEMORY 256
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Helpers ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* A tiny flash with a one-byte address, written as sequential code */
+struct Flash
+{
+    u8 memory[TEST_MEMORY];
+    u8 page[TEST_MEMORY];
+    u8 id;
+    u8 cmd;
+    u8 addr;
+    u8 in;
+    size i;
+    size programmed;
+};
+
+static void FlashBody(device_coro* co, void* state)
+{
+    auto flash = static_cast<Flash*>(state);
+
+    DEVICE_CORO_BEGIN(co);
+    DEVICE_CORO_EXCHANGE(co, 0xFF, flash->cmd);
+    if (0x9F == flash->cmd) {
+        DEVICE_CORO_EXCHANGE(co, 0xEF, flash->in);
+        DEVICE_CORO_EXCHANGE(co, 0x40, flash->in);
+        DEVICE_CORO_EXCHANGE(co, flash->id, flash->in);
+    } else if (0x03 == flash->cmd) {
+        DEVICE_CORO_EXCHANGE(co, 0xFF, flash->addr);
+        while (DEVICE_CORO_SELECTED(co)) {
+            DEVICE_CORO_EXCHANGE(co, flash->memory[flash->addr], flash->in);
+            ++flash->addr;
+        }
+    } else if (0x02 == flash->cmd) {
+        DEVICE_CORO_EXCHANGE(co, 0xFF, flash->addr);
+        for (flash->i = 0;; ++flash->i) {
+            DEVICE_CORO_EXCHANGE(co, 0xFF, flash->in);
+            if (!DEVICE_CORO_SELECTED(co)) {
+                break;
+            }
+            flash->page[flash->i % TEST_MEMORY] = flash->in;
+        }
+        /* Data is programmed once the chip-select is released */
+        for (size k = 0; k < flash->i; ++k) {
+            flash->memory[static_cast<u8>(flash->addr + k)] = flash->page[k % TEST_MEMORY];
+        }
+        if (0 != flash->i) {
+            ++flash->programmed;
+        }
+    }
+    DEVICE_CORO_END(co);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_DeviceCoro)
+{
+    spi_bus bus = {};
+    Flash flash = {};
+    device_coro co = {};
+    iterator_instance tx = {};
+    iterator_instance rx = {};
+
+    void setup() override
+    {
+        auto status = spi_bus_construct_ext(&bus, 16, malloc);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot construct shared bus");
+        auto coroStatus = device_coro_init(&co, FlashBody, &flash, DEVICE_CORO_DEFAULT_IDLE);
+        ENUMS_EQUAL_INT_TEXT(device_coro_status_ok, coroStatus, "Cannot init shared coroutine");
+        status = spi_bus_attach(&bus, TEST_CS, &DEVICE_CORO_OPS, &co);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot attach coroutine device");
+        for (size i = 0; i < TEST_MEMORY; ++i) {
+            flash.memory[i] = static_cast<u8>(i ^ 0x5A);
+        }
+    }
+
+    void teardown() override
+    {
+        iterator_destruct(&tx);
+        iterator_destruct(&rx);
+        spi_bus_destruct(&bus);
+    }
+
+    void Transfer(const u8* out, u8* in, size len)
+    {
+        iterator_destruct(&tx);
+        iterator_destruct(&rx);
+        CHECK_TRUE(array_iterator_create_const(&tx, out, len, sizeof(u8)));
+        CHECK_TRUE(array_iterator_create(&rx, in, len, sizeof(u8)));
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, len));
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_DeviceCoro, NullCases)
+{
+    ENUMS_EQUAL_INT(device_coro_status_iptr, device_coro_init(nullptr, FlashBody, &flash, 0));
+    ENUMS_EQUAL_INT(device_coro_status_iptr, device_coro_init(&co, nullptr, &flash, 0));
+}
+
+TEST(Ut_DeviceCoro, Exchange__SequentialBodyAnswersCommand)
+{
+    flash.id = 0x17;
+    const u8 out[4] = {0x9F, 0, 0, 0};
+    u8 in[4] = {};
+    Transfer(out, in, sizeof(out));
+
+    const u8 expected[4] = {0xFF, 0xEF, 0x40, 0x17};
+    MEMCMP_EQUAL(expected, in, sizeof(in));
+    UNSIGNED_LONGS_EQUAL(1, co.resumes);
+}
+
+TEST(Ut_DeviceCoro, Exchange__IdleBytesAfterBodyEnds)
+{
+    const u8 out[6] = {0x9F, 0, 0, 0, 0, 0};
+    u8 in[6] = {};
+    Transfer(out, in, sizeof(out));
+    UNSIGNED_LONGS_EQUAL(0xFF, in[4]);
+    UNSIGNED_LONGS_EQUAL(0xFF, in[5]);
+
+    /* Unknown command */
+    const u8 unknown[3] = {0x42, 0, 0};
+    Transfer(unknown, in, sizeof(unknown));
+    UNSIGNED_LONGS_EQUAL(0xFF, in[1]);
+    UNSIGNED_LONGS_EQUAL(0xFF, in[2]);
+}
+
+TEST(Ut_DeviceCoro, Exchange__BodyResumedAcrossTransfersOfMessage)
+{
+    const u8 cmd[2] = {0x03, 0x10};
+    u8 data[40] = {};
+    iterator_instance cmdIter = {};
+    CHECK_TRUE(array_iterator_create_const(&cmdIter, cmd, sizeof(cmd), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, data, sizeof(data), sizeof(u8)));
+
+    spi_transfer xfers[2] = {
+        {&cmdIter, nullptr, sizeof(cmd), 0, 0, 0, false, 0, 0},
+        {nullptr, &rx, sizeof(data), 0, 0, 0, false, 0, 0},
+    };
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    for (size i = 0; i < sizeof(data); ++i) {
+        UNSIGNED_LONGS_EQUAL(flash.memory[0x10 + i], data[i]);
+    }
+    /* Two exchanges and the deselect */
+    UNSIGNED_LONGS_EQUAL(3, co.resumes);
+    iterator_destruct(&cmdIter);
+}
+
+TEST(Ut_DeviceCoro, Deselect__BodyFinishesWhenChipSelectReleased)
+{
+    const u8 program[5] = {0x02, 0x80, 0xA1, 0xA2, 0xA3};
+    u8 in[5] = {};
+    Transfer(program, in, sizeof(program));
+    UNSIGNED_LONGS_EQUAL(1, flash.programmed);
+    UNSIGNED_LONGS_EQUAL(0xA1, flash.memory[0x80]);
+    UNSIGNED_LONGS_EQUAL(0xA2, flash.memory[0x81]);
+    UNSIGNED_LONGS_EQUAL(0xA3, flash.memory[0x82]);
+
+    /* Released after the address - nothing to program, the next transaction starts from the top */
+    const u8 aborted[2] = {0x02, 0x90};
+    Transfer(aborted, in, sizeof(aborted));
+    UNSIGNED_LONGS_EQUAL(1, flash.programmed);
+
+    flash.id = 0x18;
+    const u8 id[4] = {0x9F, 0, 0, 0};
+    Transfer(id, in, sizeof(id));
+    UNSIGNED_LONGS_EQUAL(0x18, in[3]);
+}
+
+TEST(Ut_DeviceCoro, Exchange__GenericMosiIteratorStaged)
+{
+    u8 out[100] = {0x02, 0x00};
+    for (size i = 2; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i);
+    }
+    u8 in[100] = {};
+    CHECK_TRUE(packed_iterator_create(&tx, out, sizeof(out), 8));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+
+    UNSIGNED_LONGS_EQUAL(1, flash.programmed);
+    MEMCMP_EQUAL(out + 2, flash.memory, sizeof(out) - 2);
+}
+
+TEST(Ut_DeviceCoro, Exchange__HundredsOfDevicesOnOneThread)
+{
+    static Flash flashes[200];
+    static device_coro coros[200];
+    for (u32 cs = 0; cs < 200; ++cs) {
+        flashes[cs].id = static_cast<u8>(cs);
+        device_coro_init(&coros[cs], FlashBody, &flashes[cs], DEVICE_CORO_DEFAULT_IDLE);
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&bus, cs, &DEVICE_CORO_OPS, &coros[cs]));
+    }
+
+    const u8 out[4] = {0x9F, 0, 0, 0};
+    u8 in[4] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    for (size round = 0; round < 10; ++round) {
+        for (u32 cs = 0; cs < 200; ++cs) {
+            ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, cs, &tx, &rx, sizeof(out)));
+            UNSIGNED_LONGS_EQUAL(cs, in[3]);
+        }
+    }
+    UNSIGNED_LONGS_EQUAL(10, coros[199].resumes);
+}
@@ -0,0 +1,80 @@
+#include "AllTests.h"
+#include "device_model.h"
+#include "packed_iterator.h"
+#include <cstring>
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_DeviceModel)
+{
+    iterator_instance mosi = {};
+
+    void teardown() override
+    {
+        iterator_destruct(&mosi);
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_DeviceModel, device_mosi_array__OnlyByteArraysAreContiguous)
+{
+    const u8 bytes[3] = {1, 2, 3};
+    POINTER_NULL(device_mosi_array(nullptr));
+    CHECK_TRUE(array_iterator_create_const(&mosi, bytes, sizeof(bytes), sizeof(u8)));
+    POINTERS_EQUAL(bytes, device_mosi_array(&mosi));
+
+    iterator_destruct(&mosi);
+    CHECK_TRUE(packed_iterator_create(&mosi, bytes, sizeof(bytes), 8));
+    POINTER_NULL(device_mosi_array(&mosi));
+}
+
+TEST(Ut_DeviceModel, device_mosi_read__AllSourcesPaddedWithZeros)
+{
+    const u8 bytes[3] = {0xA1, 0xB2, 0xC3};
+    u8 dst[5];
+
+    memset(dst, 0xFF, sizeof(dst));
+    device_mosi_read(nullptr, dst, sizeof(dst));
+    const u8 zeros[5] = {};
+    MEMCMP_EQUAL(zeros, dst, sizeof(dst));
+
+    CHECK_TRUE(array_iterator_create_const(&mosi, bytes, sizeof(bytes), sizeof(u8)));
+    device_mosi_read(&mosi, dst, sizeof(bytes));
+    MEMCMP_EQUAL(bytes, dst, sizeof(bytes));
+
+    iterator_destruct(&mosi);
+    memset(dst, 0xFF, sizeof(dst));
+    CHECK_TRUE(packed_iterator_create(&mosi, bytes, sizeof(bytes), 8));
+    device_mosi_read(&mosi, dst, sizeof(dst));
+    const u8 expected[5] = {0xA1, 0xB2, 0xC3, 0x00, 0x00};
+    MEMCMP_EQUAL(expected, dst, sizeof(dst));
+}
+
+TEST(Ut_DeviceModel, device_mosi_next__ChunksContinueTraversal)
+{
+    const u8 bytes[5] = {1, 2, 3, 4, 5};
+    u8 dst[3];
+    device_mosi_stream stream;
+
+    CHECK_TRUE(packed_iterator_create(&mosi, bytes, sizeof(bytes), 8));
+    device_mosi_open(&stream, &mosi);
+    device_mosi_next(&stream, dst, 3);
+    const u8 first[3] = {1, 2, 3};
+    MEMCMP_EQUAL(first, dst, sizeof(dst));
+    device_mosi_next(&stream, dst, 3);
+    const u8 second[3] = {4, 5, 0};
+    MEMCMP_EQUAL(second, dst, sizeof(dst));
+
+    iterator_destruct(&mosi);
+    CHECK_TRUE(array_iterator_create_const(&mosi, bytes, sizeof(bytes), sizeof(u8)));
+    device_mosi_open(&stream, &mosi);
+    device_mosi_next(&stream, dst, 2);
+    device_mosi_next(&stream, dst, 3);
+    MEMCMP_EQUAL(bytes + 2, dst, 3);
+    UNSIGNED_LONGS_EQUAL(5, stream.offset);
+}
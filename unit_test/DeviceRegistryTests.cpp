@@ -0,0 +1,137 @@
+#include "AllTests.h"
+#include "device_registry.h"
+#include "Fakes.h"
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_DeviceRegistry)
+{
+    device_registry registry = {};
+    FakeDevice device;
+
+    void setup() override
+    {
+        auto status = device_registry_init(&registry);
+        ENUMS_EQUAL_INT_TEXT(device_registry_status_ok, status, "Cannot initialize shared registry");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_DeviceRegistry, NullCases)
+{
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_init(nullptr));
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_register(nullptr, 0, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_register(&registry, 0, nullptr, &device));
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_unregister(nullptr, 0));
+}
+
+TEST(Ut_DeviceRegistry, device_registry_register__ErrorOnWrongParams)
+{
+    spi_device_ops noExchange = {nullptr, nullptr, nullptr, nullptr};
+    ENUMS_EQUAL_INT(device_registry_status_cerror, device_registry_register(&registry, 0, &noExchange, &device));
+    ENUMS_EQUAL_INT(device_registry_status_cerror,
+                    device_registry_register(&registry, DEVICE_REGISTRY_MAX_CS, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(device_registry_status_cerror, device_registry_unregister(&registry, DEVICE_REGISTRY_MAX_CS));
+}
+
+TEST(Ut_DeviceRegistry, device_registry_lookup__AllLinesAddressable)
+{
+    for (u32 cs = 0; cs < DEVICE_REGISTRY_MAX_CS; ++cs) {
+        POINTER_NULL(device_registry_lookup(&registry, cs));
+    }
+
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register(&registry, 0, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(device_registry_status_ok,
+                    device_registry_register(&registry, DEVICE_REGISTRY_MAX_CS - 1, &FAKE_DEVICE_OPS, &device));
+    POINTER_NOT_NULL(device_registry_lookup(&registry, 0));
+    POINTER_NOT_NULL(device_registry_lookup(&registry, DEVICE_REGISTRY_MAX_CS - 1));
+    POINTER_NULL(device_registry_lookup(&registry, 1));
+    POINTER_NULL(device_registry_lookup(&registry, DEVICE_REGISTRY_MAX_CS));
+
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_unregister(&registry, 0));
+    POINTER_NULL(device_registry_lookup(&registry, 0));
+}
+
+TEST(Ut_DeviceRegistry, device_registry_register__OperationsCopiedAndCompleted)
+{
+    /* Only exchange is given - select and deselect must still be callable */
+    spi_device_ops ops = {nullptr, FAKE_DEVICE_OPS.exchange, nullptr, nullptr};
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register(&registry, 7, &ops, &device));
+    ops.exchange = nullptr;
+
+    auto entry = device_registry_lookup(&registry, 7);
+    POINTER_NOT_NULL(entry);
+    const u8 out[2] = {0x0F, 0xF0};
+    u8 miso[2];
+    iterator_instance mosi = {};
+    CHECK_TRUE(array_iterator_create_const(&mosi, out, sizeof(out), sizeof(u8)));
+    entry->select(entry->device);
+    entry->exchange(entry->device, &mosi, miso, sizeof(out));
+    entry->deselect(entry->device);
+    UNSIGNED_LONGS_EQUAL(0, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0xF0, miso[0]);
+    UNSIGNED_LONGS_EQUAL(0x0F, miso[1]);
+    iterator_destruct(&mosi);
+}
+
+TEST(Ut_DeviceRegistry, device_registry_register_builtin__DevicesCallableLikeModels)
+{
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_register_builtin(nullptr, 0, device_kind_null));
+    ENUMS_EQUAL_INT(device_registry_status_cerror, device_registry_register_builtin(&registry, 0, device_kind_model));
+    ENUMS_EQUAL_INT(device_registry_status_cerror,
+                    device_registry_register_builtin(&registry, DEVICE_REGISTRY_MAX_CS, device_kind_null));
+    POINTER_NULL(device_registry_lookup(&registry, 0));
+
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register_builtin(&registry, 1, device_kind_loopback));
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register_builtin(&registry, 2, device_kind_null));
+    auto loopback = device_registry_lookup(&registry, 1);
+    auto null = device_registry_lookup(&registry, 2);
+    ENUMS_EQUAL_INT(device_kind_loopback, loopback->kind);
+    ENUMS_EQUAL_INT(device_kind_null, null->kind);
+
+    const u8 out[2] = {0x12, 0x34};
+    u8 miso[2];
+    iterator_instance mosi = {};
+    CHECK_TRUE(array_iterator_create_const(&mosi, out, sizeof(out), sizeof(u8)));
+    loopback->exchange(loopback->device, &mosi, miso, sizeof(out));
+    MEMCMP_EQUAL(out, miso, sizeof(out));
+    null->exchange(null->device, &mosi, miso, sizeof(out));
+    UNSIGNED_LONGS_EQUAL(DEVICE_NULL_MISO, miso[0]);
+    UNSIGNED_LONGS_EQUAL(DEVICE_NULL_MISO, miso[1]);
+    iterator_destruct(&mosi);
+
+    /* Registering a model turns the line back into a model */
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register(&registry, 1, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(device_kind_model, device_registry_lookup(&registry, 1)->kind);
+}
+
+static bool PureAlways(void* device, const u8* mosi, size len)
+{
+    (void)device;
+    (void)mosi;
+    (void)len;
+    return true;
+}
+
+TEST(Ut_DeviceRegistry, device_registry_set_cache__ErrorOnWrongParams)
+{
+    const u64 version = 0;
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_set_cache(nullptr, 0, PureAlways, &version));
+    ENUMS_EQUAL_INT(device_registry_status_iptr, device_registry_set_cache(&registry, 0, PureAlways, nullptr));
+    ENUMS_EQUAL_INT(device_registry_status_cerror, device_registry_set_cache(&registry, 0, PureAlways, &version));
+
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register(&registry, 0, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_set_cache(&registry, 0, PureAlways, &version));
+    POINTERS_EQUAL(&version, device_registry_lookup(&registry, 0)->version);
+
+    /* Registering again forgets the predicate */
+    ENUMS_EQUAL_INT(device_registry_status_ok, device_registry_register(&registry, 0, &FAKE_DEVICE_OPS, &device));
+    POINTER_NULL(reinterpret_cast<void*>(device_registry_lookup(&registry, 0)->pure));
+    POINTER_NULL(device_registry_lookup(&registry, 0)->version);
+}
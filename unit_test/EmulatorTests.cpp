@@ -0,0 +1,412 @@
+#include "AllTests.h"
+#include "emulator.h"
+#include "Fakes.h"
+#include <atomic>
+#include <sched.h>
+#include <algorithm>
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_BUSES 4
+#define TEST_MAILBOX 4
+#define TEST_CS 0
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static emulator* sharedEmu;
+static std::atomic<size> delivered;
+static std::atomic<bool> gateOpen;
+static std::vector<emulator_msg> received;
+static pthread_t handlerThread;
+static int handlerCpu;
+
+static void recordMessage(emulator* emu, u32 bus, u32 from, const emulator_msg* msg, void* ctx)
+{
+    static_cast<void>(emu);
+    static_cast<void>(bus);
+    static_cast<void>(from);
+    static_cast<void>(ctx);
+    while (!gateOpen.load()) {
+        sched_yield();
+    }
+    received.push_back(*msg);
+    handlerThread = pthread_self();
+    handlerCpu = sched_getcpu();
+    delivered.fetch_add(1);
+}
+
+/* Runs on the thread of bus 0 and raises a line of bus 1 */
+static void postOnCompletion(const spi_queue_completion* completion)
+{
+    emulator_msg msg = {};
+    msg.kind = 1;
+    msg.line = 7;
+    msg.value = reinterpret_cast<u64>(completion->user_data);
+    emulator_post(sharedEmu, 0, 1, &msg);
+}
+
+static void waitDelivered(size count)
+{
+    while (delivered.load() < count) {
+        sched_yield();
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_Emulator)
+{
+    emulator emu = {};
+    emulator_bus_config configs[TEST_BUSES] = {};
+    FakeDevice devices[TEST_BUSES];
+    spi_transfer xfer = {};
+
+    void setup() override
+    {
+        for (auto& config : configs) {
+            config.scratch_size = SPI_BUS_DEFAULT_SCRATCH;
+            config.queue_entries = 8;
+            config.cpu = EMULATOR_NO_CPU;
+            config.allocator = malloc;
+            config.deallocator = free;
+        }
+        sharedEmu = &emu;
+        delivered = 0;
+        gateOpen = true;
+        received.clear();
+        xfer.len = 4;
+    }
+
+    void teardown() override
+    {
+        gateOpen = true;
+        ENUMS_EQUAL_INT_TEXT(emulator_status_ok, emulator_destruct(&emu), "Cannot destruct shared emulator");
+    }
+
+    void construct()
+    {
+        auto status = emulator_construct(&emu, configs, TEST_BUSES, TEST_MAILBOX);
+        ENUMS_EQUAL_INT_TEXT(emulator_status_ok, status, "Cannot construct shared emulator");
+        for (u32 i = 0; i < TEST_BUSES; ++i) {
+            auto bs = spi_bus_attach(&emulator_bus_at(&emu, i)->bus, TEST_CS, &FAKE_DEVICE_OPS, &devices[i]);
+            ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, bs, "Cannot attach fake device");
+        }
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_Emulator, NullCases)
+{
+    emulator_msg msg = {};
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_construct(nullptr, configs, 1, TEST_MAILBOX));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_construct(&emu, nullptr, 1, TEST_MAILBOX));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_destruct(nullptr));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_set_handler(nullptr, 0, recordMessage, nullptr));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_set_handler(&emu, 0, nullptr, nullptr));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_post(nullptr, 0, 1, &msg));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_post(&emu, 0, 1, nullptr));
+
+    configs[1].allocator = nullptr;
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_construct(&emu, configs, 2, TEST_MAILBOX));
+}
+
+TEST(Ut_Emulator, emulator_construct__ErrorOnWrongParams)
+{
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_construct(&emu, configs, 0, TEST_MAILBOX));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_construct(&emu, configs, EMULATOR_MAX_BUSES + 1, TEST_MAILBOX));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_construct(&emu, configs, 2, 3));
+
+    configs[1].queue_entries = 3;
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_construct(&emu, configs, 2, TEST_MAILBOX));
+    configs[1].queue_entries = 8;
+    configs[1].cpu = CPU_SETSIZE;
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_construct(&emu, configs, 2, TEST_MAILBOX));
+    configs[1].cpu = EMULATOR_NO_CPU;
+
+    configs[1].allocator = FakeMalloc;
+    ENUMS_EQUAL_INT(emulator_status_merror, emulator_construct(&emu, configs, 2, TEST_MAILBOX));
+}
+
+TEST(Ut_Emulator, emulator_construct__BusesRunInParallel)
+{
+    construct();
+
+    for (size round = 0; round < 100; ++round) {
+        for (u32 i = 0; i < TEST_BUSES; ++i) {
+            spi_queue_entry entry = {};
+            entry.cs = TEST_CS;
+            entry.transfers = &xfer;
+            entry.count = 1;
+            ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&emulator_bus_at(&emu, i)->queue, &entry, 1));
+        }
+        for (u32 i = 0; i < TEST_BUSES; ++i) {
+            spi_queue* queue = &emulator_bus_at(&emu, i)->queue;
+            spi_queue_completion completion;
+            size reaped = 0;
+            ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_wait(queue, 1));
+            ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_reap(queue, &completion, 1, &reaped));
+            ENUMS_EQUAL_INT(spi_bus_status_ok, completion.status);
+        }
+    }
+
+    for (u32 i = 0; i < TEST_BUSES; ++i) {
+        UNSIGNED_LONGS_EQUAL(100 * xfer.len, devices[i].mosi.size());
+        UNSIGNED_LONGS_EQUAL(100 * xfer.len, emulator_bus_at(&emu, i)->bus.stats.bytes);
+        UNSIGNED_LONGS_EQUAL(emulator_bus_at(&emu, i)->bus.time_ns, emulator_bus_at(&emu, i)->sched.now_ns);
+    }
+    POINTER_NULL(emulator_bus_at(&emu, TEST_BUSES));
+}
+
+TEST(Ut_Emulator, emulator_post__MessageDeliveredOnReceivingThread)
+{
+    configs[1].cpu = sched_getcpu();
+    construct();
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_set_handler(&emu, TEST_BUSES, recordMessage, nullptr));
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_set_handler(&emu, 1, recordMessage, nullptr));
+
+    spi_queue_entry entry = {};
+    entry.cs = TEST_CS;
+    entry.transfers = &xfer;
+    entry.count = 1;
+    entry.user_data = reinterpret_cast<void*>(42);
+    entry.complete = postOnCompletion;
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&emulator_bus_at(&emu, 0)->queue, &entry, 1));
+
+    waitDelivered(1);
+    UNSIGNED_LONGS_EQUAL(7, received[0].line);
+    UNSIGNED_LONGS_EQUAL(42, received[0].value);
+    CHECK_TRUE(pthread_equal(emulator_bus_at(&emu, 1)->queue.worker, handlerThread));
+    CHECK_EQUAL(configs[1].cpu, handlerCpu);
+}
+
+TEST(Ut_Emulator, emulator_post__BusyWhenMailboxFull)
+{
+    construct();
+    emulator_set_handler(&emu, 2, recordMessage, nullptr);
+    emulator_msg msg = {};
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_post(&emu, 0, TEST_BUSES, &msg));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_post(&emu, TEST_BUSES, 0, &msg));
+
+    /* The handler holds the first message, so the ring is not released until the gate opens */
+    gateOpen = false;
+    for (u64 i = 0; i < TEST_MAILBOX; ++i) {
+        msg.value = i;
+        ENUMS_EQUAL_INT(emulator_status_ok, emulator_post(&emu, 3, 2, &msg));
+    }
+    ENUMS_EQUAL_INT(emulator_status_busy, emulator_post(&emu, 3, 2, &msg));
+
+    gateOpen = true;
+    waitDelivered(TEST_MAILBOX);
+    for (u64 i = 0; i < TEST_MAILBOX; ++i) {
+        UNSIGNED_LONGS_EQUAL(i, received[i].value);
+    }
+    while (emulator_status_busy == emulator_post(&emu, 3, 2, &msg)) {
+        sched_yield();
+    }
+    waitDelivered(TEST_MAILBOX + 1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------ Synchronized mode model ------------------------ */
+/* ------------------------------------------------------------------------- */
+
+#define MODEL_BUSES 3
+#define MODEL_LOOKAHEAD 1000
+
+/* Each bus ticks periodically, talks to its device and raises a line of the next bus. Handled lines feed back into
+ * the state and some of them are answered, so the outcome depends on the exact order of everything */
+struct BusModel
+{
+    emulator* emu;
+    u32 index;
+    u64 period;
+    u64 state;
+    sched_event tick;
+    FakeDevice device;
+    u64 lastSent[MODEL_BUSES];
+    std::vector<u64> trace;
+    size failures;
+};
+
+static void modelPost(BusModel* model, u32 to, u64 time, u64 value)
+{
+    emulator_msg msg = {};
+    msg.time_ns = time > model->lastSent[to] ? time : model->lastSent[to];
+    msg.value = value;
+    model->lastSent[to] = msg.time_ns;
+    if (emulator_status_ok != emulator_post(model->emu, model->index, to, &msg)) {
+        ++model->failures;
+    }
+}
+
+static void modelTick(scheduler* sched, sched_event* event)
+{
+    auto* model = static_cast<BusModel*>(event->ctx);
+    spi_bus* bus = &emulator_bus_at(model->emu, model->index)->bus;
+    if (spi_bus_status_ok != spi_bus_transfer(bus, TEST_CS, nullptr, nullptr, 4)) {
+        ++model->failures;
+    }
+
+    model->state = model->state * 6364136223846793005ull + event->deadline_ns;
+    u64 jitter = (model->state >> 33) % 500;
+    modelPost(model, (model->index + 1) % MODEL_BUSES, event->deadline_ns + MODEL_LOOKAHEAD + jitter,
+              model->state >> 40);
+
+    model->trace.push_back(event->deadline_ns);
+    model->trace.push_back(bus->time_ns);
+    scheduler_schedule(sched, event, event->deadline_ns + model->period);
+}
+
+static void modelHandle(emulator* emu, u32 bus, u32 from, const emulator_msg* msg, void* ctx)
+{
+    auto* model = static_cast<BusModel*>(ctx);
+    emulator_bus* self = emulator_bus_at(emu, bus);
+    model->state = model->state * 31 + msg->value;
+    model->trace.push_back(from);
+    model->trace.push_back(msg->time_ns);
+    model->trace.push_back(msg->value);
+
+    /* The transfer runs far past the lookahead, yet neither this message nor the next one may be handled late */
+    if (self->sched.now_ns != msg->time_ns - 1) {
+        ++model->failures;
+    }
+    if (1 == msg->value % 2) {
+        if (spi_bus_status_ok != spi_bus_transfer(&self->bus, TEST_CS, nullptr, nullptr, 2)) {
+            ++model->failures;
+        }
+        model->trace.push_back(self->bus.time_ns);
+    }
+
+    if (0 == msg->value % 3) {
+        modelPost(model, from, msg->time_ns + MODEL_LOOKAHEAD, model->state >> 40);
+    }
+}
+
+static void runModel(std::vector<std::vector<u64>>& traces, bool parallel, u64 chunk)
+{
+    const u64 until = 2000000;
+    emulator emu = {};
+    emulator_bus_config configs[MODEL_BUSES] = {};
+    BusModel models[MODEL_BUSES];
+
+    for (auto& config : configs) {
+        config.scratch_size = SPI_BUS_DEFAULT_SCRATCH;
+        config.queue_entries = 8;
+        config.cpu = EMULATOR_NO_CPU;
+        config.allocator = malloc;
+        config.deallocator = free;
+    }
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_construct(&emu, configs, MODEL_BUSES, EMULATOR_DEFAULT_MAILBOX));
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_synchronize(&emu, MODEL_LOOKAHEAD));
+
+    for (u32 i = 0; i < MODEL_BUSES; ++i) {
+        BusModel& model = models[i];
+        model.emu = &emu;
+        model.index = i;
+        model.period = 700 + 300 * i;
+        model.state = i + 1;
+        model.failures = 0;
+        std::fill(model.lastSent, model.lastSent + MODEL_BUSES, 0);
+        emulator_bus* eb = emulator_bus_at(&emu, i);
+        spi_bus_attach(&eb->bus, TEST_CS, &FAKE_DEVICE_OPS, &model.device);
+        emulator_set_handler(&emu, i, modelHandle, &model);
+        sched_event_init(&model.tick, modelTick, &model);
+        scheduler_schedule(&eb->sched, &model.tick, model.period);
+    }
+
+    for (u64 t = chunk; t <= until; t += chunk) {
+        auto status = parallel ? emulator_run(&emu, t) : emulator_run_serial(&emu, t);
+        ENUMS_EQUAL_INT(emulator_status_ok, status);
+    }
+
+    traces.clear();
+    for (auto& model : models) {
+        UNSIGNED_LONGS_EQUAL(0, model.failures);
+        UNSIGNED_LONGS_EQUAL(0, emulator_bus_at(&emu, model.index)->overruns);
+        CHECK_TRUE(emulator_bus_at(&emu, model.index)->sched.skipped_ns > 0);
+        CHECK_TRUE(model.device.exchanges > 1000);
+        traces.push_back(model.trace);
+    }
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_destruct(&emu));
+}
+
+TEST(Ut_Emulator, emulator_synchronize__ErrorOnWrongParams)
+{
+    construct();
+    emulator_msg msg = {};
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_synchronize(nullptr, MODEL_LOOKAHEAD));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_run(nullptr, 0));
+    ENUMS_EQUAL_INT(emulator_status_iptr, emulator_run_serial(nullptr, 0));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_run(&emu, 1000));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_run_serial(&emu, 1000));
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_synchronize(&emu, 0));
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_synchronize(&emu, MODEL_LOOKAHEAD));
+
+    /* Too close to the sender and out of order */
+    msg.time_ns = MODEL_LOOKAHEAD;
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_post(&emu, 0, 1, &msg));
+    msg.time_ns = MODEL_LOOKAHEAD + 10;
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_post(&emu, 0, 1, &msg));
+    msg.time_ns = MODEL_LOOKAHEAD + 9;
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_post(&emu, 0, 1, &msg));
+
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_run(&emu, 5000));
+    for (u32 i = 0; i < TEST_BUSES; ++i) {
+        UNSIGNED_LONGS_EQUAL(5000, emulator_bus_at(&emu, i)->sched.now_ns);
+    }
+    ENUMS_EQUAL_INT(emulator_status_cerror, emulator_run(&emu, 4999));
+}
+
+static emulator_status earlyPost;
+static emulator_status onTimePost;
+
+static void postFromEvent(scheduler* sched, sched_event* event)
+{
+    auto* emu = static_cast<emulator*>(event->ctx);
+    emulator_msg msg = {};
+    msg.time_ns = sched->now_ns + MODEL_LOOKAHEAD - 1;
+    earlyPost = emulator_post(emu, 0, 1, &msg);
+    msg.time_ns = sched->now_ns + MODEL_LOOKAHEAD;
+    onTimePost = emulator_post(emu, 0, 1, &msg);
+}
+
+TEST(Ut_Emulator, emulator_post__TimestampFollowsSenderScheduler)
+{
+    construct();
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_synchronize(&emu, MODEL_LOOKAHEAD));
+
+    /* The sender has run to the deadline of the event, well past its clock */
+    sched_event event;
+    sched_event_init(&event, postFromEvent, &emu);
+    scheduler_schedule(&emulator_bus_at(&emu, 0)->sched, &event, 3000);
+    earlyPost = emulator_status_ok;
+    onTimePost = emulator_status_cerror;
+    ENUMS_EQUAL_INT(emulator_status_ok, emulator_run_serial(&emu, 5000));
+
+    ENUMS_EQUAL_INT(emulator_status_cerror, earlyPost);
+    ENUMS_EQUAL_INT(emulator_status_ok, onTimePost);
+}
+
+TEST(Ut_Emulator, emulator_run__OutcomeIdenticalToSerialRun)
+{
+    std::vector<std::vector<u64>> reference;
+    std::vector<std::vector<u64>> traces;
+    runModel(reference, false, 2000000);
+
+    runModel(traces, true, 2000000);
+    CHECK_TRUE(reference == traces);
+    runModel(traces, true, 12500);
+    CHECK_TRUE(reference == traces);
+    runModel(traces, false, 40000);
+    CHECK_TRUE(reference == traces);
+}
@@ -0,0 +1,194 @@
+#include "AllTests.h"
+#include "endian_iterator.h"
+#include "array_iterator.h"
+#include "packed_iterator.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------- Private variables ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static const u16 TEST_ARRAY_U16[] = {0x1234, 0xABCD, 0x00FF};
+static const u32 TEST_ARRAY_U32[] = {0x12345678, 0xCAFEBABE};
+static const u64 TEST_ARRAY_U64[] = {0x0102030405060708};
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_EndianIterator)
+{
+    iterator_instance source = {};
+    iterator_instance iter = {};
+
+    void setup() override
+    {
+        auto status = iterator_construct(&iter, sizeof(endian_iterator_ctx));
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot construct shared iterator");
+        status = iterator_init_as_const(&iter, endian_iterator_begin, endian_iterator_next, endian_iterator_end);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot initialize shared iterator");
+    }
+
+    void teardown() override
+    {
+        auto status = iterator_destruct(&iter);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot destruct shared iterator");
+
+        status = iterator_destruct(&source);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot destruct source iterator");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_EndianIterator, NullCases)
+{
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U16, 3, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_iptr, endian_iterator_init_ctx(nullptr, &source, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_iptr, endian_iterator_init_ctx(&iter, nullptr, sizeof(u16)));
+    CHECK_FALSE(endian_iterator_create(nullptr, &source, sizeof(u16)));
+}
+
+TEST(Ut_EndianIterator, endian_iterator_init_ctx__ErrorOnWrongParams)
+{
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U16, 3, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_cerror, endian_iterator_init_ctx(&iter, &source, 3));
+    ENUMS_EQUAL_INT(endian_iterator_status_cerror, endian_iterator_init_ctx(&iter, &source, 1));
+
+    /* Non-const source is not supported */
+    u16 mutableArray[2] = {};
+    iterator_instance nonConst;
+    CHECK_TRUE(array_iterator_create(&nonConst, mutableArray, 2, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_cerror, endian_iterator_init_ctx(&iter, &nonConst, sizeof(u16)));
+    iterator_destruct(&nonConst);
+}
+
+TEST(Ut_EndianIterator, ITERATOR_FOREACH_CONST__U16Swapped)
+{
+    const u16 expected[] = {0x3412, 0xCDAB, 0xFF00};
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U16, 3, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u16)));
+
+    size i = 0;
+    ITERATOR_FOREACH_CONST(v, iter) {
+        UNSIGNED_LONGS_EQUAL(expected[i], *static_cast<const u16*>(v));
+        ++i;
+    }
+    UNSIGNED_LONGS_EQUAL(3, i);
+}
+
+TEST(Ut_EndianIterator, ITERATOR_FOREACH_CONST__U32AndU64Swapped)
+{
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U32, 2, sizeof(u32)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u32)));
+    auto v = ITERATOR_CBEGIN(iter);
+    UNSIGNED_LONGS_EQUAL(0x78563412, *static_cast<const u32*>(v));
+    v = ITERATOR_CNEXT(iter);
+    UNSIGNED_LONGS_EQUAL(0xBEBAFECA, *static_cast<const u32*>(v));
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CNEXT(iter));
+    iterator_destruct(&source);
+
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U64, 1, sizeof(u64)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u64)));
+    v = ITERATOR_CBEGIN(iter);
+    CHECK_TRUE(0x0807060504030201 == *static_cast<const u64*>(v));
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CNEXT(iter));
+}
+
+TEST(Ut_EndianIterator, ITERATOR_FOREACH_CONST__ManyBlocksFromArray)
+{
+    const size count = 5 * ENDIAN_ITERATOR_BLOCK + 3;
+    std::vector<u32> values(count);
+    for (size i = 0; i < count; ++i) {
+        values[i] = static_cast<u32>(i * 0x01010101u);
+    }
+    CHECK_TRUE(array_iterator_create_const(&source, values.data(), count, sizeof(u32)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u32)));
+
+    /* Traverse twice to make sure the iterator is reusable */
+    for (int pass = 0; pass < 2; ++pass) {
+        size i = 0;
+        ITERATOR_FOREACH_CONST(v, iter) {
+            UNSIGNED_LONGS_EQUAL(__builtin_bswap32(values[i]), *static_cast<const u32*>(v));
+            ++i;
+        }
+        UNSIGNED_LONGS_EQUAL(count, i);
+    }
+}
+
+TEST(Ut_EndianIterator, ITERATOR_FOREACH_CONST__GenericSource)
+{
+    /* 16-bit packed fields are big-endian, so swapping them gives the raw little-endian view of the bytes */
+    const size count = 2 * ENDIAN_ITERATOR_BLOCK + 1;
+    std::vector<u8> packed(count * 2);
+    for (size i = 0; i < packed.size(); ++i) {
+        packed[i] = static_cast<u8>(i);
+    }
+    CHECK_TRUE(packed_iterator_create(&source, packed.data(), count, 16));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u16)));
+
+    size i = 0;
+    ITERATOR_FOREACH_CONST(v, iter) {
+        u16 expected = static_cast<u16>(packed[2 * i] | (packed[2 * i + 1] << 8));
+        UNSIGNED_LONGS_EQUAL(expected, *static_cast<const u16*>(v));
+        ++i;
+    }
+    UNSIGNED_LONGS_EQUAL(count, i);
+}
+
+TEST(Ut_EndianIterator, endian_iterator_init_ctx__ErrorOnArrayElementSizeMismatch)
+{
+    /* Two u8 elements must not be read as two u16 */
+    static const u8 bytes[2] = {0x12, 0x34};
+    CHECK_TRUE(array_iterator_create_const(&source, bytes, sizeof(bytes), sizeof(u8)));
+    ENUMS_EQUAL_INT(endian_iterator_status_cerror, endian_iterator_init_ctx(&iter, &source, sizeof(u16)));
+    iterator_destruct(&source);
+
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U32, 2, sizeof(u32)));
+    ENUMS_EQUAL_INT(endian_iterator_status_cerror, endian_iterator_init_ctx(&iter, &source, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u32)));
+
+    /* The source re-initialized with other elements after the check yields nothing */
+    array_iterator_init_const_ctx(&source, bytes, sizeof(bytes), sizeof(u8));
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CBEGIN(iter));
+}
+
+TEST(Ut_EndianIterator, endian_iterator_begin__EmptySource)
+{
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U16, 0, sizeof(u16)));
+    ENUMS_EQUAL_INT(endian_iterator_status_ok, endian_iterator_init_ctx(&iter, &source, sizeof(u16)));
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CBEGIN(iter));
+}
+
+TEST(Ut_EndianIterator, endian_swap__InPlaceConversion)
+{
+    for (size elementSize : {2, 4, 8}) {
+        /* Odd length so both the vector loop and the scalar tail are exercised */
+        std::vector<u8> buffer(elementSize * 37);
+        for (size i = 0; i < buffer.size(); ++i) {
+            buffer[i] = static_cast<u8>(i * 7);
+        }
+        auto original = buffer;
+
+        endian_swap(buffer.data(), buffer.data(), 37, elementSize);
+        for (size i = 0; i < buffer.size(); ++i) {
+            size element = i / elementSize;
+            size mirrored = element * elementSize + elementSize - 1 - i % elementSize;
+            UNSIGNED_LONGS_EQUAL(original[mirrored], buffer[i]);
+        }
+    }
+}
+
+TEST(Ut_EndianIterator, endian_iterator_create__CreatesValidIterator)
+{
+    CHECK_TRUE(array_iterator_create_const(&source, TEST_ARRAY_U16, 3, sizeof(u16)));
+
+    iterator_instance created;
+    CHECK_TRUE(endian_iterator_create(&created, &source, sizeof(u16)));
+    UNSIGNED_LONGS_EQUAL(0x3412, *static_cast<const u16*>(ITERATOR_CBEGIN(created)));
+    ENUMS_EQUAL_INT(iterator_status_ok, iterator_destruct(&created));
+
+    CHECK_FALSE(endian_iterator_create(&created, &source, 5));
+}
@@ -1,5 +1,46 @@
 #include "Fakes.h"
 
+/* ------------------------------------------------------------------------- */
+/* --------------------------- Private functions --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void FakeDeviceSelect(void* device)
+{
+    ++static_cast<FakeDevice*>(device)->selects;
+}
+
+static void FakeDeviceExchange(void* device, const iterator_instance* mosi, u8* miso, size len)
+{
+    auto fake = static_cast<FakeDevice*>(device);
+    ++fake->exchanges;
+    if (nullptr != device_mosi_array(mosi)) {
+        ++fake->contiguous;
+    }
+
+    size offset = fake->mosi.size();
+    fake->mosi.resize(offset + len);
+    device_mosi_read(mosi, &fake->mosi[offset], len);
+    for (size i = 0; i < len; ++i) {
+        miso[i] = static_cast<u8>(~fake->mosi[offset + i]);
+    }
+}
+
+static void FakeDeviceDeselect(void* device)
+{
+    ++static_cast<FakeDevice*>(device)->deselects;
+}
+
+static void FakeDeviceTiming(void* device, const spi_cycle* cycle)
+{
+    static_cast<FakeDevice*>(device)->cycles.push_back(*cycle);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Global variables --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+const spi_device_ops FAKE_DEVICE_OPS = {FakeDeviceSelect, FakeDeviceExchange, FakeDeviceDeselect, FakeDeviceTiming};
+
 /* ------------------------------------------------------------------------- */
 /* ----------------------------- Api functions ----------------------------- */
 /* ------------------------------------------------------------------------- */
@@ -2,6 +2,34 @@
 #define SPI_EMULATOR_FAKES_H
 
 #include "type.h"
+#include "spi_bus.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Data types ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/**
+ * Fake device model state.
+ *
+ * The device records every MOSI byte and answers with the bitwise complement of it.
+ */
+struct FakeDevice
+{
+    std::vector<u8> mosi; /**< All bytes received so far */
+    size selects = 0; /**< The number of select calls */
+    size deselects = 0; /**< The number of deselect calls */
+    size exchanges = 0; /**< The number of exchange calls */
+    size contiguous = 0; /**< The number of exchange calls with MOSI given as a byte array */
+    std::vector<spi_cycle> cycles; /**< Word timing reported by a cycle-accurate bus */
+};
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Global variables --------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/** Operations of the fake device model. Device state must point to FakeDevice */
+extern const spi_device_ops FAKE_DEVICE_OPS;
 
 /* ------------------------------------------------------------------------- */
 /* ----------------------------- Api functions ----------------------------- */
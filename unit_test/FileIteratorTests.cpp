@@ -0,0 +1,127 @@
+#include "AllTests.h"
+#include "file_iterator.h"
+#include <cstdio>
+#include <unistd.h>
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Collect all bytes and the number of chunks */
+static std::vector<u8> drain(iterator_instance& iter, size& chunks)
+{
+    std::vector<u8> out;
+    chunks = 0;
+    ITERATOR_FOREACH_CONST(c, iter) {
+        auto span = static_cast<const iterator_span*>(c);
+        auto data = static_cast<const u8*>(span->data);
+        out.insert(out.end(), data, data + span->len);
+        ++chunks;
+    }
+    return out;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_FileIterator)
+{
+    char path[32] = {};
+    iterator_instance iter = {};
+
+    void setup() override
+    {
+        snprintf(path, sizeof(path), "/tmp/spi_emulatorXXXXXX");
+        int fd = mkstemp(path);
+        CHECK_TRUE_TEXT(0 <= fd, "Cannot create temporary file");
+        close(fd);
+    }
+
+    void teardown() override
+    {
+        auto status = file_iterator_destroy(&iter);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot destroy shared iterator");
+        unlink(path);
+    }
+
+    std::vector<u8> writeFile(size len)
+    {
+        std::vector<u8> content(len);
+        for (size i = 0; i < len; ++i) {
+            content[i] = static_cast<u8>(i * 31 + i / 256);
+        }
+        FILE* f = fopen(path, "wb");
+        CHECK_TRUE(nullptr != f);
+        UNSIGNED_LONGS_EQUAL(len, fwrite(content.data(), 1, len, f));
+        fclose(f);
+        return content;
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_FileIterator, NullCases)
+{
+    ENUMS_EQUAL_INT(file_iterator_status_iptr, file_iterator_init_ctx(nullptr, 0, 16));
+    CHECK_FALSE(file_iterator_create(nullptr, path, 16));
+    CHECK_FALSE(file_iterator_create(&iter, nullptr, 16));
+    ENUMS_EQUAL_INT(iterator_status_iptr, file_iterator_destroy(nullptr));
+}
+
+TEST(Ut_FileIterator, file_iterator_create__ErrorOnWrongParams)
+{
+    CHECK_FALSE(file_iterator_create(&iter, "/nonexistent/spi_emulator/capture.bin", 16));
+    CHECK_FALSE(file_iterator_create(&iter, path, 0));
+}
+
+TEST(Ut_FileIterator, ITERATOR_FOREACH_CONST__WholeFileReadInChunks)
+{
+    auto content = writeFile(10 * 1000 + 7);
+    CHECK_TRUE(file_iterator_create(&iter, path, 1000));
+
+    size chunks;
+    auto bytes = drain(iter, chunks);
+    CHECK_TRUE(content == bytes);
+    UNSIGNED_LONGS_EQUAL(11, chunks);
+
+    auto ctx = static_cast<file_iterator_ctx*>(iter.context);
+    CHECK_FALSE(ctx->error);
+}
+
+TEST(Ut_FileIterator, ITERATOR_FOREACH_CONST__TraversalRestartsFromBeginning)
+{
+    auto content = writeFile(4096);
+    CHECK_TRUE(file_iterator_create(&iter, path, 512));
+
+    /* Abandon the first traversal in the middle */
+    ITERATOR_CBEGIN(iter);
+    ITERATOR_CNEXT(iter);
+
+    size chunks;
+    auto bytes = drain(iter, chunks);
+    CHECK_TRUE(content == bytes);
+    UNSIGNED_LONGS_EQUAL(8, chunks);
+}
+
+TEST(Ut_FileIterator, file_iterator_begin__EmptyFile)
+{
+    CHECK_TRUE(file_iterator_create(&iter, path, 64));
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CBEGIN(iter));
+
+    /* Calling next past the end is harmless */
+    POINTERS_EQUAL(ITERATOR_CEND(iter), ITERATOR_CNEXT(iter));
+}
+
+TEST(Ut_FileIterator, file_iterator_destroy__DestroyWhileReaderIsWaiting)
+{
+    writeFile(100 * 64);
+    CHECK_TRUE(file_iterator_create(&iter, path, 64));
+    auto span = static_cast<const iterator_span*>(ITERATOR_CBEGIN(iter));
+    UNSIGNED_LONGS_EQUAL(64, span->len);
+
+    /* The reader has filled the second buffer and waits for the first one - teardown must not hang */
+}
@@ -0,0 +1,165 @@
+#include "AllTests.h"
+#include "generator_iterator.h"
+#include <cstring>
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_CHUNK_SIZE 64
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Collect all generated bytes and the number of chunks */
+static std::vector<u8> drain(iterator_instance& iter, size& chunks)
+{
+    std::vector<u8> out;
+    chunks = 0;
+    ITERATOR_FOREACH_CONST(c, iter) {
+        auto span = static_cast<const iterator_span*>(c);
+        auto data = static_cast<const u8*>(span->data);
+        out.insert(out.end(), data, data + span->len);
+        ++chunks;
+    }
+    return out;
+}
+
+/* Reference PRBS implementation producing one bit per step */
+static std::vector<u8> referencePrbs(u32 order, u32 tap, u32 seed, size len)
+{
+    std::vector<u8> out(len);
+    u32 lfsr = seed;
+    for (auto& byte : out) {
+        for (int b = 0; b < 8; ++b) {
+            u32 bit = ((lfsr >> (order - 1)) ^ (lfsr >> (tap - 1))) & 1;
+            lfsr = ((lfsr << 1) | bit) & ((1u << order) - 1);
+            byte = static_cast<u8>((byte << 1) | bit);
+        }
+    }
+    return out;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_GeneratorIterator)
+{
+    iterator_instance iter = {};
+
+    void setup() override {}
+
+    void teardown() override
+    {
+        auto status = iterator_destruct(&iter);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot destruct shared iterator");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_GeneratorIterator, NullCases)
+{
+    generator_constant_state state = {0xFF};
+    ENUMS_EQUAL_INT(generator_iterator_status_iptr,
+                    generator_iterator_init_ctx(nullptr, generator_constant, &state, TEST_CHUNK_SIZE, 0));
+
+    CHECK_TRUE(generator_iterator_create(&iter, generator_constant, &state, TEST_CHUNK_SIZE, 0));
+    ENUMS_EQUAL_INT(generator_iterator_status_iptr,
+                    generator_iterator_init_ctx(&iter, nullptr, &state, TEST_CHUNK_SIZE, 0));
+    ENUMS_EQUAL_INT(generator_iterator_status_iptr, generator_prbs_init(nullptr, 7, 1));
+}
+
+TEST(Ut_GeneratorIterator, generator_iterator_init_ctx__ErrorOnWrongParams)
+{
+    generator_constant_state state = {0xFF};
+    CHECK_FALSE(generator_iterator_create(&iter, generator_constant, &state, 0, 0));
+
+    generator_prbs_state prbs;
+    ENUMS_EQUAL_INT(generator_iterator_status_cerror, generator_prbs_init(&prbs, 9, 1));
+    ENUMS_EQUAL_INT(generator_iterator_status_cerror, generator_prbs_init(&prbs, 7, 0x80));
+}
+
+TEST(Ut_GeneratorIterator, ITERATOR_FOREACH_CONST__ConstantBytesUpToLimit)
+{
+    generator_constant_state state = {0xFF};
+    const size limit = 3 * TEST_CHUNK_SIZE + 10;
+    CHECK_TRUE(generator_iterator_create(&iter, generator_constant, &state, TEST_CHUNK_SIZE, limit));
+
+    size chunks;
+    auto bytes = drain(iter, chunks);
+    UNSIGNED_LONGS_EQUAL(limit, bytes.size());
+    UNSIGNED_LONGS_EQUAL(4, chunks);
+    for (auto b : bytes) {
+        UNSIGNED_LONGS_EQUAL(0xFF, b);
+    }
+
+    /* Begin starts counting from zero again */
+    bytes = drain(iter, chunks);
+    UNSIGNED_LONGS_EQUAL(limit, bytes.size());
+}
+
+TEST(Ut_GeneratorIterator, ITERATOR_FOREACH_CONST__CounterContinuesAcrossChunks)
+{
+    generator_counter_state state = {250};
+    CHECK_TRUE(generator_iterator_create(&iter, generator_counter, &state, 4, 10));
+
+    size chunks;
+    auto bytes = drain(iter, chunks);
+    CHECK_TRUE((std::vector<u8>{250, 251, 252, 253, 254, 255, 0, 1, 2, 3}) == bytes);
+    UNSIGNED_LONGS_EQUAL(3, chunks);
+}
+
+TEST(Ut_GeneratorIterator, ITERATOR_FOREACH_CONST__GeneratorEndsSequence)
+{
+    /* Generator producing 5 bytes in total, regardless of the requested length */
+    static size left;
+    left = 5;
+    auto fill = [](void* user, u8* buffer, size len) -> size {
+        static_cast<void>(user);
+        size n = len < left ? len : left;
+        for (size i = 0; i < n; ++i) {
+            buffer[i] = 0xA5;
+        }
+        left -= n;
+        return n;
+    };
+    CHECK_TRUE(generator_iterator_create(&iter, fill, nullptr, 2, 0));
+
+    size chunks;
+    auto bytes = drain(iter, chunks);
+    UNSIGNED_LONGS_EQUAL(5, bytes.size());
+    UNSIGNED_LONGS_EQUAL(3, chunks);
+}
+
+TEST(Ut_GeneratorIterator, generator_prbs__MatchesBitwiseReference)
+{
+    const std::vector<std::pair<u8, u8>> polynomials = {{7, 6}, {15, 14}, {23, 18}, {31, 28}};
+    for (auto& p : polynomials) {
+        generator_prbs_state state;
+        ENUMS_EQUAL_INT(generator_iterator_status_ok, generator_prbs_init(&state, p.first, 0x5A5A5A5A));
+        CHECK_TRUE(generator_iterator_create(&iter, generator_prbs, &state, TEST_CHUNK_SIZE, 1000));
+
+        size chunks;
+        auto bytes = drain(iter, chunks);
+        u32 seed = 0x5A5A5A5Au & ((1u << p.first) - 1);
+        CHECK_TRUE(referencePrbs(p.first, p.second, seed, 1000) == bytes);
+        iterator_destruct(&iter);
+    }
+}
+
+TEST(Ut_GeneratorIterator, generator_prbs__Prbs7RepeatsAfterMaximalPeriod)
+{
+    /* The period is 127 bits, therefore the byte sequence repeats after 127 bytes */
+    generator_prbs_state state;
+    ENUMS_EQUAL_INT(generator_iterator_status_ok, generator_prbs_init(&state, 7, 1));
+    u8 bytes[2 * 127];
+    generator_prbs(&state, bytes, sizeof(bytes));
+    MEMCMP_EQUAL(bytes, bytes + 127, 127);
+    CHECK_TRUE(0 != memcmp(bytes, bytes + 1, 126));
+}
@@ -0,0 +1,239 @@
+#include "AllTests.h"
+#include "list.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Data types ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Example structures embedding list nodes */
+struct SDevice
+{
+    u32 id;
+    slist_node node;
+};
+
+struct DDevice
+{
+    u32 id;
+    dlist_node node;
+};
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_List)
+{
+    slist sl = {};
+    dlist dl = {};
+    SDevice sdevs[5] = {};
+    DDevice ddevs[5] = {};
+
+    void setup() override
+    {
+        ENUMS_EQUAL_INT(list_status_ok, slist_init(&sl));
+        ENUMS_EQUAL_INT(list_status_ok, dlist_init(&dl));
+        for (u32 i = 0; i < 5; ++i) {
+            sdevs[i].id = i;
+            ddevs[i].id = i;
+        }
+    }
+
+    void teardown() override {}
+
+    std::vector<u32> collect(slist_node* const* head)
+    {
+        std::vector<u32> ids;
+        for (slist_node* n = *head; nullptr != n; n = n->next) {
+            ids.push_back(LIST_ENTRY(n, SDevice, node)->id);
+        }
+        return ids;
+    }
+
+    std::vector<u32> collectDoubly()
+    {
+        std::vector<u32> ids;
+        for (slist_node* n = dl.head; nullptr != n; n = n->next) {
+            ids.push_back(LIST_ENTRY(reinterpret_cast<dlist_node*>(n), DDevice, node)->id);
+        }
+        return ids;
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_List, NullCases)
+{
+    ENUMS_EQUAL_INT(list_status_iptr, slist_init(nullptr));
+    ENUMS_EQUAL_INT(list_status_iptr, slist_push_front(nullptr, &sdevs[0].node));
+    ENUMS_EQUAL_INT(list_status_iptr, slist_push_back(&sl, nullptr));
+    ENUMS_EQUAL_INT(list_status_iptr, slist_remove(&sl, nullptr));
+    POINTER_NULL(slist_pop_front(nullptr));
+
+    ENUMS_EQUAL_INT(list_status_iptr, dlist_init(nullptr));
+    ENUMS_EQUAL_INT(list_status_iptr, dlist_push_front(&dl, nullptr));
+    ENUMS_EQUAL_INT(list_status_iptr, dlist_push_back(nullptr, &ddevs[0].node));
+    ENUMS_EQUAL_INT(list_status_iptr, dlist_remove(nullptr, &ddevs[0].node));
+    ENUMS_EQUAL_INT(list_status_iptr, dlist_splice(&dl, nullptr));
+    POINTER_NULL(dlist_pop_front(nullptr));
+
+    iterator_instance iter;
+    ENUMS_EQUAL_INT(list_status_iptr, list_iterator_init_ctx(nullptr, &sl.head, 0));
+    ENUMS_EQUAL_INT(list_status_iptr, list_iterator_init_ctx(&iter, nullptr, 0));
+    CHECK_FALSE(list_iterator_create(&iter, nullptr, 0));
+}
+
+TEST(Ut_List, slist__PushPopAndRemove)
+{
+    slist_push_back(&sl, &sdevs[1].node);
+    slist_push_back(&sl, &sdevs[2].node);
+    slist_push_front(&sl, &sdevs[0].node);
+    CHECK_TRUE((std::vector<u32>{0, 1, 2}) == collect(&sl.head));
+    UNSIGNED_LONGS_EQUAL(3, sl.count);
+
+    /* Remove the tail, then append again */
+    ENUMS_EQUAL_INT(list_status_ok, slist_remove(&sl, &sdevs[2].node));
+    POINTERS_EQUAL(&sdevs[1].node, sl.tail);
+    slist_push_back(&sl, &sdevs[3].node);
+    CHECK_TRUE((std::vector<u32>{0, 1, 3}) == collect(&sl.head));
+
+    /* Node which is not on the list */
+    ENUMS_EQUAL_INT(list_status_cerror, slist_remove(&sl, &sdevs[4].node));
+
+    POINTERS_EQUAL(&sdevs[0].node, slist_pop_front(&sl));
+    POINTERS_EQUAL(&sdevs[1].node, slist_pop_front(&sl));
+    POINTERS_EQUAL(&sdevs[3].node, slist_pop_front(&sl));
+    POINTER_NULL(slist_pop_front(&sl));
+    POINTER_NULL(sl.tail);
+    UNSIGNED_LONGS_EQUAL(0, sl.count);
+}
+
+TEST(Ut_List, dlist__PushPopAndRemove)
+{
+    for (auto& d : ddevs) {
+        dlist_push_back(&dl, &d.node);
+    }
+    CHECK_TRUE((std::vector<u32>{0, 1, 2, 3, 4}) == collectDoubly());
+
+    /* Remove from the middle, the head and the tail */
+    dlist_remove(&dl, &ddevs[2].node);
+    dlist_remove(&dl, &ddevs[0].node);
+    dlist_remove(&dl, &ddevs[4].node);
+    CHECK_TRUE((std::vector<u32>{1, 3}) == collectDoubly());
+    POINTERS_EQUAL(&ddevs[3].node, dl.tail);
+    POINTERS_EQUAL(&ddevs[1].node, ddevs[3].node.prev);
+    UNSIGNED_LONGS_EQUAL(2, dl.count);
+
+    dlist_push_front(&dl, &ddevs[0].node);
+    POINTERS_EQUAL(&ddevs[0].node, dlist_pop_front(&dl));
+    POINTERS_EQUAL(&ddevs[1].node, dlist_pop_front(&dl));
+    POINTERS_EQUAL(&ddevs[3].node, dlist_pop_front(&dl));
+    POINTER_NULL(dlist_pop_front(&dl));
+    POINTER_NULL(dl.tail);
+}
+
+TEST(Ut_List, dlist_splice__NodesMoved)
+{
+    dlist other;
+    dlist_init(&other);
+    dlist_push_back(&dl, &ddevs[0].node);
+    dlist_push_back(&other, &ddevs[1].node);
+    dlist_push_back(&other, &ddevs[2].node);
+
+    ENUMS_EQUAL_INT(list_status_ok, dlist_splice(&dl, &other));
+    CHECK_TRUE((std::vector<u32>{0, 1, 2}) == collectDoubly());
+    UNSIGNED_LONGS_EQUAL(3, dl.count);
+    POINTERS_EQUAL(&ddevs[0].node, ddevs[1].node.prev);
+    POINTER_NULL(other.head);
+    UNSIGNED_LONGS_EQUAL(0, other.count);
+}
+
+TEST(Ut_List, ITERATOR_FOREACH__AllNodesVisitedWithAndWithoutPrefetch)
+{
+    for (auto& d : sdevs) {
+        slist_push_back(&sl, &d.node);
+    }
+
+    for (size distance : {0, 1, 4, 100}) {
+        iterator_instance iter;
+        CHECK_TRUE(list_iterator_create(&iter, &sl.head, distance));
+        u32 expected = 0;
+        ITERATOR_FOREACH(n, iter) {
+            auto dev = LIST_ENTRY(static_cast<slist_node*>(n), SDevice, node);
+            UNSIGNED_LONGS_EQUAL(expected, dev->id);
+            ++expected;
+        }
+        UNSIGNED_LONGS_EQUAL(5, expected);
+        iterator_destruct(&iter);
+    }
+}
+
+TEST(Ut_List, ITERATOR_FOREACH_CONST__DoublyLinkedListTraversed)
+{
+    for (auto& d : ddevs) {
+        dlist_push_front(&dl, &d.node);
+    }
+
+    iterator_instance iter;
+    CHECK_TRUE(list_iterator_create_const(&iter, &dl.head, LIST_ITERATOR_DEFAULT_PREFETCH));
+    u32 expected = 4;
+    size visited = 0;
+    ITERATOR_FOREACH_CONST(n, iter) {
+        auto node = reinterpret_cast<const dlist_node*>(n);
+        UNSIGNED_LONGS_EQUAL(expected, LIST_ENTRY(node, const DDevice, node)->id);
+        --expected;
+        ++visited;
+    }
+    UNSIGNED_LONGS_EQUAL(5, visited);
+
+    /* The head is read on each traversal */
+    dlist_remove(&dl, &ddevs[4].node);
+    POINTERS_EQUAL(&ddevs[3].node, ITERATOR_CBEGIN(iter));
+    iterator_destruct(&iter);
+}
+
+TEST(Ut_List, ITERATOR_FOREACH__CurrentNodeRemovedWhileIterating)
+{
+    for (size distance : {0, 1, 4}) {
+        for (auto& d : sdevs) {
+            slist_push_back(&sl, &d.node);
+        }
+        iterator_instance iter;
+        CHECK_TRUE(list_iterator_create(&iter, &sl.head, distance));
+        u32 expected = 0;
+        ITERATOR_FOREACH(n, iter) {
+            UNSIGNED_LONGS_EQUAL(expected, LIST_ENTRY(static_cast<slist_node*>(n), SDevice, node)->id);
+            ENUMS_EQUAL_INT(list_status_ok, slist_remove(&sl, static_cast<slist_node*>(n)));
+            ++expected;
+        }
+        UNSIGNED_LONGS_EQUAL(5, expected);
+        POINTER_NULL(sl.head);
+        iterator_destruct(&iter);
+    }
+
+    /* Every other node of a doubly linked list */
+    for (auto& d : ddevs) {
+        dlist_push_back(&dl, &d.node);
+    }
+    iterator_instance iter;
+    CHECK_TRUE(list_iterator_create(&iter, &dl.head, 0));
+    ITERATOR_FOREACH(n, iter) {
+        auto node = reinterpret_cast<dlist_node*>(n);
+        if (0 == LIST_ENTRY(node, DDevice, node)->id % 2) {
+            dlist_remove(&dl, node);
+        }
+    }
+    CHECK_TRUE((std::vector<u32>{1, 3}) == collectDoubly());
+    iterator_destruct(&iter);
+}
+
+TEST(Ut_List, ITERATOR_FOREACH__EmptyList)
+{
+    iterator_instance iter;
+    CHECK_TRUE(list_iterator_create(&iter, &sl.head, LIST_ITERATOR_DEFAULT_PREFETCH));
+    POINTERS_EQUAL(ITERATOR_END(iter), ITERATOR_BEGIN(iter));
+    iterator_destruct(&iter);
+}
@@ -0,0 +1,173 @@
+#include "AllTests.h"
+#include "packed_iterator.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* -------------------------- Private variables ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Four 12-bit samples: 0xABC, 0xDEF, 0x123, 0x456 */
+static const u8 TEST_PACKED_12[] = {0xAB, 0xCD, 0xEF, 0x12, 0x34, 0x56};
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Reference implementation reading the fields bit by bit */
+static std::vector<u16> referenceUnpack(const std::vector<u8>& packed, size fields, u8 width)
+{
+    std::vector<u16> out(fields);
+    for (size i = 0; i < fields; ++i) {
+        u16 value = 0;
+        for (size b = 0; b < width; ++b) {
+            size bit = i * width + b;
+            value = static_cast<u16>((value << 1) | ((packed[bit / 8] >> (7 - bit % 8)) & 1));
+        }
+        out[i] = value;
+    }
+    return out;
+}
+
+static std::vector<u8> randomBytes(size len)
+{
+    std::vector<u8> bytes(len);
+    u32 state = 0x12345678;
+    for (auto& b : bytes) {
+        state = state * 1103515245 + 12345;
+        b = static_cast<u8>(state >> 16);
+    }
+    return bytes;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_PackedIterator)
+{
+    iterator_instance iter = {};
+
+    void setup() override
+    {
+        auto status = iterator_construct(&iter, sizeof(packed_iterator_ctx));
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot construct shared iterator");
+        status = iterator_init_as_const(&iter, packed_iterator_begin, packed_iterator_next, packed_iterator_end);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot initialize shared iterator");
+    }
+
+    void teardown() override
+    {
+        auto status = iterator_destruct(&iter);
+        ENUMS_EQUAL_INT_TEXT(iterator_status_ok, status, "Cannot destruct shared iterator");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_PackedIterator, NullCases)
+{
+    ENUMS_EQUAL_INT(packed_iterator_status_iptr, packed_iterator_init_ctx(nullptr, TEST_PACKED_12, 4, 12));
+    ENUMS_EQUAL_INT(packed_iterator_status_iptr, packed_iterator_init_ctx(&iter, nullptr, 4, 12));
+    CHECK_FALSE(packed_iterator_create(nullptr, TEST_PACKED_12, 4, 12));
+}
+
+TEST(Ut_PackedIterator, packed_iterator_init_ctx__ErrorOnWrongParams)
+{
+    ENUMS_EQUAL_INT(packed_iterator_status_cerror, packed_iterator_init_ctx(&iter, TEST_PACKED_12, 4, 0));
+    ENUMS_EQUAL_INT(packed_iterator_status_cerror, packed_iterator_init_ctx(&iter, TEST_PACKED_12, 4, 17));
+
+    iterator_instance nonConst = {};
+    nonConst.type = iterator_type_non_const;
+    nonConst.context = iter.context;
+    ENUMS_EQUAL_INT(packed_iterator_status_cerror, packed_iterator_init_ctx(&nonConst, TEST_PACKED_12, 4, 12));
+}
+
+TEST(Ut_PackedIterator, ITERATOR_FOREACH_CONST__TwelveBitSamplesUnpacked)
+{
+    const u16 expected[] = {0xABC, 0xDEF, 0x123, 0x456};
+    ENUMS_EQUAL_INT(packed_iterator_status_ok, packed_iterator_init_ctx(&iter, TEST_PACKED_12, 4, 12));
+
+    size i = 0;
+    ITERATOR_FOREACH_CONST(sample, iter) {
+        UNSIGNED_LONGS_EQUAL(expected[i], *static_cast<const u16*>(sample));
+        ++i;
+    }
+    UNSIGNED_LONGS_EQUAL(4, i);
+}
+
+TEST(Ut_PackedIterator, packed_iterator_begin__EmptyArray)
+{
+    ENUMS_EQUAL_INT(packed_iterator_status_ok, packed_iterator_init_ctx(&iter, TEST_PACKED_12, 0, 12));
+    POINTERS_EQUAL(ITERATOR_CBEGIN(iter), ITERATOR_CEND(iter));
+}
+
+TEST(Ut_PackedIterator, ITERATOR_FOREACH_CONST__MultipleBlocksVisited)
+{
+    for (u8 width : {10, 12, 14, 7}) {
+        const size fields = 3 * PACKED_ITERATOR_BLOCK + 5;
+        auto packed = randomBytes(packed_bytes(fields, width));
+        auto expected = referenceUnpack(packed, fields, width);
+
+        ENUMS_EQUAL_INT(packed_iterator_status_ok, packed_iterator_init_ctx(&iter, packed.data(), fields, width));
+        size i = 0;
+        ITERATOR_FOREACH_CONST(sample, iter) {
+            UNSIGNED_LONGS_EQUAL(expected[i], *static_cast<const u16*>(sample));
+            ++i;
+        }
+        UNSIGNED_LONGS_EQUAL(fields, i);
+    }
+}
+
+TEST(Ut_PackedIterator, packed_unpack__AllWidthsMatchReference)
+{
+    for (u8 width = 1; width <= PACKED_ITERATOR_MAX_WIDTH; ++width) {
+        /* Odd number of fields so both the vector loop and the scalar tail are exercised */
+        const size fields = 101;
+        auto packed = randomBytes(packed_bytes(fields, width));
+        auto expected = referenceUnpack(packed, fields, width);
+
+        std::vector<u16> actual(fields);
+        packed_unpack(packed.data(), actual.data(), fields, width);
+        for (size i = 0; i < fields; ++i) {
+            UNSIGNED_LONGS_EQUAL_TEXT(expected[i], actual[i], "Unpacked field differs");
+        }
+    }
+}
+
+TEST(Ut_PackedIterator, packed_pack__RoundTrip)
+{
+    for (u8 width : {10, 12, 14}) {
+        const size fields = 77;
+        auto packed = randomBytes(packed_bytes(fields, width));
+        /* Clear padding bits so the buffers can be compared directly */
+        size padding = packed.size() * 8 - fields * width;
+        packed.back() = static_cast<u8>(packed.back() & (0xFF << padding));
+
+        std::vector<u16> unpacked(fields);
+        packed_unpack(packed.data(), unpacked.data(), fields, width);
+
+        std::vector<u8> repacked(packed.size(), 0xAA);
+        packed_pack(unpacked.data(), repacked.data(), fields, width);
+        MEMCMP_EQUAL(packed.data(), repacked.data(), packed.size());
+    }
+}
+
+TEST(Ut_PackedIterator, packed_pack__HighBitsIgnored)
+{
+    const u16 samples[] = {0xFABC, 0xFDEF, 0x0123, 0xF456};
+    u8 packed[sizeof(TEST_PACKED_12)] = {};
+    packed_pack(samples, packed, 4, 12);
+    MEMCMP_EQUAL(TEST_PACKED_12, packed, sizeof(TEST_PACKED_12));
+}
+
+TEST(Ut_PackedIterator, packed_iterator_create__CreatesValidIterator)
+{
+    iterator_instance created;
+    CHECK_TRUE(packed_iterator_create(&created, TEST_PACKED_12, 4, 12));
+    UNSIGNED_LONGS_EQUAL(0xABC, *static_cast<const u16*>(ITERATOR_CBEGIN(created)));
+    ENUMS_EQUAL_INT(iterator_status_ok, iterator_destruct(&created));
+
+    CHECK_FALSE(packed_iterator_create(&created, TEST_PACKED_12, 4, 0));
+}
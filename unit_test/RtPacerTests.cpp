@@ -0,0 +1,148 @@
+#include "AllTests.h"
+#include "rt_pacer.h"
+#include "scheduler.h"
+#include <sched.h>
+#include <time.h>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Helpers ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static u64 WallNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<u64>(ts.tv_sec) * 1000000000 + static_cast<u64>(ts.tv_nsec);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_RtPacer)
+{
+    rt_pacer pacer;
+
+    void setup() override
+    {
+        auto status = rt_pacer_construct(&pacer);
+        ENUMS_EQUAL_INT_TEXT(rt_pacer_status_ok, status, "Cannot construct shared pacer");
+    }
+
+    void teardown() override
+    {
+        rt_pacer_destruct(&pacer);
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_RtPacer, NullCases)
+{
+    ENUMS_EQUAL_INT(rt_pacer_status_iptr, rt_pacer_construct_ext(nullptr, 0, 0, RT_PACER_NO_CPU));
+    ENUMS_EQUAL_INT(rt_pacer_status_iptr, rt_pacer_destruct(nullptr));
+    ENUMS_EQUAL_INT(rt_pacer_status_iptr, rt_pacer_rebase(nullptr));
+}
+
+TEST(Ut_RtPacer, rt_pacer_pin__ErrorOnWrongCpu)
+{
+    ENUMS_EQUAL_INT(rt_pacer_status_cerror, rt_pacer_pin(-1));
+    ENUMS_EQUAL_INT(rt_pacer_status_cerror, rt_pacer_pin(CPU_SETSIZE));
+}
+
+TEST(Ut_RtPacer, rt_pacer_pin__ThreadMovedToCpu)
+{
+    cpu_set_t saved;
+    CHECK_EQUAL(0, sched_getaffinity(0, sizeof(saved), &saved));
+    int cpu = sched_getcpu();
+
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_pin(cpu));
+    cpu_set_t pinned;
+    sched_getaffinity(0, sizeof(pinned), &pinned);
+    CHECK_EQUAL(1, CPU_COUNT(&pinned));
+    CHECK_TRUE(CPU_ISSET(cpu, &pinned));
+
+    sched_setaffinity(0, sizeof(saved), &saved);
+}
+
+TEST(Ut_RtPacer, rt_pacer_pace__WallTimeTracksVirtualTime)
+{
+    u64 start = WallNs();
+    rt_pacer_pace(&pacer, 0, 0);
+    rt_pacer_pace(&pacer, 0, 2000000);
+    rt_pacer_pace(&pacer, 2000000, 2010000);
+    u64 elapsed = WallNs() - start;
+
+    CHECK_TRUE(elapsed >= 2010000);
+    UNSIGNED_LONGS_EQUAL(3, pacer.stats.waits);
+}
+
+TEST(Ut_RtPacer, rt_pacer_pace__LateStepCountedAsMiss)
+{
+    rt_pacer_pace(&pacer, 1000, 1000);
+    timespec delay = {0, 3000000};
+    nanosleep(&delay, nullptr);
+
+    rt_pacer_pace(&pacer, 1000, 2000);
+    UNSIGNED_LONGS_EQUAL(1, pacer.stats.misses);
+    CHECK_TRUE(pacer.stats.worst_late_ns >= 2999000);
+    CHECK_TRUE(pacer.stats.total_late_ns >= pacer.stats.worst_late_ns);
+
+    /* A new origin forgives the lateness */
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_rebase(&pacer));
+    rt_pacer_pace(&pacer, 2000, 2000);
+    UNSIGNED_LONGS_EQUAL(1, pacer.stats.misses);
+}
+
+TEST(Ut_RtPacer, rt_pacer_pace__DrivesScheduler)
+{
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    scheduler_set_pacer(&sched, rt_pacer_pace, &pacer);
+
+    u64 start = WallNs();
+    scheduler_advance(&sched, 1000000);
+    CHECK_TRUE(WallNs() - start >= 1000000);
+    UNSIGNED_LONGS_EQUAL(1, pacer.stats.waits);
+}
+
+TEST(Ut_RtPacer, rt_pacer_construct_ext__SleepOnlyPacer)
+{
+    rt_pacer sleeper;
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_construct_ext(&sleeper, 0, RT_PACER_DEFAULT_TOLERANCE_NS,
+                                                               RT_PACER_NO_CPU));
+    u64 start = WallNs();
+    rt_pacer_pace(&sleeper, 0, 500000);
+    CHECK_TRUE(WallNs() - start >= 500000);
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_destruct(&sleeper));
+}
+
+TEST(Ut_RtPacer, rt_pacer_construct_ext__ErrorOnUnavailableCpu)
+{
+    rt_pacer other;
+    ENUMS_EQUAL_INT(rt_pacer_status_cerror, rt_pacer_construct_ext(&other, 0, 0, -2));
+    ENUMS_EQUAL_INT(rt_pacer_status_cerror, rt_pacer_construct_ext(&other, 0, 0, CPU_SETSIZE));
+}
+
+TEST(Ut_RtPacer, rt_pacer_pace__PinStatusReported)
+{
+    cpu_set_t saved;
+    CHECK_EQUAL(0, sched_getaffinity(0, sizeof(saved), &saved));
+
+    rt_pacer pinned;
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_construct_ext(&pinned, 0, 0, sched_getcpu()));
+    rt_pacer_pace(&pinned, 0, 0);
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, pinned.pin_status);
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_destruct(&pinned));
+
+    /* The CPU went away between construction and the first step */
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_construct_ext(&pinned, 0, 0, sched_getcpu()));
+    pinned.cpu = CPU_SETSIZE;
+    rt_pacer_pace(&pinned, 0, 0);
+    ENUMS_EQUAL_INT(rt_pacer_status_cerror, pinned.pin_status);
+    ENUMS_EQUAL_INT(rt_pacer_status_ok, rt_pacer_destruct(&pinned));
+
+    CHECK_EQUAL(0, sched_setaffinity(0, sizeof(saved), &saved));
+}
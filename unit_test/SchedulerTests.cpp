@@ -0,0 +1,318 @@
+#include "AllTests.h"
+#include "scheduler.h"
+#include <vector>
+#include <algorithm>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Helpers ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+struct Firing
+{
+    u64 deadline;
+    u64 now;
+};
+
+static std::vector<Firing> firings;
+
+static void RecordFiring(scheduler* sched, sched_event* event)
+{
+    firings.push_back({event->deadline_ns, sched->now_ns});
+}
+
+/* Reschedule the event 'ctx' nanoseconds later until it has fired three times */
+static void Periodic(scheduler* sched, sched_event* event)
+{
+    RecordFiring(sched, event);
+    if (firings.size() < 3) {
+        scheduler_schedule_in(sched, event, reinterpret_cast<u64>(event->ctx));
+    }
+}
+
+static sched_event* victim;
+
+static void CancelVictim(scheduler* sched, sched_event* event)
+{
+    RecordFiring(sched, event);
+    scheduler_cancel(sched, victim);
+}
+
+static std::vector<std::pair<u64, u64>> paces;
+
+static void RecordPace(void* ctx, u64 now, u64 target)
+{
+    (void)ctx;
+    paces.emplace_back(now, target);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_Scheduler)
+{
+    scheduler sched;
+
+    void setup() override
+    {
+        firings.clear();
+        paces.clear();
+        auto status = scheduler_init(&sched, 0);
+        ENUMS_EQUAL_INT_TEXT(scheduler_status_ok, status, "Cannot initialize shared scheduler");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_Scheduler, NullCases)
+{
+    sched_event event;
+    u64 deadline;
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_init(nullptr, 0));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, sched_event_init(nullptr, RecordFiring, nullptr));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, sched_event_init(&event, nullptr, nullptr));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_schedule(nullptr, &event, 0));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_schedule(&sched, nullptr, 0));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_cancel(nullptr, &event));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_cancel(&sched, nullptr));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_advance(nullptr, 0));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_next(nullptr, &deadline));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_next(&sched, nullptr));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_fast_forward(nullptr, 0));
+    ENUMS_EQUAL_INT(scheduler_status_iptr, scheduler_set_pacer(nullptr, RecordPace, nullptr));
+}
+
+TEST(Ut_Scheduler, scheduler_advance__ErrorWhenGoingBackwards)
+{
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 1000));
+    ENUMS_EQUAL_INT(scheduler_status_cerror, scheduler_advance(&sched, 999));
+    UNSIGNED_LONGS_EQUAL(1000, sched.now_ns);
+}
+
+TEST(Ut_Scheduler, scheduler_advance__EventsFireAtTheirDeadlines)
+{
+    sched_event events[4];
+    const u64 deadlines[4] = {5000, 70, 1ull << 40, 4096};
+    for (size i = 0; i < 4; ++i) {
+        ENUMS_EQUAL_INT(scheduler_status_ok, sched_event_init(&events[i], RecordFiring, nullptr));
+        ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_schedule(&sched, &events[i], deadlines[i]));
+    }
+    UNSIGNED_LONGS_EQUAL(4, sched.pending);
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 5000));
+    UNSIGNED_LONGS_EQUAL(3, firings.size());
+    const u64 expected[3] = {70, 4096, 5000};
+    for (size i = 0; i < 3; ++i) {
+        UNSIGNED_LONGS_EQUAL(expected[i], firings[i].deadline);
+        UNSIGNED_LONGS_EQUAL(expected[i], firings[i].now);
+    }
+    CHECK_TRUE(sched_event_pending(&events[2]));
+    CHECK_FALSE(sched_event_pending(&events[0]));
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 1ull << 41));
+    UNSIGNED_LONGS_EQUAL(4, firings.size());
+    UNSIGNED_LONGS_EQUAL(1ull << 40, firings[3].now);
+    UNSIGNED_LONGS_EQUAL(1ull << 41, sched.now_ns);
+    UNSIGNED_LONGS_EQUAL(0, sched.pending);
+    UNSIGNED_LONGS_EQUAL(4, sched.fired);
+}
+
+TEST(Ut_Scheduler, scheduler_advance__ManyEventsFireInDeadlineOrder)
+{
+    const size count = 4096;
+    std::vector<sched_event> events(count);
+    u64 seed = 12345;
+    for (auto& event : events) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        u64 deadline = (seed >> 11) >> (seed % 40);
+        sched_event_init(&event, RecordFiring, nullptr);
+        scheduler_schedule(&sched, &event, deadline);
+    }
+
+    /* Advance in uneven steps, so some of them cross many slots at once and some end in the middle of a slot */
+    u64 now = 0;
+    while (0 != sched.pending) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        now += (seed >> 20) >> (seed % 48);
+        ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, now));
+    }
+
+    UNSIGNED_LONGS_EQUAL(count, firings.size());
+    for (size i = 0; i < count; ++i) {
+        UNSIGNED_LONGS_EQUAL(firings[i].deadline, firings[i].now);
+        if (0 != i) {
+            CHECK_TRUE(firings[i - 1].deadline <= firings[i].deadline);
+        }
+    }
+}
+
+TEST(Ut_Scheduler, scheduler_cancel__CancelledEventNeverFires)
+{
+    sched_event first;
+    sched_event second;
+    sched_event_init(&first, RecordFiring, nullptr);
+    sched_event_init(&second, RecordFiring, nullptr);
+    scheduler_schedule(&sched, &first, 100000);
+    scheduler_schedule(&sched, &second, 100000);
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_cancel(&sched, &first));
+    ENUMS_EQUAL_INT(scheduler_status_cerror, scheduler_cancel(&sched, &first));
+    UNSIGNED_LONGS_EQUAL(1, sched.pending);
+
+    scheduler_advance(&sched, 200000);
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    ENUMS_EQUAL_INT(scheduler_status_cerror, scheduler_cancel(&sched, &second));
+}
+
+TEST(Ut_Scheduler, scheduler_cancel__CallbackCancelsEventOfTheSameBatch)
+{
+    sched_event first;
+    sched_event second;
+    sched_event_init(&first, CancelVictim, nullptr);
+    sched_event_init(&second, RecordFiring, nullptr);
+    victim = &second;
+    scheduler_schedule(&sched, &first, 300);
+    scheduler_schedule(&sched, &second, 300);
+
+    scheduler_advance(&sched, 300);
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    UNSIGNED_LONGS_EQUAL(0, sched.pending);
+}
+
+TEST(Ut_Scheduler, scheduler_schedule__RescheduleMovesPendingEvent)
+{
+    sched_event event;
+    sched_event_init(&event, RecordFiring, nullptr);
+    scheduler_schedule(&sched, &event, 1ull << 30);
+    scheduler_schedule(&sched, &event, 10);
+    UNSIGNED_LONGS_EQUAL(1, sched.pending);
+
+    scheduler_advance(&sched, 1ull << 31);
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    UNSIGNED_LONGS_EQUAL(10, firings[0].now);
+}
+
+TEST(Ut_Scheduler, scheduler_schedule__PastDeadlineFiresOnNextAdvance)
+{
+    sched_event event;
+    sched_event_init(&event, RecordFiring, nullptr);
+    scheduler_advance(&sched, 1000);
+    scheduler_schedule(&sched, &event, 10);
+
+    scheduler_advance(&sched, 1000);
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    UNSIGNED_LONGS_EQUAL(10, firings[0].deadline);
+    UNSIGNED_LONGS_EQUAL(1000, firings[0].now);
+}
+
+TEST(Ut_Scheduler, scheduler_schedule__CallbackReschedulesWithinTheSameAdvance)
+{
+    sched_event event;
+    sched_event_init(&event, Periodic, reinterpret_cast<void*>(static_cast<uintptr_t>(700)));
+    scheduler_schedule_in(&sched, &event, 700);
+
+    scheduler_advance(&sched, 10000);
+    UNSIGNED_LONGS_EQUAL(3, firings.size());
+    UNSIGNED_LONGS_EQUAL(700, firings[0].now);
+    UNSIGNED_LONGS_EQUAL(1400, firings[1].now);
+    UNSIGNED_LONGS_EQUAL(2100, firings[2].now);
+    CHECK_FALSE(sched_event_pending(&event));
+}
+
+TEST(Ut_Scheduler, scheduler_next__EarliestDeadlineReported)
+{
+    u64 deadline = 0;
+    ENUMS_EQUAL_INT(scheduler_status_empty, scheduler_next(&sched, &deadline));
+
+    sched_event events[3];
+    const u64 deadlines[3] = {900000, 123456, 1ull << 50};
+    for (size i = 0; i < 3; ++i) {
+        sched_event_init(&events[i], RecordFiring, nullptr);
+        scheduler_schedule(&sched, &events[i], deadlines[i]);
+    }
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_next(&sched, &deadline));
+    UNSIGNED_LONGS_EQUAL(123456, deadline);
+
+    scheduler_advance(&sched, 123456);
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_next(&sched, &deadline));
+    UNSIGNED_LONGS_EQUAL(900000, deadline);
+
+    /* Level 0 events are reported exactly */
+    scheduler_advance(&sched, 899990);
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_next(&sched, &deadline));
+    UNSIGNED_LONGS_EQUAL(900000, deadline);
+}
+
+TEST(Ut_Scheduler, scheduler_fast_forward__JumpsToTheNextEvent)
+{
+    ENUMS_EQUAL_INT(scheduler_status_empty, scheduler_fast_forward(&sched, UINT64_MAX));
+    UNSIGNED_LONGS_EQUAL(0, sched.now_ns);
+
+    /* A 400 ms sector erase and a 700 us page program */
+    sched_event erase;
+    sched_event program;
+    sched_event_init(&erase, RecordFiring, nullptr);
+    sched_event_init(&program, RecordFiring, nullptr);
+    scheduler_schedule(&sched, &erase, 400000000);
+    scheduler_schedule(&sched, &program, 700000);
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_fast_forward(&sched, UINT64_MAX));
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    UNSIGNED_LONGS_EQUAL(700000, sched.now_ns);
+
+    /* The limit stops the jump short of the event */
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_fast_forward(&sched, 1000000));
+    UNSIGNED_LONGS_EQUAL(1, firings.size());
+    UNSIGNED_LONGS_EQUAL(1000000, sched.now_ns);
+    ENUMS_EQUAL_INT(scheduler_status_cerror, scheduler_fast_forward(&sched, 999999));
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_fast_forward(&sched, UINT64_MAX));
+    UNSIGNED_LONGS_EQUAL(2, firings.size());
+    UNSIGNED_LONGS_EQUAL(400000000, sched.now_ns);
+    UNSIGNED_LONGS_EQUAL(400000000, sched.skipped_ns);
+    ENUMS_EQUAL_INT(scheduler_status_empty, scheduler_fast_forward(&sched, UINT64_MAX));
+}
+
+TEST(Ut_Scheduler, scheduler_set_pacer__PacerHoldsBackEveryStep)
+{
+    sched_event event;
+    sched_event_init(&event, RecordFiring, nullptr);
+    scheduler_schedule(&sched, &event, 5000);
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_set_pacer(&sched, RecordPace, nullptr));
+
+    scheduler_advance(&sched, 8000);
+    UNSIGNED_LONGS_EQUAL(2, paces.size());
+    CHECK_TRUE(paces[0].first < 5000);
+    UNSIGNED_LONGS_EQUAL(5000, paces[0].second);
+    UNSIGNED_LONGS_EQUAL(5000, paces[1].first);
+    UNSIGNED_LONGS_EQUAL(8000, paces[1].second);
+
+    /* Standing still needs no pacing */
+    scheduler_advance(&sched, 8000);
+    UNSIGNED_LONGS_EQUAL(2, paces.size());
+
+    scheduler_set_pacer(&sched, nullptr, nullptr);
+    scheduler_advance(&sched, 9000);
+    UNSIGNED_LONGS_EQUAL(2, paces.size());
+}
+
+static scheduler_status nestedStatus;
+
+static void AdvanceFromCallback(scheduler* sched, sched_event* event)
+{
+    RecordFiring(sched, event);
+    nestedStatus = scheduler_advance(sched, sched->now_ns + 1000);
+}
+
+TEST(Ut_Scheduler, scheduler_advance__CallbackCannotAdvance)
+{
+    sched_event event;
+    sched_event_init(&event, AdvanceFromCallback, nullptr);
+    scheduler_schedule(&sched, &event, 100);
+
+    scheduler_advance(&sched, 200);
+    ENUMS_EQUAL_INT(scheduler_status_cerror, nestedStatus);
+    UNSIGNED_LONGS_EQUAL(200, sched.now_ns);
+}
@@ -0,0 +1,1042 @@
+#include "AllTests.h"
+#include "spi_bus.h"
+#include "array_iterator.h"
+#include "packed_iterator.h"
+#include "Fakes.h"
+#include <cstring>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_SCRATCH_SIZE 16
+#define TEST_CS 3
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_SpiBus)
+{
+    spi_bus bus = {};
+    FakeDevice device;
+    iterator_instance tx = {};
+    iterator_instance rx = {};
+
+    void setup() override
+    {
+        auto status = spi_bus_construct_ext(&bus, TEST_SCRATCH_SIZE, malloc);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot construct shared bus");
+        status = spi_bus_attach(&bus, TEST_CS, &FAKE_DEVICE_OPS, &device);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot attach fake device");
+    }
+
+    void teardown() override
+    {
+        iterator_destruct(&tx);
+        iterator_destruct(&rx);
+        auto status = spi_bus_destruct(&bus);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot destruct shared bus");
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_SpiBus, NullCases)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_construct_ext(nullptr, TEST_SCRATCH_SIZE, malloc));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_construct_ext(&bus, TEST_SCRATCH_SIZE, nullptr));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_destruct_ext(nullptr, free));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_destruct_ext(&bus, nullptr));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_attach(nullptr, 0, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_attach(&bus, 0, nullptr, &device));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_detach(nullptr, 0));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_transfer(nullptr, TEST_CS, nullptr, nullptr, 1));
+}
+
+TEST(Ut_SpiBus, spi_bus_construct_ext__ErrorStatusReturnedWhenMemoryAllocationFailed)
+{
+    spi_bus other;
+    ENUMS_EQUAL_INT(spi_bus_status_merror, spi_bus_construct_ext(&other, TEST_SCRATCH_SIZE, FakeMalloc));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_construct_ext(&other, SPI_BUS_MIN_SCRATCH - 1, malloc));
+}
+
+TEST(Ut_SpiBus, spi_bus_attach__ErrorOnWrongParams)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_attach(&bus, SPI_BUS_MAX_SLAVES, &FAKE_DEVICE_OPS, &device));
+    spi_device_ops noExchange = {nullptr, nullptr, nullptr, nullptr};
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_attach(&bus, 0, &noExchange, &device));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_detach(&bus, SPI_BUS_MAX_SLAVES));
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__NoDeviceOnChipSelect)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_nodev, spi_bus_transfer(&bus, 0, nullptr, nullptr, 1));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_detach(&bus, TEST_CS));
+    ENUMS_EQUAL_INT(spi_bus_status_nodev, spi_bus_transfer(&bus, TEST_CS, nullptr, nullptr, 1));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_transfer(&bus, SPI_BUS_MAX_SLAVES, nullptr, nullptr, 1));
+}
+
+TEST(Ut_SpiBus, spi_bus_message__ErrorOnZeroClockFrequency)
+{
+    bus.speed_hz = 0;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_transfer(&bus, TEST_CS, nullptr, nullptr, 1));
+
+    /* A transfer setting its own frequency does not need the default */
+    spi_transfer xfers[2] = {};
+    xfers[0].len = 1;
+    xfers[0].speed_hz = 1000000;
+    xfers[1].len = 1;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    UNSIGNED_LONGS_EQUAL(0, device.selects);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 1));
+    UNSIGNED_LONGS_EQUAL(8000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__ArraysExchangedInOneCall)
+{
+    u8 out[100];
+    u8 in[100] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i);
+    }
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, device.deselects);
+    MEMCMP_EQUAL(out, device.mosi.data(), sizeof(out));
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[i]), in[i]);
+    }
+    UNSIGNED_LONGS_EQUAL(1, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(sizeof(out), bus.stats.bytes);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__ArrayTooShort)
+{
+    u8 out[4] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out) + 1));
+    UNSIGNED_LONGS_EQUAL(0, device.selects);
+
+    /* Wrong iterator types */
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_transfer(&bus, TEST_CS, nullptr, &tx, 1));
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__GenericIteratorsStagedInChunks)
+{
+    /* 8-bit packed fields form a non-array iterator over bytes */
+    u8 out[40];
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(0x80 + i);
+    }
+    CHECK_TRUE(packed_iterator_create(&tx, out, sizeof(out), 8));
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    MEMCMP_EQUAL(out, device.mosi.data(), sizeof(out));
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__MissingTxDataSentAsZeros)
+{
+    u8 in[20];
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, nullptr, &rx, sizeof(in)));
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(0, device.mosi[i]);
+        UNSIGNED_LONGS_EQUAL(0xFF, in[i]);
+    }
+
+    /* A generic iterator shorter than the transfer is padded */
+    const u8 packed[2] = {0x12, 0x34};
+    device.mosi.clear();
+    CHECK_TRUE(packed_iterator_create(&tx, packed, 2, 8));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, 4));
+    CHECK_TRUE((std::vector<u8>{0x12, 0x34, 0x00, 0x00}) == device.mosi);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__GenericRxIterator)
+{
+    /* Receive into every second byte of an array through a custom iterator */
+    static u8 in[8];
+    static size idx;
+    memset(in, 0, sizeof(in));
+    auto begin = [](void* ctx) -> void* { static_cast<void>(ctx); idx = 0; return &in[0]; };
+    auto next = [](void* ctx) -> void* { static_cast<void>(ctx); idx += 2; return &in[idx]; };
+    auto end = [](void* ctx) -> void* { static_cast<void>(ctx); return &in[8]; };
+    ENUMS_EQUAL_INT(iterator_status_ok, iterator_construct(&rx, 1));
+    ENUMS_EQUAL_INT(iterator_status_ok, iterator_init_as_non_const(&rx, begin, next, end));
+
+    const u8 out[4] = {0x01, 0x02, 0x03, 0x04};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+
+    const u8 expected[8] = {0xFE, 0, 0xFD, 0, 0xFC, 0, 0xFB, 0};
+    MEMCMP_EQUAL(expected, in, sizeof(in));
+}
+
+TEST(Ut_SpiBus, spi_bus_message__ChipSelectKeptAssertedBetweenTransfers)
+{
+    const u8 cmd[1] = {0x9F};
+    u8 id[3] = {};
+    iterator_instance cmdIter = {};
+    CHECK_TRUE(array_iterator_create_const(&cmdIter, cmd, sizeof(cmd), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, id, sizeof(id), sizeof(u8)));
+
+    spi_transfer xfers[2] = {};
+    xfers[0].tx = &cmdIter;
+    xfers[0].len = sizeof(cmd);
+    xfers[1].rx = &rx;
+    xfers[1].len = sizeof(id);
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.deselects);
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+    CHECK_TRUE((std::vector<u8>{0x9F, 0x00, 0x00, 0x00}) == device.mosi);
+    UNSIGNED_LONGS_EQUAL(2, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(1, bus.stats.messages);
+    UNSIGNED_LONGS_EQUAL(SPI_BUS_NO_CS, bus.active_cs);
+
+    iterator_destruct(&cmdIter);
+}
+
+TEST(Ut_SpiBus, spi_bus_message__CsChangeSemantics)
+{
+    spi_transfer xfers[3] = {};
+    for (auto& xfer : xfers) {
+        xfer.len = 1;
+    }
+
+    /* In the middle of a message the chip-select toggles */
+    xfers[0].cs_change = true;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 3));
+    UNSIGNED_LONGS_EQUAL(2, device.selects);
+    UNSIGNED_LONGS_EQUAL(2, device.deselects);
+
+    /* On the last transfer the device stays selected for the next message */
+    xfers[2].cs_change = true;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, &xfers[2], 1));
+    UNSIGNED_LONGS_EQUAL(3, device.selects);
+    UNSIGNED_LONGS_EQUAL(2, device.deselects);
+    UNSIGNED_LONGS_EQUAL(TEST_CS, bus.active_cs);
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers + 1, 1));
+    UNSIGNED_LONGS_EQUAL(3, device.selects);
+    UNSIGNED_LONGS_EQUAL(3, device.deselects);
+
+    /* Addressing another device releases the one left selected */
+    FakeDevice other;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&bus, 0, &FAKE_DEVICE_OPS, &other));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, &xfers[2], 1));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, 0, xfers + 1, 1));
+    UNSIGNED_LONGS_EQUAL(4, device.deselects);
+    UNSIGNED_LONGS_EQUAL(1, other.selects);
+    UNSIGNED_LONGS_EQUAL(1, other.deselects);
+}
+
+TEST(Ut_SpiBus, spi_bus_message__VirtualTimeAdvanced)
+{
+    spi_transfer xfers[2] = {};
+    xfers[0].len = 125; /* 1000 bits at the default 1 MHz */
+    xfers[0].delay_usecs = 10;
+    xfers[1].len = 3;
+    xfers[1].speed_hz = 3000000;
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    UNSIGNED_LONGS_EQUAL(1000000 + 10000 + 8000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_message__NothingExchangedOnInvalidTransfer)
+{
+    u8 out[2] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+
+    spi_transfer xfers[2] = {};
+    xfers[0].len = 1;
+    xfers[1].tx = &tx;
+    xfers[1].len = sizeof(out) + 1;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, xfers, 2));
+
+    xfers[1].len = sizeof(out);
+    xfers[1].bits_per_word = SPI_MODE_MAX_BITS_PER_WORD + 1;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    xfers[1].bits_per_word = 16;
+    xfers[1].len = 1;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, xfers, 2));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_message(&bus, TEST_CS, nullptr, 1));
+
+    UNSIGNED_LONGS_EQUAL(0, device.selects);
+    UNSIGNED_LONGS_EQUAL(0, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__HighChipSelectLines)
+{
+    FakeDevice far;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&bus, SPI_BUS_MAX_SLAVES - 1, &FAKE_DEVICE_OPS, &far));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, SPI_BUS_MAX_SLAVES - 1, nullptr, nullptr, 2));
+    UNSIGNED_LONGS_EQUAL(1, far.exchanges);
+    UNSIGNED_LONGS_EQUAL(0, device.exchanges);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__GenericTxPassedThroughWhenRxIsArray)
+{
+    u8 out[40];
+    u8 in[40] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(3 * i);
+    }
+    CHECK_TRUE(packed_iterator_create(&tx, out, sizeof(out), 8));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+
+    /* Longer than the scratch memory, still a single call without staging */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0, device.contiguous);
+    MEMCMP_EQUAL(out, device.mosi.data(), sizeof(out));
+    UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[39]), in[39]);
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__StagedChunksSeenAsByteArrays)
+{
+    u8 out[40] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(3, device.contiguous);
+}
+
+TEST(Ut_SpiBus, spi_bus_message__QuadFastReadSwitchesLines)
+{
+    /* 1-4-4 fast read: single-line opcode, address and dummy on four lines, data on four lines */
+    const u8 cmd[1] = {0xEB};
+    const u8 addr[4] = {0x00, 0x10, 0x00, 0xFF};
+    u8 data[64];
+    iterator_instance cmdIter = {};
+    CHECK_TRUE(array_iterator_create_const(&cmdIter, cmd, sizeof(cmd), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create_const(&tx, addr, sizeof(addr), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, data, sizeof(data), sizeof(u8)));
+
+    spi_transfer xfers[3] = {};
+    xfers[0].tx = &cmdIter;
+    xfers[0].len = sizeof(cmd);
+    xfers[1].tx = &tx;
+    xfers[1].len = sizeof(addr);
+    xfers[1].tx_nbits = SPI_LANES_QUAD;
+    xfers[2].rx = &rx;
+    xfers[2].len = sizeof(data);
+    xfers[2].rx_nbits = SPI_LANES_QUAD;
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 3));
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+
+    /* 8 + 8 + 128 clocks at 1 MHz */
+    UNSIGNED_LONGS_EQUAL(144000, bus.time_ns);
+    iterator_destruct(&cmdIter);
+}
+
+TEST(Ut_SpiBus, spi_bus_message__MultiLineTransfersAreHalfDuplex)
+{
+    u8 out[2] = {};
+    u8 in[2] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+
+    spi_transfer xfer = {};
+    xfer.tx = &tx;
+    xfer.rx = &rx;
+    xfer.len = sizeof(out);
+    xfer.tx_nbits = SPI_LANES_DUAL;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, &xfer, 1));
+    xfer.tx_nbits = 3;
+    xfer.rx = nullptr;
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_message(&bus, TEST_CS, &xfer, 1));
+    xfer.tx_nbits = SPI_LANES_OCTAL;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, &xfer, 1));
+    UNSIGNED_LONGS_EQUAL(2000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_modes__ErrorOnWrongParams)
+{
+    spi_mode mode = {SPI_MODE_0, false};
+    spi_mode wrong = {SPI_MODE_3 + 1, false};
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_modes(nullptr, TEST_CS, &mode, &mode));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_modes(&bus, TEST_CS, nullptr, &mode));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_modes(&bus, TEST_CS, &mode, nullptr));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_set_modes(&bus, SPI_BUS_MAX_SLAVES, &mode, &mode));
+    ENUMS_EQUAL_INT(spi_bus_status_nodev, spi_bus_set_modes(&bus, 0, &mode, &mode));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_set_modes(&bus, TEST_CS, &mode, &wrong));
+}
+
+TEST(Ut_SpiBus, spi_bus_transfer__DeviceWithOtherBitOrderSeesReversedBytes)
+{
+    spi_mode host = {SPI_MODE_0, false};
+    spi_mode lsb = {SPI_MODE_0, true};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_modes(&bus, TEST_CS, &host, &lsb));
+
+    u8 out[40];
+    u8 in[40] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i + 1);
+    }
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+
+    /* Transformed data is staged, so the scratch size splits the transfer */
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0x80, device.mosi[0]);
+    UNSIGNED_LONGS_EQUAL(0x40, device.mosi[1]);
+    UNSIGNED_LONGS_EQUAL(0xC0, device.mosi[2]);
+
+    /* The complement travels back through the reverse transform */
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[i]), in[i]);
+    }
+}
+
+TEST(Ut_SpiBus, spi_bus_message__ClockPhaseMismatchDelaysStream)
+{
+    spi_mode host = {SPI_MODE_0, false};
+    spi_mode device1 = {SPI_MODE_1, false};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_modes(&bus, TEST_CS, &host, &device1));
+
+    const u16 out[10] = {0xFFF, 0x001, 0x800, 0x000, 0x555, 0xAAA, 0x123, 0x456, 0x789, 0xABC};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfer = {};
+    xfer.tx = &tx;
+    xfer.len = sizeof(out);
+    xfer.bits_per_word = 12;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, &xfer, 1));
+
+    /* Each 12-bit word loses its last bit to the next one - also across chunk boundaries */
+    u16 seen[10];
+    memcpy(seen, device.mosi.data(), sizeof(seen));
+    u32 carry = 0;
+    for (size i = 0; i < 10; ++i) {
+        UNSIGNED_LONGS_EQUAL((out[i] >> 1) | (carry << 11), seen[i]);
+        carry = out[i] & 1;
+    }
+
+    /* 10 words of 12 bits at 1 MHz */
+    UNSIGNED_LONGS_EQUAL(120000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_modes__ModesWithSameSamplingEdgeAreCompatible)
+{
+    spi_mode mode0 = {SPI_MODE_0, false};
+    spi_mode mode3 = {SPI_MODE_3, false};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_modes(&bus, TEST_CS, &mode0, &mode3));
+
+    u8 out[40] = {0x5A};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(0x5A, device.mosi[0]);
+
+    /* Staged chunks of the direct path are still byte array views */
+    UNSIGNED_LONGS_EQUAL(3, device.contiguous);
+}
+
+TEST(Ut_SpiBus, spi_bus_construct_cycle_ext__ErrorOnWrongParams)
+{
+    spi_bus other;
+    spi_bus_timing timing = {};
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_construct_cycle_ext(nullptr, TEST_SCRATCH_SIZE, &timing, malloc));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_construct_cycle_ext(&other, TEST_SCRATCH_SIZE, nullptr, malloc));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_construct_cycle_ext(&other, TEST_SCRATCH_SIZE, &timing, nullptr));
+    ENUMS_EQUAL_INT(spi_bus_status_merror, spi_bus_construct_cycle_ext(&other, TEST_SCRATCH_SIZE, &timing, FakeMalloc));
+}
+
+TEST(Ut_SpiBus, spi_bus_message__FastBusReportsNoCycles)
+{
+    u8 out[4] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    CHECK_TRUE(device.cycles.empty());
+}
+
+TEST(Ut_SpiBus, spi_bus_message__CycleAccurateTiming)
+{
+    spi_bus cycleBus;
+    spi_bus_timing timing = {100, 50, 1000, 250};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_construct_cycle_ext(&cycleBus, TEST_SCRATCH_SIZE, &timing, malloc));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&cycleBus, TEST_CS, &FAKE_DEVICE_OPS, &device));
+
+    u8 out[3] = {0x01, 0x02, 0x03};
+    u8 in[3] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&cycleBus, TEST_CS, &tx, &rx, sizeof(out)));
+
+    /* One exchange per word, each preceded by its edges: 16 edges at 500 ns after 100 ns of setup */
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(3, device.cycles.size());
+    for (size i = 0; i < 3; ++i) {
+        UNSIGNED_LONGS_EQUAL(16, device.cycles[i].edges);
+        UNSIGNED_LONGS_EQUAL(100 + i * (8000 + 250), device.cycles[i].first_edge_ns);
+        UNSIGNED_LONGS_EQUAL(100 + i * (8000 + 250) + 15 * 500, device.cycles[i].last_edge_ns);
+        UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[i]), in[i]);
+    }
+
+    /* Setup, three words, two gaps and hold */
+    u64 end = 100 + 3 * 8000 + 2 * 250 + 50;
+    UNSIGNED_LONGS_EQUAL(end, cycleBus.time_ns);
+
+    /* The next assertion waits for the inactive time */
+    device.cycles.clear();
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&cycleBus, TEST_CS, &tx, nullptr, 1));
+    UNSIGNED_LONGS_EQUAL(end + 1000 + 100, device.cycles[0].first_edge_ns);
+    UNSIGNED_LONGS_EQUAL(2, cycleBus.stats.transfers);
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_destruct(&cycleBus));
+}
+
+TEST(Ut_SpiBus, spi_bus_message__CycleAccurateWideWordsAndLanes)
+{
+    spi_bus cycleBus;
+    spi_bus_timing timing = {};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_construct_cycle(&cycleBus, &timing));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&cycleBus, TEST_CS, &FAKE_DEVICE_OPS, &device));
+
+    const u16 out[2] = {0x0ABC, 0x0DEF};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfer = {};
+    xfer.tx = &tx;
+    xfer.len = sizeof(out);
+    xfer.bits_per_word = 12;
+    xfer.tx_nbits = SPI_LANES_QUAD;
+    xfer.speed_hz = 3000000;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&cycleBus, TEST_CS, &xfer, 1));
+
+    /* 12 bits over 4 lines take 3 clocks, edges at 1/6 us rounded down */
+    UNSIGNED_LONGS_EQUAL(2, device.cycles.size());
+    UNSIGNED_LONGS_EQUAL(6, device.cycles[1].edges);
+    UNSIGNED_LONGS_EQUAL(1000, device.cycles[1].first_edge_ns);
+    UNSIGNED_LONGS_EQUAL(1833, device.cycles[1].last_edge_ns);
+    UNSIGNED_LONGS_EQUAL(2000, cycleBus.time_ns);
+    MEMCMP_EQUAL(out, device.mosi.data(), sizeof(out));
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_destruct(&cycleBus));
+}
+
+static u32 busyExchangesSeen;
+
+static void ReleaseBusy(scheduler* sched, sched_event* event)
+{
+    (void)sched;
+    auto* device = static_cast<FakeDevice*>(event->ctx);
+    busyExchangesSeen = device->exchanges;
+}
+
+TEST(Ut_SpiBus, spi_bus_set_scheduler__SchedulerFollowsBusTime)
+{
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_scheduler(nullptr, &sched));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_scheduler(&bus, &sched));
+
+    /* 8 bytes at 1 MHz take 64 us - the event falls between the two transfers */
+    sched_event event;
+    sched_event_init(&event, ReleaseBusy, &device);
+    scheduler_schedule(&sched, &event, 10000);
+    busyExchangesSeen = 0;
+
+    u8 out[8] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfers[2] = {};
+    xfers[0].tx = &tx;
+    xfers[0].len = sizeof(out);
+    xfers[0].speed_hz = 1000000;
+    xfers[1] = xfers[0];
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 2));
+
+    UNSIGNED_LONGS_EQUAL(1, busyExchangesSeen);
+    UNSIGNED_LONGS_EQUAL(128000, sched.now_ns);
+    UNSIGNED_LONGS_EQUAL(128000, bus.time_ns);
+
+    /* A bus behind the scheduler catches up before the next message */
+    scheduler_advance(&sched, 500000);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 1));
+    UNSIGNED_LONGS_EQUAL(564000, bus.time_ns);
+    UNSIGNED_LONGS_EQUAL(564000, sched.now_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_horizon__SchedulerHeldBack)
+{
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    spi_bus_set_scheduler(&bus, &sched);
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_horizon(nullptr, 0));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_horizon(&bus, 20000));
+
+    sched_event event;
+    sched_event_init(&event, ReleaseBusy, &device);
+    scheduler_schedule(&sched, &event, 30000);
+    u8 out[8] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+
+    /* 64 us pass on the bus, but the scheduler stops at the horizon and the event stays pending */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(64000, bus.time_ns);
+    UNSIGNED_LONGS_EQUAL(20000, sched.now_ns);
+    CHECK_TRUE(sched_event_pending(&event));
+
+    /* Once the horizon is lifted the scheduler catches up with the next message */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_horizon(&bus, SPI_BUS_NO_HORIZON));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(128000, bus.time_ns);
+    UNSIGNED_LONGS_EQUAL(128000, sched.now_ns);
+    CHECK_FALSE(sched_event_pending(&event));
+}
+
+TEST(Ut_SpiBus, spi_bus_attach_builtin__LoopbackAndNullServedByBus)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_attach_builtin(nullptr, 0, device_kind_loopback));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror, spi_bus_attach_builtin(&bus, 0, device_kind_model));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach_builtin(&bus, 0, device_kind_loopback));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach_builtin(&bus, 1, device_kind_null));
+
+    u8 out[100];
+    u8 in[100] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i + 1);
+    }
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 0, &tx, &rx, sizeof(out)));
+    MEMCMP_EQUAL(out, in, sizeof(out));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 1, &tx, &rx, sizeof(out)));
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(DEVICE_NULL_MISO, in[i]);
+    }
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 0, nullptr, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(0, in[0]);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 1, &tx, nullptr, sizeof(out)));
+
+    /* Built-in devices take bus time like any other */
+    UNSIGNED_LONGS_EQUAL(4, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(4 * sizeof(out) * 8000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_attach_builtin__GenericIteratorsTakeModelPath)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach_builtin(&bus, 0, device_kind_loopback));
+
+    u8 out[40];
+    u8 in[40] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(0xC0 + i);
+    }
+    CHECK_TRUE(packed_iterator_create(&tx, out, sizeof(out), 8));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 0, &tx, &rx, sizeof(out)));
+    MEMCMP_EQUAL(out, in, sizeof(out));
+
+    /* Non-identity modes are staged and transformed on the way there and back */
+    spi_mode host = {SPI_MODE_0, false};
+    spi_mode device = {SPI_MODE_0, true};
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_modes(&bus, 0, &host, &device));
+    iterator_destruct(&tx);
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 0, &tx, &rx, sizeof(out)));
+    MEMCMP_EQUAL(out, in, sizeof(out));
+}
+
+TEST(Ut_SpiBus, spi_bus_set_coalescing__SmallTransfersShareDeviceCall)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_coalescing(nullptr, true));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_coalescing(&bus, true));
+
+    /* Register write, register read, and a generic TX iterator in between */
+    const u8 write[3] = {0x40, 0x01, 0x02};
+    const u8 packed[2] = {0x55, 0xAA};
+    u8 read[4] = {};
+    iterator_instance writeIter = {};
+    CHECK_TRUE(array_iterator_create_const(&writeIter, write, sizeof(write), sizeof(u8)));
+    CHECK_TRUE(packed_iterator_create(&tx, packed, sizeof(packed), 8));
+    CHECK_TRUE(array_iterator_create(&rx, read, sizeof(read), sizeof(u8)));
+
+    spi_transfer xfers[3] = {};
+    xfers[0].tx = &writeIter;
+    xfers[0].len = sizeof(write);
+    xfers[1].tx = &tx;
+    xfers[1].len = sizeof(packed);
+    xfers[2].rx = &rx;
+    xfers[2].len = sizeof(read);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 3));
+
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.deselects);
+    CHECK_TRUE((std::vector<u8>{0x40, 0x01, 0x02, 0x55, 0xAA, 0, 0, 0, 0}) == device.mosi);
+    for (size i = 0; i < sizeof(read); ++i) {
+        UNSIGNED_LONGS_EQUAL(0xFF, read[i]);
+    }
+
+    /* Results are the same as without coalescing */
+    UNSIGNED_LONGS_EQUAL(3, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(9, bus.stats.bytes);
+    UNSIGNED_LONGS_EQUAL(2, bus.stats.coalesced);
+    UNSIGNED_LONGS_EQUAL(9 * 8000, bus.time_ns);
+    iterator_destruct(&writeIter);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_coalescing__RunsBrokenWhereBehaviourWouldChange)
+{
+    spi_bus_set_coalescing(&bus, true);
+
+    u8 out[8] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfers[6] = {};
+    for (auto& xfer : xfers) {
+        xfer.tx = &tx;
+        xfer.len = 4;
+    }
+    xfers[1].delay_usecs = 1; /* Delay after the transfer */
+    xfers[3].cs_change = true; /* Chip-select toggled after the transfer */
+    xfers[4].speed_hz = 2000000; /* Different clock */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 6));
+
+    /* {0, 1} {2, 3} {4} {5} */
+    UNSIGNED_LONGS_EQUAL(4, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(2, device.selects);
+    UNSIGNED_LONGS_EQUAL(2, bus.stats.coalesced);
+
+    /* Runs never outgrow the scratch memory */
+    device.exchanges = 0;
+    for (auto& xfer : xfers) {
+        xfer = {};
+        xfer.tx = &tx;
+        xfer.len = 8;
+    }
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 6));
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_coalescing__TransferLongerThanScratchNotCoalesced)
+{
+    spi_bus_set_coalescing(&bus, true);
+
+    u8 out[TEST_SCRATCH_SIZE * 3];
+    u8 in[TEST_SCRATCH_SIZE * 3] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i);
+    }
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    spi_transfer xfers[2] = {};
+    xfers[0].tx = &tx;
+    xfers[0].rx = &rx;
+    xfers[0].len = sizeof(out);
+    xfers[1].tx = &tx;
+    xfers[1].len = 4;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 2));
+
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.coalesced);
+    UNSIGNED_LONGS_EQUAL(sizeof(out) + 4, device.mosi.size());
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[i]), in[i]);
+    }
+}
+
+TEST(Ut_SpiBus, spi_bus_set_coalescing__ScheduledEventSplitsRun)
+{
+    spi_bus_set_coalescing(&bus, true);
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    spi_bus_set_scheduler(&bus, &sched);
+
+    /* The event falls due during the second transfer, so it fires before the third one */
+    sched_event event;
+    sched_event_init(&event, ReleaseBusy, &device);
+    scheduler_schedule(&sched, &event, 40000);
+    busyExchangesSeen = 0;
+
+    u8 out[4] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfers[4] = {};
+    for (auto& xfer : xfers) {
+        xfer.tx = &tx;
+        xfer.len = sizeof(out);
+    }
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 4));
+
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, busyExchangesSeen);
+    UNSIGNED_LONGS_EQUAL(128000, bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_coalescing__DisabledByDefault)
+{
+    u8 out[4] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    spi_transfer xfers[3] = {};
+    for (auto& xfer : xfers) {
+        xfer.tx = &tx;
+        xfer.len = sizeof(out);
+    }
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, xfers, 3));
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.coalesced);
+}
+
+static u64 statusVersion;
+
+/* Status register reads (0x05) have no side effects */
+static bool PureStatusRead(void* device, const u8* mosi, size len)
+{
+    (void)device;
+    return 0 < len && 0x05 == mosi[0];
+}
+
+TEST(Ut_SpiBus, spi_bus_set_cache__ErrorOnWrongParams)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_cache(nullptr, TEST_CS, PureStatusRead, &statusVersion));
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, nullptr));
+    ENUMS_EQUAL_INT(spi_bus_status_cerror,
+                    spi_bus_set_cache(&bus, SPI_BUS_MAX_SLAVES, PureStatusRead, &statusVersion));
+    ENUMS_EQUAL_INT(spi_bus_status_nodev, spi_bus_set_cache(&bus, 0, PureStatusRead, &statusVersion));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_cache(&bus, TEST_CS, nullptr, nullptr));
+}
+
+TEST(Ut_SpiBus, spi_bus_set_cache__RepeatedReadsAnsweredWithoutDevice)
+{
+    statusVersion = 0;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion));
+
+    const u8 out[2] = {0x05, 0x00};
+    u8 in[2] = {};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    CHECK_TRUE(array_iterator_create(&rx, in, sizeof(in), sizeof(u8)));
+    for (size i = 0; i < 10; ++i) {
+        in[0] = in[1] = 0;
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+        UNSIGNED_LONGS_EQUAL(0xFA, in[0]);
+        UNSIGNED_LONGS_EQUAL(0xFF, in[1]);
+    }
+
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(9, bus.stats.cached);
+
+    /* Results are the same as without the cache */
+    UNSIGNED_LONGS_EQUAL(10, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(20, bus.stats.bytes);
+    UNSIGNED_LONGS_EQUAL(20 * 8000, bus.time_ns);
+
+    /* A new version of the state invalidates the response */
+    ++statusVersion;
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+
+    /* So does attaching the line again */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach(&bus, TEST_CS, &FAKE_DEVICE_OPS, &device));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, &rx, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_cache__OnlyPureTransactionsCached)
+{
+    statusVersion = 0;
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+
+    /* Commands with side effects always reach the device */
+    const u8 write[2] = {0x06, 0x00};
+    CHECK_TRUE(array_iterator_create_const(&tx, write, sizeof(write), sizeof(u8)));
+    for (size i = 0; i < 3; ++i) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(write)));
+    }
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+
+    /* A chip-select left asserted keeps the transaction open, so it is never cached */
+    const u8 read[2] = {0x05, 0x00};
+    iterator_destruct(&tx);
+    CHECK_TRUE(array_iterator_create_const(&tx, read, sizeof(read), sizeof(u8)));
+    spi_transfer xfer = {&tx, nullptr, sizeof(read), 0, 0, 0, true, 0, 0};
+    for (size i = 0; i < 3; ++i) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_message(&bus, TEST_CS, &xfer, 1));
+    }
+    UNSIGNED_LONGS_EQUAL(6, device.exchanges);
+
+    /* Neither are transactions longer than an entry */
+    u8 longRead[SPI_BUS_CACHE_BYTES + 1] = {0x05};
+    spi_bus_detach(&bus, TEST_CS);
+    spi_bus_attach(&bus, TEST_CS, &FAKE_DEVICE_OPS, &device);
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+    iterator_destruct(&tx);
+    CHECK_TRUE(array_iterator_create_const(&tx, longRead, sizeof(longRead), sizeof(u8)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(longRead)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(longRead)));
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.cached);
+}
+
+/* Byte stream which, like a generator, continues where the previous traversal stopped */
+struct Stream
+{
+    const u8* data;
+    size pos;
+    size len;
+};
+
+static const void* StreamBegin(void* context)
+{
+    auto stream = static_cast<Stream*>(context);
+    return stream->data + stream->pos;
+}
+
+static const void* StreamNext(void* context)
+{
+    auto stream = static_cast<Stream*>(context);
+    return stream->data + ++stream->pos;
+}
+
+static const void* StreamEnd(void* context)
+{
+    auto stream = static_cast<Stream*>(context);
+    return stream->data + stream->len;
+}
+
+TEST(Ut_SpiBus, spi_bus_set_cache__NonRewindableMosiReadOnce)
+{
+    statusVersion = 0;
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+
+    /* Such an iterator cannot be read twice, so its bytes reach the device exactly once and nothing is cached */
+    const u8 bytes[4] = {0x05, 0x00, 0x06, 0x00};
+    CHECK_TRUE(iterator_status_ok == iterator_construct(&tx, sizeof(Stream)));
+    CHECK_TRUE(iterator_status_ok == iterator_init_as_const(&tx, StreamBegin, StreamNext, StreamEnd));
+    *static_cast<Stream*>(tx.context) = {bytes, 0, sizeof(bytes)};
+
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, 2));
+    CHECK_TRUE((std::vector<u8>{0x05, 0x00}) == device.mosi);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, 2));
+    CHECK_TRUE((std::vector<u8>{0x05, 0x00, 0x06, 0x00}) == device.mosi);
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.cached);
+}
+
+static bool writeInProgress;
+
+static void CompleteWrite(scheduler* sched, sched_event* event)
+{
+    (void)sched;
+    (void)event;
+    writeInProgress = false;
+    ++statusVersion;
+}
+
+TEST(Ut_SpiBus, spi_bus_set_fast_forward__PollingSkippedToNextEvent)
+{
+    ENUMS_EQUAL_INT(spi_bus_status_iptr, spi_bus_set_fast_forward(nullptr, true));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_set_fast_forward(&bus, true));
+    statusVersion = 0;
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    spi_bus_set_scheduler(&bus, &sched);
+
+    /* The write completes after 1 ms, polls take 16 us each */
+    writeInProgress = true;
+    sched_event event;
+    sched_event_init(&event, CompleteWrite, nullptr);
+    scheduler_schedule(&sched, &event, 1000000);
+
+    const u8 out[2] = {0x05, 0x00};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    size polls = 0;
+    while (writeInProgress && polls < 1000) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+        ++polls;
+    }
+
+    /* The first poll fills the cache and the next four form a run */
+    /* The last one is moved to 992 us, so its end fires the event as the end of the 63rd poll would */
+    UNSIGNED_LONGS_EQUAL(1 + SPI_BUS_POLL_REPEATS, polls);
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(58, bus.stats.skipped);
+    UNSIGNED_LONGS_EQUAL(62, bus.stats.cached);
+    UNSIGNED_LONGS_EQUAL(63, bus.stats.messages);
+    UNSIGNED_LONGS_EQUAL(63, bus.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(126, bus.stats.bytes);
+    UNSIGNED_LONGS_EQUAL(63 * 16000, bus.time_ns);
+    UNSIGNED_LONGS_EQUAL(bus.time_ns, sched.now_ns);
+
+    /* The next poll sees the new state */
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(2, device.exchanges);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_fast_forward__OnlySteadyUninterruptedPollingSkipped)
+{
+    spi_bus_set_fast_forward(&bus, true);
+    statusVersion = 0;
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+    ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_attach_builtin(&bus, 0, device_kind_null));
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    spi_bus_set_scheduler(&bus, &sched);
+    sched_event event;
+    sched_event_init(&event, CompleteWrite, nullptr);
+    scheduler_schedule(&sched, &event, 1000000);
+
+    /* Another message between polls */
+    const u8 out[2] = {0x05, 0x00};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    for (size i = 0; i < 10; ++i) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, 0, &tx, nullptr, sizeof(out)));
+    }
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.skipped);
+
+    /* Polls at a varying period */
+    for (size i = 0; i < 10; ++i) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+        scheduler_advance(&sched, sched.now_ns + 1000 * (i % 3));
+    }
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.skipped);
+
+    /* Steady polling with a firmware delay counted in the period */
+    writeInProgress = true;
+    size polls = 0;
+    while (writeInProgress && polls < 1000) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+        scheduler_advance(&sched, sched.now_ns + 4000);
+        ++polls;
+    }
+    CHECK_TRUE(0 < bus.stats.skipped);
+    CHECK_TRUE(SPI_BUS_POLL_REPEATS + 1 >= polls);
+    CHECK_TRUE(1000000 + 16000 >= bus.time_ns);
+}
+
+TEST(Ut_SpiBus, spi_bus_set_fast_forward__DisabledByDefault)
+{
+    statusVersion = 0;
+    spi_bus_set_cache(&bus, TEST_CS, PureStatusRead, &statusVersion);
+    scheduler sched;
+    scheduler_init(&sched, 0);
+    spi_bus_set_scheduler(&bus, &sched);
+    sched_event event;
+    sched_event_init(&event, CompleteWrite, nullptr);
+    scheduler_schedule(&sched, &event, 1000000);
+
+    const u8 out[2] = {0x05, 0x00};
+    CHECK_TRUE(array_iterator_create_const(&tx, out, sizeof(out), sizeof(u8)));
+    for (size i = 0; i < 10; ++i) {
+        ENUMS_EQUAL_INT(spi_bus_status_ok, spi_bus_transfer(&bus, TEST_CS, &tx, nullptr, sizeof(out)));
+    }
+    UNSIGNED_LONGS_EQUAL(0, bus.stats.skipped);
+    UNSIGNED_LONGS_EQUAL(10 * 16000, bus.time_ns);
+}
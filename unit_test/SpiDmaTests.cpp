@@ -0,0 +1,209 @@
+#include "AllTests.h"
+#include "spi_dma.h"
+#include "Fakes.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_CS 5
+#define TEST_BURST 16
+#define TEST_GAP_NS 500
+
+/* 8 clocks per byte at the default 1 MHz */
+#define TEST_BYTE_NS 8000
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Helpers ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+struct Irq
+{
+    size calls = 0;
+    u64 time_ns = 0;
+    scheduler* sched = nullptr;
+    std::vector<u64> trace;
+};
+
+static void RecordIrq(spi_dma_channel* channel, void* ctx)
+{
+    auto irq = static_cast<Irq*>(ctx);
+    ++irq->calls;
+    irq->time_ns = nullptr != irq->sched ? irq->sched->now_ns : channel->bus->time_ns;
+    irq->trace.push_back(channel->stats.bursts);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_SpiDma)
+{
+    spi_bus bus = {};
+    FakeDevice device;
+    spi_dma_channel channel = {};
+    Irq irq;
+
+    void setup() override
+    {
+        auto status = spi_bus_construct(&bus);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot construct shared bus");
+        status = spi_bus_attach(&bus, TEST_CS, &FAKE_DEVICE_OPS, &device);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot attach fake device");
+        auto dmaStatus = spi_dma_init(&channel, &bus, TEST_CS, TEST_BURST, TEST_GAP_NS);
+        ENUMS_EQUAL_INT_TEXT(spi_dma_status_ok, dmaStatus, "Cannot init shared channel");
+        spi_dma_set_irq(&channel, RecordIrq, &irq);
+    }
+
+    void teardown() override
+    {
+        spi_bus_destruct(&bus);
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_SpiDma, NullCases)
+{
+    ENUMS_EQUAL_INT(spi_dma_status_iptr, spi_dma_init(nullptr, &bus, 0, 1, 0));
+    ENUMS_EQUAL_INT(spi_dma_status_iptr, spi_dma_init(&channel, nullptr, 0, 1, 0));
+    ENUMS_EQUAL_INT(spi_dma_status_iptr, spi_dma_set_irq(nullptr, RecordIrq, nullptr));
+    ENUMS_EQUAL_INT(spi_dma_status_iptr, spi_dma_start(nullptr, nullptr, nullptr, 1));
+}
+
+TEST(Ut_SpiDma, spi_dma_init__ErrorOnWrongParams)
+{
+    spi_dma_channel other;
+    ENUMS_EQUAL_INT(spi_dma_status_cerror, spi_dma_init(&other, &bus, SPI_BUS_MAX_SLAVES, 1, 0));
+    ENUMS_EQUAL_INT(spi_dma_status_cerror, spi_dma_init(&other, &bus, 0, 0, 0));
+}
+
+TEST(Ut_SpiDma, spi_dma_start__ErrorOnWrongParams)
+{
+    ENUMS_EQUAL_INT(spi_dma_status_cerror, spi_dma_start(&channel, nullptr, nullptr, 0));
+    spi_dma_channel other;
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_init(&other, &bus, TEST_CS + 1, 1, 0));
+    ENUMS_EQUAL_INT(spi_dma_status_nodev, spi_dma_start(&other, nullptr, nullptr, 1));
+    UNSIGNED_LONGS_EQUAL(0, device.selects);
+}
+
+TEST(Ut_SpiDma, spi_dma_start__BurstsExchangedInPlace)
+{
+    u8 out[100];
+    u8 in[100] = {};
+    for (size i = 0; i < sizeof(out); ++i) {
+        out[i] = static_cast<u8>(i * 3);
+    }
+
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, out, in, sizeof(out)));
+    CHECK_FALSE(channel.busy);
+    UNSIGNED_LONGS_EQUAL(1, irq.calls);
+
+    /* One exchange per burst, every one over the caller's memory, all within a single selection */
+    UNSIGNED_LONGS_EQUAL(7, channel.stats.bursts);
+    UNSIGNED_LONGS_EQUAL(7, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(7, device.contiguous);
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.deselects);
+    MEMCMP_EQUAL(out, device.mosi.data(), sizeof(out));
+    for (size i = 0; i < sizeof(in); ++i) {
+        UNSIGNED_LONGS_EQUAL(static_cast<u8>(~out[i]), in[i]);
+    }
+
+    UNSIGNED_LONGS_EQUAL(sizeof(out) * TEST_BYTE_NS + 6 * TEST_GAP_NS, bus.time_ns);
+    UNSIGNED_LONGS_EQUAL(bus.time_ns, irq.time_ns);
+    UNSIGNED_LONGS_EQUAL(1, channel.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(sizeof(out), channel.stats.bytes);
+}
+
+TEST(Ut_SpiDma, spi_dma_start__MissingBuffers)
+{
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, nullptr, nullptr, 20));
+    UNSIGNED_LONGS_EQUAL(20, device.mosi.size());
+    for (u8 byte : device.mosi) {
+        UNSIGNED_LONGS_EQUAL(0, byte);
+    }
+    UNSIGNED_LONGS_EQUAL(1, irq.calls);
+}
+
+TEST(Ut_SpiDma, spi_dma_start__BurstsAreScheduledEvents)
+{
+    scheduler sched;
+    scheduler_init(&sched, 1000);
+    spi_bus_set_scheduler(&bus, &sched);
+    irq.sched = &sched;
+
+    /* An event of another device falls between the first and the second burst */
+    static std::vector<u64> bursts;
+    bursts.clear();
+    sched_event other;
+    sched_event_init(&other, [](scheduler* s, sched_event* e) {
+        (void)s;
+        bursts.push_back(static_cast<spi_dma_channel*>(e->ctx)->stats.bursts);
+    }, &channel);
+    scheduler_schedule(&sched, &other, 1000 + TEST_BURST * TEST_BYTE_NS + 1);
+
+    u8 out[40] = {};
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, out, nullptr, sizeof(out)));
+    CHECK_TRUE(channel.busy);
+    ENUMS_EQUAL_INT(spi_dma_status_busy, spi_dma_start(&channel, out, nullptr, sizeof(out)));
+    UNSIGNED_LONGS_EQUAL(0, device.exchanges);
+
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 1000000));
+    CHECK_FALSE(channel.busy);
+    UNSIGNED_LONGS_EQUAL(3, device.exchanges);
+    UNSIGNED_LONGS_EQUAL(1, device.selects);
+    UNSIGNED_LONGS_EQUAL(1, device.deselects);
+    CHECK_TRUE((std::vector<u64>{1}) == bursts);
+
+    /* The interrupt fires at the end of the last burst */
+    UNSIGNED_LONGS_EQUAL(1, irq.calls);
+    UNSIGNED_LONGS_EQUAL(1000 + sizeof(out) * TEST_BYTE_NS + 2 * TEST_GAP_NS, irq.time_ns);
+    UNSIGNED_LONGS_EQUAL(3, irq.trace[0]);
+
+    /* The channel is free again */
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, out, nullptr, 1));
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 2000000));
+    UNSIGNED_LONGS_EQUAL(2, irq.calls);
+}
+
+TEST(Ut_SpiDma, spi_dma_start__BusErrorStopsTransfer)
+{
+    scheduler sched;
+    scheduler_init(&sched, 1000);
+    spi_bus_set_scheduler(&bus, &sched);
+    irq.sched = &sched;
+
+    /* The device goes away between the first and the second burst */
+    sched_event detach;
+    sched_event_init(&detach, [](scheduler* s, sched_event* e) {
+        (void)s;
+        spi_bus_detach(static_cast<spi_bus*>(e->ctx), TEST_CS);
+    }, &bus);
+    scheduler_schedule(&sched, &detach, 1000 + TEST_BURST * TEST_BYTE_NS + 1);
+
+    u8 out[40] = {};
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, out, nullptr, sizeof(out)));
+    ENUMS_EQUAL_INT(scheduler_status_ok, scheduler_advance(&sched, 1000000));
+
+    CHECK_FALSE(channel.busy);
+    ENUMS_EQUAL_INT(spi_bus_status_nodev, channel.status);
+    UNSIGNED_LONGS_EQUAL(1, irq.calls);
+    UNSIGNED_LONGS_EQUAL(1, channel.stats.bursts);
+    UNSIGNED_LONGS_EQUAL(TEST_BURST, channel.stats.bytes);
+    UNSIGNED_LONGS_EQUAL(0, channel.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(1, channel.stats.errors);
+    UNSIGNED_LONGS_EQUAL(1, device.exchanges);
+}
+
+TEST(Ut_SpiDma, spi_dma_start__StatusOkAfterSuccessfulTransfer)
+{
+    u8 out[4] = {};
+    ENUMS_EQUAL_INT(spi_dma_status_ok, spi_dma_start(&channel, out, nullptr, sizeof(out)));
+    ENUMS_EQUAL_INT(spi_bus_status_ok, channel.status);
+    UNSIGNED_LONGS_EQUAL(1, channel.stats.transfers);
+    UNSIGNED_LONGS_EQUAL(0, channel.stats.errors);
+}
@@ -0,0 +1,85 @@
+#include "AllTests.h"
+#include "spi_lanes.h"
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+/* Bit by bit reference of spi_lanes_split() */
+static std::vector<u8> splitReference(const std::vector<u8>& src, u8 nbits)
+{
+    size stride = spi_lanes_stride(src.size(), nbits);
+    std::vector<u8> lines(nbits * stride, 0);
+    size clock = 0;
+    for (auto byte : src) {
+        for (int first = 7; first >= 0; first -= nbits, ++clock) {
+            for (u8 k = 0; k < nbits; ++k) {
+                u8 bit = (byte >> (first - (nbits - 1) + k)) & 1;
+                lines[k * stride + clock / 8] |= static_cast<u8>(bit << (7 - clock % 8));
+            }
+        }
+    }
+    return lines;
+}
+
+static std::vector<u8> pattern(size len)
+{
+    std::vector<u8> data(len);
+    u32 x = 0x12345678;
+    for (auto& byte : data) {
+        x = x * 1103515245 + 12345;
+        byte = static_cast<u8>(x >> 24);
+    }
+    return data;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_SpiLanes)
+{
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_SpiLanes, spi_lanes_valid__OnlyPowersOfTwoUpToEight)
+{
+    CHECK_TRUE(spi_lanes_valid(SPI_LANES_SINGLE));
+    CHECK_TRUE(spi_lanes_valid(SPI_LANES_DUAL));
+    CHECK_TRUE(spi_lanes_valid(SPI_LANES_QUAD));
+    CHECK_TRUE(spi_lanes_valid(SPI_LANES_OCTAL));
+    CHECK_FALSE(spi_lanes_valid(0));
+    CHECK_FALSE(spi_lanes_valid(3));
+    CHECK_FALSE(spi_lanes_valid(16));
+}
+
+TEST(Ut_SpiLanes, spi_lanes_split__QuadNibblesGoToLines)
+{
+    /* Nibbles F 0 8 1 0 0 F F: 0x8 drives IO3 alone, 0x1 drives IO0 alone */
+    const u8 src[4] = {0xF0, 0x81, 0x00, 0xFF};
+    u8 lines[4];
+    spi_lanes_split(src, sizeof(src), SPI_LANES_QUAD, lines);
+    const u8 expected[4] = {0x93, 0x83, 0x83, 0xA3};
+    MEMCMP_EQUAL(expected, lines, sizeof(lines));
+}
+
+TEST(Ut_SpiLanes, spi_lanes_split__MatchesBitLevelReference)
+{
+    for (u8 nbits : {SPI_LANES_SINGLE, SPI_LANES_DUAL, SPI_LANES_QUAD, SPI_LANES_OCTAL}) {
+        for (size len : {1, 3, 7, 8, 9, 16, 61, 64, 259}) {
+            auto src = pattern(len);
+            auto expected = splitReference(src, nbits);
+            std::vector<u8> lines(expected.size(), 0xAA);
+            spi_lanes_split(src.data(), len, nbits, lines.data());
+            CHECK_TRUE_TEXT(expected == lines, "Split differs from the reference");
+
+            std::vector<u8> merged(len);
+            spi_lanes_merge(lines.data(), len, nbits, merged.data());
+            CHECK_TRUE_TEXT(src == merged, "Merge is not the reverse of split");
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include "AllTests.h"
+#include "spi_mode.h"
+#include <cstring>
+#include <vector>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static u32 reverseBits(u32 value, u8 bits)
+{
+    u32 out = 0;
+    for (u8 i = 0; i < bits; ++i) {
+        out = (out << 1) | ((value >> i) & 1);
+    }
+    return out;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_SpiMode)
+{
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_SpiMode, spi_mode_word_bytes__ContainerFollowsWordSize)
+{
+    CHECK_FALSE(spi_mode_bpw_valid(3));
+    CHECK_TRUE(spi_mode_bpw_valid(4));
+    CHECK_TRUE(spi_mode_bpw_valid(32));
+    CHECK_FALSE(spi_mode_bpw_valid(33));
+    UNSIGNED_LONGS_EQUAL(1, spi_mode_word_bytes(4));
+    UNSIGNED_LONGS_EQUAL(1, spi_mode_word_bytes(8));
+    UNSIGNED_LONGS_EQUAL(2, spi_mode_word_bytes(9));
+    UNSIGNED_LONGS_EQUAL(2, spi_mode_word_bytes(16));
+    UNSIGNED_LONGS_EQUAL(4, spi_mode_word_bytes(17));
+    UNSIGNED_LONGS_EQUAL(4, spi_mode_word_bytes(32));
+}
+
+TEST(Ut_SpiMode, spi_mode_reverse__AllWordSizes)
+{
+    for (u8 bpw = SPI_MODE_MIN_BITS_PER_WORD; bpw <= SPI_MODE_MAX_BITS_PER_WORD; ++bpw) {
+        /* Long enough to reach the SIMD kernel and leave a tail */
+        const size count = 37;
+        size word_bytes = spi_mode_word_bytes(bpw);
+        std::vector<u8> buffer(count * word_bytes);
+        std::vector<u32> expected(count);
+        u32 x = bpw;
+        for (size i = 0; i < count; ++i) {
+            x = x * 2654435761u + 1;
+            u32 word = x & static_cast<u32>((static_cast<u64>(1) << bpw) - 1);
+            expected[i] = reverseBits(word, bpw);
+            memcpy(&buffer[i * word_bytes], &word, word_bytes);
+        }
+
+        spi_mode_reverse(buffer.data(), count, bpw);
+        for (size i = 0; i < count; ++i) {
+            u32 word = 0;
+            memcpy(&word, &buffer[i * word_bytes], word_bytes);
+            UNSIGNED_LONGS_EQUAL_TEXT(expected[i], word, "Wrong reversal");
+        }
+    }
+}
+
+TEST(Ut_SpiMode, spi_mode_shift__CarryPassedBetweenChunks)
+{
+    u8 words[4] = {0x0F, 0x08, 0x01, 0x00};
+    u32 carry = spi_mode_shift(words, 2, 4, 1);
+    UNSIGNED_LONGS_EQUAL(0, carry);
+    carry = spi_mode_shift(words + 2, 2, 4, carry);
+    UNSIGNED_LONGS_EQUAL(0, carry);
+    const u8 expected[4] = {0x0F, 0x0C, 0x00, 0x08};
+    MEMCMP_EQUAL(expected, words, sizeof(words));
+
+    /* Bits above the word size are ignored */
+    u32 wide[1] = {0xFFFFFFFF};
+    UNSIGNED_LONGS_EQUAL(1, spi_mode_shift(wide, 1, 32, 0));
+    UNSIGNED_LONGS_EQUAL(0x7FFFFFFF, wide[0]);
+}
+
+TEST(Ut_SpiMode, spi_mode_transform_between__EdgesAndBitOrder)
+{
+    spi_mode modes[4] = {{SPI_MODE_0, false}, {SPI_MODE_1, false}, {SPI_MODE_2, false}, {SPI_MODE_3, false}};
+    for (u8 a = 0; a < 4; ++a) {
+        for (u8 b = 0; b < 4; ++b) {
+            auto t = spi_mode_transform_between(&modes[a], &modes[b]);
+            bool sameEdge = (a == b) || (a + b == 3);
+            CHECK_EQUAL(sameEdge, spi_mode_transform_identity(&t));
+        }
+    }
+
+    spi_mode lsb = {SPI_MODE_0, true};
+    auto t = spi_mode_transform_between(&modes[0], &lsb);
+    CHECK_FALSE(spi_mode_transform_identity(&t));
+    u16 words[2] = {0x0001, 0x0300};
+    UNSIGNED_LONGS_EQUAL(0, spi_mode_apply(&t, words, 2, 16, 0));
+    UNSIGNED_LONGS_EQUAL(0x8000, words[0]);
+    UNSIGNED_LONGS_EQUAL(0x00C0, words[1]);
+
+    /* Reversal, delay and reversal back */
+    spi_mode lsb1 = {SPI_MODE_1, true};
+    t = spi_mode_transform_between(&lsb, &lsb1);
+    u8 bytes[2] = {0x01, 0x80};
+    UNSIGNED_LONGS_EQUAL(1, spi_mode_apply(&t, bytes, 2, 8, 0));
+    UNSIGNED_LONGS_EQUAL(0x02, bytes[0]);
+    UNSIGNED_LONGS_EQUAL(0x00, bytes[1]);
+}
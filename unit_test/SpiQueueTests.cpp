@@ -0,0 +1,217 @@
+#include "AllTests.h"
+#include "spi_queue.h"
+#include "Fakes.h"
+#include <atomic>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private macros ----------------------------- */
+/* ------------------------------------------------------------------------- */
+
+#define TEST_ENTRIES 8
+#define TEST_CS 1
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- Private functions -------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static size callbacks;
+
+static void countCompletion(const spi_queue_completion* completion)
+{
+    static_cast<void>(completion);
+    ++callbacks;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_SpiQueue)
+{
+    spi_bus bus = {};
+    spi_queue queue = {};
+    FakeDevice device;
+    spi_transfer xfer = {};
+    int efd = -1;
+
+    void setup() override
+    {
+        auto status = spi_bus_construct(&bus);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot construct shared bus");
+        status = spi_bus_attach(&bus, TEST_CS, &FAKE_DEVICE_OPS, &device);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot attach fake device");
+        efd = eventfd(0, 0);
+        CHECK_TRUE_TEXT(0 <= efd, "Cannot create eventfd");
+        auto qs = spi_queue_construct_ext(&queue, &bus, TEST_ENTRIES, efd, malloc, free);
+        ENUMS_EQUAL_INT_TEXT(spi_queue_status_ok, qs, "Cannot construct shared queue");
+        xfer.len = 4;
+        callbacks = 0;
+    }
+
+    void teardown() override
+    {
+        auto qs = spi_queue_destruct(&queue);
+        ENUMS_EQUAL_INT_TEXT(spi_queue_status_ok, qs, "Cannot destruct shared queue");
+        close(efd);
+        auto status = spi_bus_destruct(&bus);
+        ENUMS_EQUAL_INT_TEXT(spi_bus_status_ok, status, "Cannot destruct shared bus");
+    }
+
+    spi_queue_entry entry(u32 cs, size tag)
+    {
+        spi_queue_entry e = {};
+        e.cs = cs;
+        e.transfers = &xfer;
+        e.count = 1;
+        e.user_data = reinterpret_cast<void*>(tag);
+        e.complete = countCompletion;
+        return e;
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_SpiQueue, NullCases)
+{
+    spi_queue other;
+    spi_queue_completion completion;
+    size reaped;
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_construct_ext(nullptr, &bus, 8, SPI_QUEUE_NO_FD, malloc, free));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_construct_ext(&other, nullptr, 8, SPI_QUEUE_NO_FD, malloc, free));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_construct_ext(&other, &bus, 8, SPI_QUEUE_NO_FD, nullptr, free));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_construct_ext(&other, &bus, 8, SPI_QUEUE_NO_FD, malloc, nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_destruct_ext(nullptr, free));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_destruct_ext(&queue, nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_submit(nullptr, nullptr, 1));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_reap(nullptr, &completion, 1, &reaped));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_reap(&queue, nullptr, 1, &reaped));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_reap(&queue, &completion, 1, nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_wait(nullptr, 1));
+}
+
+TEST(Ut_SpiQueue, spi_queue_construct_ext__ErrorOnWrongParams)
+{
+    spi_queue other;
+    ENUMS_EQUAL_INT(spi_queue_status_cerror, spi_queue_construct_ext(&other, &bus, 0, SPI_QUEUE_NO_FD, malloc, free));
+    ENUMS_EQUAL_INT(spi_queue_status_cerror, spi_queue_construct_ext(&other, &bus, 6, SPI_QUEUE_NO_FD, malloc, free));
+    ENUMS_EQUAL_INT(spi_queue_status_merror,
+                    spi_queue_construct_ext(&other, &bus, 8, SPI_QUEUE_NO_FD, FakeMalloc, free));
+}
+
+TEST(Ut_SpiQueue, spi_queue_submit__BatchCompletedInOrder)
+{
+    spi_queue_entry entries[TEST_ENTRIES];
+    for (size i = 0; i < TEST_ENTRIES; ++i) {
+        entries[i] = entry(TEST_CS, i);
+    }
+    entries[3].cs = 0; /* Nothing attached */
+
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&queue, entries, TEST_ENTRIES));
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_wait(&queue, TEST_ENTRIES));
+
+    spi_queue_completion completions[TEST_ENTRIES];
+    size reaped = 0;
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_reap(&queue, completions, TEST_ENTRIES, &reaped));
+    UNSIGNED_LONGS_EQUAL(TEST_ENTRIES, reaped);
+    for (size i = 0; i < TEST_ENTRIES; ++i) {
+        POINTERS_EQUAL(reinterpret_cast<void*>(i), completions[i].user_data);
+        ENUMS_EQUAL_INT(3 == i ? spi_bus_status_nodev : spi_bus_status_ok, completions[i].status);
+    }
+    UNSIGNED_LONGS_EQUAL(TEST_ENTRIES, callbacks);
+    UNSIGNED_LONGS_EQUAL(TEST_ENTRIES - 1, device.exchanges);
+
+    /* Eventfd accumulates the number of completions */
+    u64 counter = 0;
+    UNSIGNED_LONGS_EQUAL(sizeof(counter), read(efd, &counter, sizeof(counter)));
+    UNSIGNED_LONGS_EQUAL(TEST_ENTRIES, counter);
+
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_reap(&queue, completions, TEST_ENTRIES, &reaped));
+    UNSIGNED_LONGS_EQUAL(0, reaped);
+}
+
+TEST(Ut_SpiQueue, spi_queue_submit__BusyUntilCompletionsReaped)
+{
+    spi_queue_entry entries[TEST_ENTRIES + 1];
+    for (size i = 0; i < TEST_ENTRIES + 1; ++i) {
+        entries[i] = entry(TEST_CS, i);
+    }
+    ENUMS_EQUAL_INT(spi_queue_status_busy, spi_queue_submit(&queue, entries, TEST_ENTRIES + 1));
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&queue, entries, TEST_ENTRIES));
+    ENUMS_EQUAL_INT(spi_queue_status_busy, spi_queue_submit(&queue, entries, 1));
+    ENUMS_EQUAL_INT(spi_queue_status_cerror, spi_queue_wait(&queue, TEST_ENTRIES + 1));
+
+    /* Reaping part of the completions frees the same number of slots */
+    spi_queue_completion completions[2];
+    size reaped = 0;
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_wait(&queue, 2));
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_reap(&queue, completions, 2, &reaped));
+    UNSIGNED_LONGS_EQUAL(2, reaped);
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&queue, entries, 2));
+    ENUMS_EQUAL_INT(spi_queue_status_busy, spi_queue_submit(&queue, entries, 1));
+}
+
+TEST(Ut_SpiQueue, spi_queue_submit__ManyRoundTrips)
+{
+    /* Exercise sleeping and waking of both sides */
+    size total = 0;
+    for (size round = 0; round < 1000; ++round) {
+        spi_queue_entry e = entry(TEST_CS, round);
+        ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&queue, &e, 1));
+        ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_wait(&queue, 1));
+
+        spi_queue_completion completion;
+        size reaped = 0;
+        ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_reap(&queue, &completion, 1, &reaped));
+        UNSIGNED_LONGS_EQUAL(1, reaped);
+        POINTERS_EQUAL(reinterpret_cast<void*>(round), completion.user_data);
+        total += reaped;
+    }
+    UNSIGNED_LONGS_EQUAL(1000, total);
+    UNSIGNED_LONGS_EQUAL(1000 * xfer.len, bus.stats.bytes);
+}
+
+static std::atomic<size> services;
+static pthread_t serviceThread;
+
+static bool countService(void* ctx)
+{
+    static_cast<void>(ctx);
+    serviceThread = pthread_self();
+    services.fetch_add(1);
+    return false;
+}
+
+TEST(Ut_SpiQueue, spi_queue_kick__ServiceRunsOnWorker)
+{
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_set_service(nullptr, countService, nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_set_service(&queue, nullptr, nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_kick(nullptr));
+
+    services = 0;
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_set_service(&queue, countService, nullptr));
+    for (size round = 1; round <= 100; ++round) {
+        ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_kick(&queue));
+        while (services.load() < round) {
+            sched_yield();
+        }
+    }
+    CHECK_TRUE(pthread_equal(queue.worker, serviceThread));
+}
+
+TEST(Ut_SpiQueue, spi_queue_stop__SubmittedMessagesExecuted)
+{
+    spi_queue_entry entries[3] = {entry(TEST_CS, 0), entry(TEST_CS, 1), entry(TEST_CS, 2)};
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_submit(&queue, entries, 3));
+    ENUMS_EQUAL_INT(spi_queue_status_iptr, spi_queue_stop(nullptr));
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_stop(&queue));
+    UNSIGNED_LONGS_EQUAL(3, callbacks);
+
+    /* A stopped queue may still be kicked and stopped again */
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_kick(&queue));
+    ENUMS_EQUAL_INT(spi_queue_status_ok, spi_queue_stop(&queue));
+}
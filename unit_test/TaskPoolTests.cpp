@@ -0,0 +1,184 @@
+#include "AllTests.h"
+#include "Fakes.h"
+#include "task_pool.h"
+#include <atomic>
+#include <sched.h>
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Helpers ---------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+static void Count(void* arg)
+{
+    static_cast<std::atomic<size>*>(arg)->fetch_add(1);
+}
+
+struct Tree
+{
+    task_pool* pool;
+    std::atomic<size> nodes;
+    std::atomic<size> failures;
+};
+
+struct Node
+{
+    Tree* tree;
+    size depth;
+};
+
+static Node NODES[1 << 12];
+
+/* Every node spawns its two children from the worker running it */
+static void Visit(void* arg)
+{
+    auto node = static_cast<Node*>(arg);
+    auto index = static_cast<size>(node - NODES);
+    node->tree->nodes.fetch_add(1);
+    if (0 == node->depth) {
+        return;
+    }
+    for (size child = 2 * index + 1; child <= 2 * index + 2; ++child) {
+        NODES[child] = {node->tree, node->depth - 1};
+        if (task_pool_status_ok != task_pool_submit(node->tree->pool, Visit, &NODES[child])) {
+            node->tree->failures.fetch_add(1);
+        }
+    }
+}
+
+static void Hold(void* arg)
+{
+    auto gate = static_cast<std::atomic<bool>*>(arg);
+    while (!gate->load()) {
+        sched_yield();
+    }
+}
+
+static u64 Executed(const task_pool& pool)
+{
+    u64 executed = 0;
+    for (size i = 0; i < pool.count; ++i) {
+        executed += pool.workers[i].executed;
+    }
+    return executed;
+}
+
+/* ------------------------------------------------------------------------- */
+/* ----------------------------- Test groups ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST_GROUP(Ut_TaskPool)
+{
+    task_pool pool;
+
+    void setup() override
+    {
+        auto status = task_pool_construct(&pool, 4);
+        ENUMS_EQUAL_INT_TEXT(task_pool_status_ok, status, "Cannot construct shared pool");
+    }
+
+    void teardown() override
+    {
+        task_pool_destruct(&pool);
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ Test cases ------------------------------- */
+/* ------------------------------------------------------------------------- */
+
+TEST(Ut_TaskPool, NullCases)
+{
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_construct_ext(nullptr, 1, 16, malloc, free));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_construct_ext(&pool, 1, 16, nullptr, free));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_construct_ext(&pool, 1, 16, malloc, nullptr));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_destruct_ext(nullptr, free));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_destruct_ext(&pool, nullptr));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_submit(nullptr, Count, nullptr));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_submit(&pool, nullptr, nullptr));
+    ENUMS_EQUAL_INT(task_pool_status_iptr, task_pool_wait(nullptr));
+}
+
+TEST(Ut_TaskPool, task_pool_construct__ErrorOnWrongParameters)
+{
+    task_pool other;
+    ENUMS_EQUAL_INT(task_pool_status_cerror, task_pool_construct_ext(&other, 0, 16, malloc, free));
+    ENUMS_EQUAL_INT(task_pool_status_cerror, task_pool_construct_ext(&other, 1, 0, malloc, free));
+    ENUMS_EQUAL_INT(task_pool_status_cerror, task_pool_construct_ext(&other, 1, 24, malloc, free));
+}
+
+TEST(Ut_TaskPool, task_pool_construct__ErrorWhenAllocatorFails)
+{
+    task_pool other;
+    ENUMS_EQUAL_INT(task_pool_status_merror, task_pool_construct_ext(&other, 1, 16, FakeMalloc, free));
+}
+
+TEST(Ut_TaskPool, task_pool_wait__ReturnsAtOnceWithoutTasks)
+{
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_wait(&pool));
+}
+
+TEST(Ut_TaskPool, task_pool_submit__EveryTaskRunsOnce)
+{
+    std::atomic<size> counter(0);
+    for (size round = 0; round < 100; ++round) {
+        for (size i = 0; i < 1000; ++i) {
+            ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&pool, Count, &counter));
+        }
+        ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_wait(&pool));
+        UNSIGNED_LONGS_EQUAL((round + 1) * 1000, counter.load());
+    }
+    UNSIGNED_LONGS_EQUAL(100000, Executed(pool));
+}
+
+TEST(Ut_TaskPool, task_pool_submit__TasksSpawnTasks)
+{
+    task_pool wide;
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_construct_ext(&wide, 4, 4096, malloc, free));
+
+    Tree tree;
+    tree.pool = &wide;
+    tree.nodes = 0;
+    tree.failures = 0;
+    NODES[0] = {&tree, 10};
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&wide, Visit, &NODES[0]));
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_wait(&wide));
+
+    UNSIGNED_LONGS_EQUAL(0, tree.failures.load());
+    UNSIGNED_LONGS_EQUAL(2047, tree.nodes.load());
+    UNSIGNED_LONGS_EQUAL(2047, Executed(wide));
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_destruct(&wide));
+}
+
+TEST(Ut_TaskPool, task_pool_submit__BusyWhenAllDescriptorsAreUsed)
+{
+    task_pool small;
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_construct_ext(&small, 1, 2, malloc, free));
+
+    std::atomic<bool> gate(false);
+    std::atomic<size> counter(0);
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&small, Hold, &gate));
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&small, Count, &counter));
+    ENUMS_EQUAL_INT(task_pool_status_busy, task_pool_submit(&small, Count, &counter));
+
+    gate = true;
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_wait(&small));
+    UNSIGNED_LONGS_EQUAL(1, counter.load());
+
+    /* Descriptors are back on the free list */
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&small, Count, &counter));
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&small, Count, &counter));
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_destruct(&small));
+    UNSIGNED_LONGS_EQUAL(3, counter.load());
+}
+
+TEST(Ut_TaskPool, task_pool_destruct__FinishesSubmittedTasks)
+{
+    task_pool other;
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_construct(&other, 2));
+    std::atomic<size> counter(0);
+    for (size i = 0; i < 500; ++i) {
+        ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_submit(&other, Count, &counter));
+    }
+    ENUMS_EQUAL_INT(task_pool_status_ok, task_pool_destruct(&other));
+    UNSIGNED_LONGS_EQUAL(500, counter.load());
+}